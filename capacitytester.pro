@@ -15,6 +15,7 @@ INCLUDEPATH = inc/
 HEADERS = inc/*
 SOURCES = src/*
 QT += widgets
+unix:LIBS += -lrt
 
 DEFINES += PROGRAM=\\\"CapacityTester\\\"
 
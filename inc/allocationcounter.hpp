@@ -0,0 +1,75 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef ALLOCATIONCOUNTER_HPP
+#define ALLOCATIONCOUNTER_HPP
+
+#include <cstdlib>
+#include <cstddef>
+#include <cerrno>
+
+#include <QtGlobal>
+
+#define USE_ALLOCATION_COUNTER
+#if !defined(__GLIBC__) || defined(NO_ALLOCATION_COUNTER)
+#undef USE_ALLOCATION_COUNTER
+#endif
+
+class AllocationCounter
+{
+public:
+
+    struct Counts
+    {
+        qint64
+        count;
+
+        qint64
+        bytes;
+
+    };
+
+    typedef void (*Hook)(size_t size);
+
+    class Suspend
+    {
+    public:
+
+        Suspend();
+
+        ~Suspend();
+
+    };
+
+    static bool
+    isEnabled();
+
+    static Hook
+    setHook(Hook hook);
+
+    static void
+    count(size_t size);
+
+    static Counts
+    current();
+
+};
+
+#endif
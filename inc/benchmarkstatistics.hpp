@@ -0,0 +1,114 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef BENCHMARKSTATISTICS_HPP
+#define BENCHMARKSTATISTICS_HPP
+
+#include <cmath>
+#include <algorithm>
+
+#include <QList>
+#include <QVector>
+#include <QPair>
+#include <QVariant>
+
+class BenchmarkStatistics
+{
+public:
+
+    struct Comparison
+    {
+        double
+        difference;
+
+        double
+        p_value;
+
+        bool
+        significant;
+
+    };
+
+    static const int
+    MIN_ROUNDS = 3;
+
+    static BenchmarkStatistics
+    fromBlocks(const QVector<QPair<qint64, qint64> > &blocks, qint64 start,
+        int batches = 30);
+
+    static BenchmarkStatistics
+    fromVariantMap(const QVariantMap &map);
+
+    static Comparison
+    compare(const BenchmarkStatistics &a, const BenchmarkStatistics &b,
+        double alpha = 0.05);
+
+    BenchmarkStatistics();
+
+    void
+    add(double value);
+
+    void
+    add(const BenchmarkStatistics &other);
+
+    int
+    count() const;
+
+    QList<double>
+    samples() const;
+
+    double
+    median() const;
+
+    double
+    mean() const;
+
+    double
+    stddev() const;
+
+    double
+    mad() const;
+
+    double
+    percentile(double p) const;
+
+    double
+    confidenceLow() const;
+
+    double
+    confidenceHigh() const;
+
+    QVariantMap
+    toVariantMap() const;
+
+private:
+
+    QList<double>
+    sorted() const;
+
+    double
+    confidenceHalfWidth() const;
+
+    QList<double>
+    values;
+
+};
+
+#endif
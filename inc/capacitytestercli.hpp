@@ -23,6 +23,8 @@
 
 #include <cassert>
 #include <iostream>
+#include <cerrno>
+#include <algorithm>
 
 #include <QCoreApplication>
 #include <QDebug>
@@ -31,9 +33,17 @@
 #include <QCommandLineParser>
 #include <QSignalMapper>
 #include <QThread>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QRegExp>
 
 #include "size.hpp"
 #include "volumetester.hpp"
+#include "imagewriter.hpp"
+#include "partitiontester.hpp"
+#include "devicetester.hpp"
+#include "fioreport.hpp"
+#include "flashgeometry.hpp"
 
 class CapacityTesterCli : public QObject
 {
@@ -65,9 +75,162 @@ private:
     int
     safety_buffer;
 
+    QString
+    data_provider;
+
+    bool
+    is_network;
+
+    bool
+    is_remount;
+
+    bool
+    is_single_pass;
+
+    bool
+    is_sentinels;
+
+    int
+    stream_count;
+
+    bool
+    is_scsi;
+
+    int
+    transfer_length;
+
+    bool
+    is_zoned;
+
+    int
+    open_zones;
+
+    bool
+    is_badblocks;
+
+    int
+    bad_block_size;
+
+    int
+    queue_depth;
+
+    QString
+    bad_block_path;
+
+    bool
+    is_json;
+
+    int
+    verify_sample;
+
+    bool
+    is_discard;
+
+    bool
+    is_perf;
+
+    bool
+    is_benchmark;
+
+    int
+    warmup_seconds;
+
+    int
+    benchmark_rounds;
+
+    int
+    benchmark_round;
+
+    QString
+    benchmark_path;
+
+    QMap<int, BenchmarkStatistics>
+    benchmark_batches;
+
+    QMap<int, BenchmarkStatistics>
+    benchmark_speeds;
+
+    int
+    aging_percent;
+
+    quint64
+    aging_seed;
+
+    int
+    aging_stage;
+
+    qint64
+    aging_total;
+
+    int
+    aging_files;
+
+    qint64
+    aging_bytes;
+
+    QMap<int, double>
+    clean_speeds;
+
+    QString
+    workload_spec;
+
+    int
+    workload_seconds;
+
+    QVariantMap
+    workload_statistics;
+
+    QString
+    capture_path;
+
+    qint64
+    capture_neighborhood;
+
+    QString
+    timeseries_path;
+
+    QSharedPointer<TimeSeries>
+    throughput_series;
+
+    QSharedPointer<TimeSeries>
+    latency_series;
+
+    QTimer
+    timeseries_timer;
+
+    QString
+    certificate_path;
+
+    bool
+    is_wipe;
+
+    QString
+    wipe_target;
+
+    QString
+    wipe_name;
+
+    QDateTime
+    wipe_started;
+
+    qint64
+    wipe_capacity;
+
+    int
+    discard_result;
+
+    qint64
+    discard_bytes;
+
     QPointer<VolumeTester>
     worker;
 
+    QPointer<DeviceTester>
+    device_worker;
+
+    QPointer<FlashGeometry>
+    geometry_worker;
+
     qint64
     total_mb;
 
@@ -80,6 +243,63 @@ private:
     QString
     str_verify_speed;
 
+    QString
+    str_workload_speed;
+
+    QStringList
+    kernel_messages;
+
+    QStringList
+    allocation_lines;
+
+    QString
+    test_target;
+
+    QList<QPair<int, QVariantMap> >
+    phase_statistics;
+
+    QStringList
+    zone_lines;
+
+    QList<QPair<double, double> >
+    zone_speeds;
+
+    QList<qint64>
+    bad_blocks;
+
+    QPointer<ImageWriter>
+    image_writer;
+
+    qint64
+    image_total;
+
+    qint64
+    image_data;
+
+    qint64
+    image_skipped;
+
+    QStringList
+    image_paths;
+
+    QList<qint64>
+    image_written;
+
+    QList<qint64>
+    image_verified;
+
+    QList<int>
+    image_errors;
+
+    bool
+    is_all_partitions;
+
+    int
+    parallel_count;
+
+    QPointer<PartitionTester>
+    partition_tester;
+
 private slots:
 
     void
@@ -100,6 +320,15 @@ private slots:
     void
     showVolumeInfo(const QString &mountpoint);
 
+    void
+    showPlan(const QString &mountpoint);
+
+    QString
+    durationString(qint64 seconds);
+
+    void
+    showMonitor();
+
     void
     startVolumeTest(const QString &mountpoint);
 
@@ -115,6 +344,18 @@ private slots:
     void
     completedVolumeTest(bool success, int error_type);
 
+    void
+    agingStarted(qint64 total);
+
+    void
+    agingProgress(qint64 bytes);
+
+    void
+    aged(int files, qint64 bytes);
+
+    void
+    showAging();
+
     void
     initializationStarted(qint64 total);
 
@@ -127,12 +368,147 @@ private slots:
     void
     verifyStarted();
 
+    void
+    remountStarted();
+
+    void
+    workloadStarted(int seconds);
+
+    void
+    workloadProgress(int seconds, qint64 bytes, double avg_speed);
+
+    void
+    flightRecord(const QString &report);
+
+    void
+    allocations(int phase, qint64 count, qint64 bytes);
+
+    void
+    phaseStatistics(int phase, const QVariantMap &statistics);
+
+    QString
+    counterLine(int phase, const QVariantMap &statistics);
+
     void
     written(qint64 written, double avg_speed);
 
     void
     verified(qint64 read, double avg_speed);
 
+    void
+    kernelMessage(qint64 time, const QString &message,
+        int phase, qint64 offset, double speed);
+
+    void
+    showDeviceInfo(const QString &device);
+
+    void
+    startDeviceTest(const QString &device);
+
+    void
+    deviceTestStarted(qint64 total);
+
+    void
+    zoneTested(int zone, qint64 start, qint64 capacity,
+        double write_speed, double read_speed);
+
+    void
+    showZones();
+
+    void
+    patternStarted(int index, const QString &pattern);
+
+    void
+    badBlock(qint64 block);
+
+    void
+    showBadBlocks();
+
+    void
+    startWipe(const QString &path);
+
+    void
+    discarded(bool success, qint64 bytes);
+
+    void
+    showWipeCertificate(bool success);
+
+    void
+    addBenchmarkRound();
+
+    void
+    showBenchmark();
+
+    void
+    compareBenchmarks(const QString &path_a, const QString &path_b);
+
+    void
+    captured(int regions, qint64 bytes);
+
+    void
+    analyzeCapture(const QString &path);
+
+    void
+    saveTimeSeries();
+
+    void
+    startGeometry(const QString &path);
+
+    void
+    geometryAlignment(qint64 align, double pre, double on, double post);
+
+    void
+    geometryOpenUnits(int units, double avg_speed);
+
+    void
+    geometryDetected(qint64 erase_block, qint64 page, int open_units);
+
+    void
+    geometryFailed(const QString &message);
+
+    void
+    completedGeometry(bool success);
+
+    void
+    startImageWrite(const QString &image, const QStringList &targets,
+        bool sparse = false);
+
+    void
+    imageStarted(qint64 total, int targets);
+
+    void
+    imageWritten(int target, qint64 bytes, double avg_speed);
+
+    void
+    imageVerified(int target, qint64 bytes, double avg_speed);
+
+    void
+    imageRead(qint64 data, qint64 skipped);
+
+    void
+    imageTargetFailed(int target, qint64 start, int error_type);
+
+    void
+    showImageProgress();
+
+    void
+    completedImageWrite(bool success);
+
+    void
+    startPartitionTest(const QString &path);
+
+    void
+    partitionStarted(int index);
+
+    void
+    partitionProgress(int index, qint64 bytes, double avg_speed);
+
+    void
+    partitionFinished(int index, bool success, int error_type);
+
+    void
+    completedPartitionTest(bool success);
+
 };
 
 #endif
@@ -0,0 +1,199 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef DATAPROVIDER_HPP
+#define DATAPROVIDER_HPP
+
+#include <cassert>
+#include <cstring>
+#include <ctime>
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QFile>
+#include <QtEndian>
+
+class DataProvider
+{
+public:
+
+    static QStringList
+    names();
+
+    static DataProvider*
+    create(const QString &spec);
+
+    virtual
+    ~DataProvider();
+
+    QString
+    spec() const;
+
+    virtual QString
+    reproducibleSpec() const;
+
+    virtual QString
+    name() const = 0;
+
+    virtual void
+    fill(char *data, int size, qint64 offset) const = 0;
+
+    virtual int
+    verify(const char *data, int size, qint64 offset) const = 0;
+
+protected:
+
+    DataProvider();
+
+private:
+
+    QString
+    _spec;
+
+};
+
+class BufferDataProvider : public DataProvider
+{
+public:
+
+    void
+    fill(char *data, int size, qint64 offset) const;
+
+    int
+    verify(const char *data, int size, qint64 offset) const;
+
+protected:
+
+    BufferDataProvider();
+
+    void
+    setBuffer(const char *data, qint64 size);
+
+private:
+
+    const char
+    *buffer;
+
+    qint64
+    buffer_size;
+
+};
+
+class RandomDataProvider : public BufferDataProvider
+{
+public:
+
+    RandomDataProvider(int size = 16 * 1024 * 1024, quint64 seed = 0);
+
+    QString
+    name() const;
+
+    QString
+    reproducibleSpec() const;
+
+    quint64
+    seed() const;
+
+private:
+
+    quint64
+    _seed;
+
+    QByteArray
+    pattern;
+
+};
+
+class FileDataProvider : public BufferDataProvider
+{
+public:
+
+    FileDataProvider(const QString &path);
+
+    ~FileDataProvider();
+
+    QString
+    name() const;
+
+    bool
+    isValid() const;
+
+private:
+
+    QFile
+    file;
+
+    uchar
+    *map;
+
+};
+
+class ConstantDataProvider : public DataProvider
+{
+public:
+
+    ConstantDataProvider(const QString &name, quint64 word);
+
+    QString
+    name() const;
+
+    void
+    fill(char *data, int size, qint64 offset) const;
+
+    int
+    verify(const char *data, int size, qint64 offset) const;
+
+private:
+
+    QString
+    _name;
+
+    quint64
+    _word;
+
+};
+
+class KeystreamDataProvider : public DataProvider
+{
+public:
+
+    KeystreamDataProvider(quint64 seed);
+
+    QString
+    name() const;
+
+    quint64
+    seed() const;
+
+    void
+    fill(char *data, int size, qint64 offset) const;
+
+    int
+    verify(const char *data, int size, qint64 offset) const;
+
+private:
+
+    quint64
+    _seed;
+
+};
+
+#endif
@@ -0,0 +1,427 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef DEVICETESTER_HPP
+#define DEVICETESTER_HPP
+
+#include <cassert>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/fs.h> /* BLKGETSIZE64, BLKSSZGET */
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 10, 0)
+#include <linux/blkzoned.h> /* BLKREPORTZONE, BLKRESETZONE */
+#define USE_ZONED
+#endif
+#endif
+
+#include <QObject>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QStorageInfo>
+#include <QElapsedTimer>
+#include <QScopedPointer>
+#include <QThread>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QVector>
+#include <QSet>
+#include <QtEndian>
+
+#include "volumetester.hpp"
+#include "dataprovider.hpp"
+#include "scsidevice.hpp"
+#include "allocationcounter.hpp"
+#include "latencyhistogram.hpp"
+#include "livestats.hpp"
+#include "perfcounters.hpp"
+
+class DeviceTester : public QObject
+{
+    Q_OBJECT
+
+signals:
+
+    void
+    started(qint64 total);
+
+    void
+    writeStarted();
+
+    void
+    verifyStarted();
+
+    void
+    written(qint64 bytes, double avg_speed);
+
+    void
+    verified(qint64 bytes, double avg_speed);
+
+    void
+    writeFailed(qint64 start, int size);
+
+    void
+    verifyFailed(qint64 start, int size);
+
+    void
+    failed(int error_type = VolumeTester::Error::Unknown);
+
+    void
+    succeeded();
+
+    void
+    allocations(int phase, qint64 count, qint64 bytes);
+
+    void
+    phaseStatistics(int phase, const QVariantMap &statistics);
+
+    void
+    discarded(bool success, qint64 bytes);
+
+    void
+    zoneTested(int zone, qint64 start, qint64 capacity,
+        double write_speed, double read_speed);
+
+    void
+    patternStarted(int index, const QString &pattern);
+
+    void
+    badBlock(qint64 block);
+
+    void
+    finished(bool success = false,
+        int error_type = VolumeTester::Error::Unknown);
+
+public:
+
+    enum Backend
+    {
+        BlockLayer,
+        Scsi,
+    };
+
+    static const int
+    MB = VolumeTester::MB;
+
+    static const int
+    STAMP_INTERVAL = 4096;
+
+    static bool
+    isDevice(const QString &path);
+
+    static QString
+    blockDevice(const QString &path);
+
+    static QString
+    zoneModel(const QString &path);
+
+    static QStringList
+    badblocksPatterns();
+
+    DeviceTester(const QString &device);
+
+    ~DeviceTester();
+
+    bool
+    setBackend(Backend backend);
+
+    Backend
+    backend() const;
+
+    bool
+    setTransferLength(int bytes);
+
+    int
+    transferLength() const;
+
+    bool
+    setDataProvider(const QString &spec);
+
+    bool
+    setVerifySampling(int percent);
+
+    void
+    setDiscard(bool enabled);
+
+    void
+    setPerfCounters(bool enabled);
+
+    void
+    setZoned(bool enabled);
+
+    bool
+    setOpenZones(int count);
+
+    bool
+    setPatternSequence(const QStringList &patterns);
+
+    bool
+    setBadBlockSize(int bytes);
+
+    int
+    badBlockSize() const;
+
+    bool
+    setQueueDepth(int count);
+
+    bool
+    isValid() const;
+
+    QString
+    device() const;
+
+    qint64
+    bytesTotal() const;
+
+    qint64
+    claimedCapacity(int *sector_size = 0, QString *name = 0) const;
+
+    QList<QStorageInfo>
+    filesystems() const;
+
+    QString
+    errorString() const;
+
+public slots:
+
+    void
+    start();
+
+    void
+    cancel();
+
+private:
+
+    class ZoneStream;
+    friend class ZoneStream;
+
+    struct Zone
+    {
+        qint64
+        start;
+
+        qint64
+        size;
+
+        qint64
+        capacity;
+
+        bool
+        sequential;
+
+        qint64
+        write_bytes;
+
+        qint64
+        write_time;
+
+        qint64
+        read_bytes;
+
+        qint64
+        read_time;
+
+    };
+
+    bool
+    open();
+
+    void
+    close();
+
+    bool
+    writeAt(qint64 offset, const char *data, int size);
+
+    bool
+    readAt(qint64 offset, char *data, int size);
+
+    bool
+    flush();
+
+    void
+    fillBuffer(char *data, int size, qint64 offset) const;
+
+    int
+    verifyBuffer(char *data, int size, qint64 offset) const;
+
+    bool
+    writeFull();
+
+    bool
+    verifyFull();
+
+    bool
+    abortRequested() const;
+
+    bool
+    runPhase(int phase, bool (DeviceTester::*function)());
+
+    void
+    discard();
+
+    bool
+    reportZones();
+
+    bool
+    resetZones();
+
+    bool
+    writeZones();
+
+    bool
+    verifyZones();
+
+    bool
+    runZones(bool verify);
+
+    bool
+    zoneStream(bool verify);
+
+    void
+    zoneFailed(int type, qint64 start, int size, const QString &message);
+
+    void
+    recordTransfer(qint64 latency, int size);
+
+    bool
+    runPatterns();
+
+    void
+    findBadBlocks(bool verify, char *data, qint64 pos, int size);
+
+    void
+    addBadBlock(qint64 block, int type);
+
+    QString
+    _device;
+
+    Backend
+    _backend;
+
+    int
+    transfer_length;
+
+    QScopedPointer<DataProvider>
+    data_provider;
+
+    int
+    verify_sampling;
+
+    bool
+    discard_device;
+
+    int
+    fd;
+
+    int
+    lock_fd;
+
+    ScsiDevice
+    scsi;
+
+    int
+    block_size;
+
+    qint64
+    bytes_total;
+
+    char
+    *buffer;
+
+    bool
+    _canceled;
+
+    int
+    error_type;
+
+    QString
+    error;
+
+    LatencyHistogram
+    phase_latency;
+
+    qint64
+    phase_bytes;
+
+    LiveStats
+    live_stats;
+
+    bool
+    perf_enabled;
+
+    PerfCounters
+    perf_counters;
+
+    bool
+    zoned_mode;
+
+    int
+    open_zones;
+
+    int
+    zone_stream_count;
+
+    QVector<Zone>
+    zones;
+
+    QAtomicInt
+    next_zone;
+
+    QAtomicInt
+    zone_error;
+
+    QAtomicInteger<qint64>
+    zone_bytes;
+
+    QMutex
+    zone_mutex;
+
+    qint64
+    zone_failed_start;
+
+    int
+    zone_failed_size;
+
+    QStringList
+    pattern_sequence;
+
+    int
+    bad_block_size;
+
+    int
+    queue_depth;
+
+    QSet<qint64>
+    bad_blocks;
+
+    int
+    bad_block_errors;
+
+};
+
+#endif
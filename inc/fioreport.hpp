@@ -0,0 +1,65 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef FIOREPORT_HPP
+#define FIOREPORT_HPP
+
+#include <QString>
+#include <QByteArray>
+#include <QVariant>
+#include <QDateTime>
+#include <QLocale>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+class FioReport
+{
+public:
+
+    FioReport(const QString &version);
+
+    void
+    addJob(const QString &name, const QString &rw, const QString &filename,
+        const QVariantMap &statistics, int error = 0);
+
+    QByteArray
+    toJson() const;
+
+private:
+
+    static QJsonObject
+    ioStatistics(const QVariantMap &statistics);
+
+    static QJsonObject
+    latency(const QVariantMap &statistics, bool percentiles);
+
+    QString
+    _version;
+
+    QDateTime
+    timestamp;
+
+    QJsonArray
+    jobs;
+
+};
+
+#endif
@@ -0,0 +1,180 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef FLASHGEOMETRY_HPP
+#define FLASHGEOMETRY_HPP
+
+#include <cassert>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h> /* major, minor */
+#include <linux/fs.h> /* BLKGETSIZE64, BLKSSZGET, FS_IOC_FIEMAP */
+#include <linux/fiemap.h>
+#endif
+
+#include <QObject>
+#include <QFile>
+#include <QDir>
+#include <QStorageInfo>
+#include <QElapsedTimer>
+#include <QScopedPointer>
+
+#include "volumetester.hpp"
+#include "devicetester.hpp"
+#include "dataprovider.hpp"
+
+class FlashGeometry : public QObject
+{
+    Q_OBJECT
+
+signals:
+
+    void
+    alignmentMeasured(qint64 align, double pre, double on, double post);
+
+    void
+    openUnitsMeasured(int units, double avg_speed);
+
+    void
+    detected(qint64 erase_block, qint64 page, int open_units);
+
+    void
+    failed(const QString &message);
+
+    void
+    finished(bool success = false);
+
+public:
+
+    static const int
+    KB = 1024;
+
+    static const int
+    MB = 1024 * 1024;
+
+    FlashGeometry(const QString &path);
+
+    ~FlashGeometry();
+
+    bool
+    isValid() const;
+
+    bool
+    isDevice() const;
+
+    void
+    setWriteTest(bool enabled);
+
+    qint64
+    eraseBlockSize() const;
+
+    qint64
+    pageSize() const;
+
+    int
+    openUnits() const;
+
+public slots:
+
+    void
+    start();
+
+    void
+    cancel();
+
+private:
+
+    bool
+    open();
+
+    void
+    close();
+
+    bool
+    createFile();
+
+    bool
+    locateFile();
+
+    bool
+    transfer(bool write, qint64 offset, int size, qint64 *nsec = 0);
+
+    bool
+    measureAlignment();
+
+    bool
+    measureOpenUnits();
+
+    QString
+    _path;
+
+    bool
+    is_device;
+
+    bool
+    write_test;
+
+    bool
+    _canceled;
+
+    QString
+    file_path;
+
+    int
+    fd;
+
+    int
+    sector_size;
+
+    qint64
+    dev_base;
+
+    qint64
+    file_base;
+
+    qint64
+    region_size;
+
+    char
+    *buffer;
+
+    QScopedPointer<DataProvider>
+    data_provider;
+
+    qint64
+    erase_block;
+
+    qint64
+    page;
+
+    int
+    open_units;
+
+    QString
+    error;
+
+};
+
+#endif
@@ -0,0 +1,148 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef FLIGHTRECORDER_HPP
+#define FLIGHTRECORDER_HPP
+
+#include <cassert>
+#include <algorithm>
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+#include "size.hpp"
+
+class FlightRecorder
+{
+public:
+
+    struct Operation
+    {
+        int
+        type;
+
+        qint64
+        offset;
+
+        int
+        size;
+
+        qint64
+        time;
+
+        qint64
+        latency;
+
+    };
+
+    FlightRecorder(const QStringList &type_names,
+        int last_count = 64, int slowest_count = 16);
+
+    ~FlightRecorder();
+
+    void
+    clear();
+
+    void
+    record(int type, qint64 offset, int size, qint64 begin, qint64 end);
+
+    void
+    setFailure(qint64 offset, const char *expected, const char *actual,
+        int size);
+
+    qint64
+    lastActivity() const;
+
+    QList<Operation>
+    lastOperations() const;
+
+    QList<Operation>
+    slowestOperations() const;
+
+    QString
+    dump(const QString &reason) const;
+
+private:
+
+    struct Slot
+    {
+        QAtomicInt
+        sequence;
+
+        Operation
+        operation;
+
+    };
+
+    static bool
+    write(Slot &slot, const Operation &operation);
+
+    static bool
+    read(const Slot &slot, Operation *operation);
+
+    QString
+    format(const Operation &operation) const;
+
+    QStringList
+    _type_names;
+
+    int
+    last_count;
+
+    int
+    slowest_count;
+
+    Slot
+    *last;
+
+    Slot
+    *slowest;
+
+    QAtomicInteger<qint64>
+    *slowest_latency;
+
+    QAtomicInteger<qint64>
+    slowest_threshold;
+
+    QAtomicInt
+    counter;
+
+    QAtomicInteger<qint64>
+    last_activity;
+
+    QAtomicInt
+    failure_state;
+
+    qint64
+    failure_offset;
+
+    QByteArray
+    failure_expected;
+
+    QByteArray
+    failure_actual;
+
+};
+
+#endif
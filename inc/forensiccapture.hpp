@@ -0,0 +1,121 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef FORENSICCAPTURE_HPP
+#define FORENSICCAPTURE_HPP
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QVariant>
+#include <QFile>
+#include <QDataStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QMutex>
+
+class ForensicCapture
+{
+public:
+
+    struct Region
+    {
+        qint64
+        offset;
+
+        int
+        size;
+
+        QString
+        kind;
+
+        QVariantMap
+        info;
+
+        QByteArray
+        data;
+
+    };
+
+    static bool
+    read(const QString &path, QVariantMap *header, QList<Region> *regions);
+
+    ForensicCapture();
+
+    ~ForensicCapture();
+
+    bool
+    open(const QString &path, const QVariantMap &header);
+
+    bool
+    isOpen() const;
+
+    void
+    setLimit(qint64 bytes);
+
+    bool
+    add(qint64 offset, const char *data, int size, const QString &kind,
+        const QVariantMap &info = QVariantMap());
+
+    int
+    regionCount() const;
+
+    qint64
+    bytesCaptured() const;
+
+    void
+    close();
+
+private:
+
+    static const quint32
+    FILE_MAGIC = 0x43544346; //CTCF
+
+    static const quint32
+    RECORD_MAGIC = 0x43545243; //CTRC
+
+    static const quint32
+    INDEX_MAGIC = 0x43544958; //CTIX
+
+    static const int
+    VERSION = 1;
+
+    static bool
+    readRecord(QDataStream &in, Region *region);
+
+    QFile
+    file;
+
+    mutable QMutex
+    mutex;
+
+    qint64
+    limit;
+
+    QVariantList
+    index;
+
+    qint64
+    bytes_captured;
+
+};
+
+#endif
@@ -0,0 +1,245 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef IMAGEWRITER_HPP
+#define IMAGEWRITER_HPP
+
+#include <cassert>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/fs.h> /* BLKZEROOUT */
+#include <linux/falloc.h> /* FALLOC_FL_PUNCH_HOLE */
+#endif
+
+#include <QObject>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QStorageInfo>
+#include <QStringList>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+
+#include "volumetester.hpp"
+
+class ImageWriter : public QObject
+{
+    Q_OBJECT
+
+signals:
+
+    void
+    started(qint64 total, int targets);
+
+    void
+    sourceRead(qint64 data, qint64 skipped);
+
+    void
+    written(int target, qint64 bytes, double avg_speed);
+
+    void
+    verifyStarted(int target);
+
+    void
+    verified(int target, qint64 bytes, double avg_speed);
+
+    void
+    targetFailed(int target, qint64 start, int error_type);
+
+    void
+    targetSucceeded(int target);
+
+    void
+    failed(int error_type = VolumeTester::Error::Unknown);
+
+    void
+    finished(bool success = false);
+
+public:
+
+    static const int
+    MB = VolumeTester::MB;
+
+    static QString
+    targetPath(const QString &target, const QString &image);
+
+    static qint64
+    targetCapacity(const QString &path);
+
+    static bool
+    isZero(const char *data, int size);
+
+    ImageWriter(const QString &image, const QStringList &targets);
+
+    bool
+    setBufferSize(int chunks);
+
+    void
+    setSparse(bool enabled);
+
+    bool
+    isValid() const;
+
+    QString
+    image() const;
+
+    qint64
+    imageSize() const;
+
+    QStringList
+    targets() const;
+
+public slots:
+
+    void
+    start();
+
+    void
+    cancel();
+
+private:
+
+    class Target;
+    friend class Target;
+
+    struct Extent
+    {
+        qint64
+        offset;
+
+        int
+        size;
+
+    };
+
+    struct Chunk
+    {
+        qint64
+        offset;
+
+        int
+        size;
+
+        uchar
+        *data;
+
+        int
+        pending;
+
+        QList<Extent>
+        extents;
+
+    };
+
+    bool
+    writeTarget(int index);
+
+    bool
+    verifyTarget(int index);
+
+    void
+    abandonTarget(int index, int next_chunk, qint64 start, int error_type);
+
+    void
+    setTargetError(int index, qint64 start, int error_type);
+
+    void
+    releaseChunks(QFile &source);
+
+    QList<Extent>
+    dataExtents(QFile &source, const Chunk &chunk) const;
+
+    bool
+    zeroTarget(QFile &file, bool is_device, qint64 start, qint64 length);
+
+    bool
+    abortRequested() const;
+
+    int
+    chunk_size;
+
+    int
+    buffer_chunks;
+
+    bool
+    sparse;
+
+    int
+    zero_block_size;
+
+    QString
+    image_path;
+
+    QStringList
+    target_paths;
+
+    qint64
+    total;
+
+    QMutex
+    mutex;
+
+    QWaitCondition
+    chunk_produced;
+
+    QWaitCondition
+    chunk_consumed;
+
+    QList<Chunk>
+    chunks;
+
+    int
+    first_chunk;
+
+    int
+    produced;
+
+    bool
+    source_done;
+
+    bool
+    source_failed;
+
+    int
+    active_targets;
+
+    QList<QByteArray>
+    checksums;
+
+    QList<QList<Extent> >
+    extents;
+
+    QList<int>
+    target_errors;
+
+    bool
+    _canceled;
+
+};
+
+#endif
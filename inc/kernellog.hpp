@@ -0,0 +1,88 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef KERNELLOG_HPP
+#define KERNELLOG_HPP
+
+#include <cassert>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QFile>
+#include <QFileInfo>
+
+class KernelLog
+{
+public:
+
+    struct Message
+    {
+        qint64
+        time;
+
+        int
+        level;
+
+        QString
+        text;
+
+    };
+
+    static QStringList
+    deviceFilters(const QString &device);
+
+    KernelLog();
+
+    ~KernelLog();
+
+    bool
+    open(const QStringList &filters);
+
+    void
+    close();
+
+    bool
+    isOpen() const;
+
+    QList<Message>
+    read();
+
+private:
+
+    bool
+    matches(const QString &text) const;
+
+    int
+    fd;
+
+    qint64
+    start_usec;
+
+    QStringList
+    _filters;
+
+};
+
+#endif
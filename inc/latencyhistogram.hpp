@@ -0,0 +1,103 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef LATENCYHISTOGRAM_HPP
+#define LATENCYHISTOGRAM_HPP
+
+#include <cmath>
+#include <cstring>
+
+#include <QList>
+#include <QString>
+#include <QVariant>
+
+class LatencyHistogram
+{
+public:
+
+    static QList<double>
+    defaultPercentiles();
+
+    LatencyHistogram();
+
+    void
+    clear();
+
+    void
+    add(qint64 value);
+
+    qint64
+    count() const;
+
+    qint64
+    min() const;
+
+    qint64
+    max() const;
+
+    double
+    mean() const;
+
+    double
+    stddev() const;
+
+    qint64
+    percentile(double p) const;
+
+    QVariantMap
+    toVariantMap(const QList<double> &percentiles = defaultPercentiles())
+        const;
+
+private:
+
+    enum
+    {
+        SUB_BITS = 5,
+        SUB_COUNT = 1 << SUB_BITS,
+        BUCKET_COUNT = SUB_COUNT + (63 - SUB_BITS) * SUB_COUNT,
+    };
+
+    static int
+    bucketIndex(qint64 value);
+
+    static qint64
+    bucketValue(int index);
+
+    qint64
+    buckets[BUCKET_COUNT];
+
+    qint64
+    _count;
+
+    qint64
+    _min;
+
+    qint64
+    _max;
+
+    double
+    sum;
+
+    double
+    sum_squares;
+
+};
+
+#endif
@@ -0,0 +1,182 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef LIVESTATS_HPP
+#define LIVESTATS_HPP
+
+#include <cassert>
+#include <cstring>
+#include <atomic>
+#if defined(__unix__)
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define USE_LIVESTATS
+#endif
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QDir>
+#include <QFile>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+class LiveStats
+{
+public:
+
+    //Layout of the shared memory segment (version 1)
+    //Fixed-size fields in host byte order, no pointers
+    struct Data
+    {
+        qint64
+        pid;
+
+        qint64
+        started; //ms since epoch
+
+        qint64
+        updated; //ms since epoch
+
+        qint32
+        state;
+
+        qint32
+        phase; //VolumeTester::Phase
+
+        qint32
+        error_type; //VolumeTester::Error
+
+        qint32
+        reserved;
+
+        qint64
+        bytes_total;
+
+        qint64
+        bytes_done; //current phase
+
+        qint64
+        phase_time; //ms
+
+        double
+        avg_speed; //MB/s, current phase
+
+        qint64
+        errors;
+
+        char
+        target[256];
+
+    };
+
+    struct Segment
+    {
+        quint32
+        magic;
+
+        quint32
+        version;
+
+        quint32
+        size;
+
+        QBasicAtomicInteger<quint32>
+        sequence; //odd while being written
+
+        Data
+        data;
+
+    };
+
+    enum State
+    {
+        Running,
+        Succeeded,
+        Failed,
+    };
+
+    static const quint32
+    MAGIC = 0x53544354; //"TCTS"
+
+    static const quint32
+    VERSION = 1;
+
+    static QString
+    directory();
+
+    static bool
+    read(const QString &name, Data *data);
+
+    static QStringList
+    segments();
+
+    LiveStats();
+
+    ~LiveStats();
+
+    bool
+    open(const QString &target, qint64 bytes_total);
+
+    void
+    close();
+
+    bool
+    isOpen() const;
+
+    void
+    setPhase(int phase);
+
+    void
+    addBytes(qint64 bytes);
+
+    void
+    addError();
+
+    void
+    finish(bool success, int error_type);
+
+private:
+
+    Q_DISABLE_COPY(LiveStats)
+
+    void
+    beginWrite();
+
+    void
+    endWrite();
+
+    Segment
+    *segment;
+
+    QString
+    name;
+
+    QElapsedTimer
+    phase_timer;
+
+};
+
+#endif
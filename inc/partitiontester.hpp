@@ -0,0 +1,213 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef PARTITIONTESTER_HPP
+#define PARTITIONTESTER_HPP
+
+#include <algorithm>
+
+#include <QObject>
+#include <QFile>
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QStringList>
+#include <QThread>
+#include <QPointer>
+#include <QHash>
+
+#include "volumetester.hpp"
+#include "devicetester.hpp"
+
+class PartitionTester : public QObject
+{
+    Q_OBJECT
+
+signals:
+
+    void
+    partitionStarted(int index);
+
+    void
+    written(int index, qint64 bytes, double avg_speed);
+
+    void
+    verified(int index, qint64 bytes, double avg_speed);
+
+    void
+    partitionFinished(int index, bool success, int error_type);
+
+    void
+    finished(bool success = false);
+
+public:
+
+    struct Partition
+    {
+        QString
+        device;
+
+        QString
+        mountpoint;
+
+        qint64
+        start;
+
+        qint64
+        size;
+
+        qint64
+        tested;
+
+        qint64
+        written;
+
+        qint64
+        verified;
+
+        double
+        write_speed;
+
+        double
+        verify_speed;
+
+        qint64
+        failed_start;
+
+        int
+        failed_size;
+
+        int
+        error_type;
+
+        bool
+        done;
+
+    };
+
+    static QString
+    parentDevice(const QString &path);
+
+    PartitionTester(const QString &path);
+
+    bool
+    isValid() const;
+
+    QString
+    device() const;
+
+    qint64
+    deviceSize() const;
+
+    QList<Partition>
+    partitions() const;
+
+    bool
+    setParallel(int count);
+
+    bool
+    setSafetyBuffer(int bytes);
+
+    bool
+    setDataProvider(const QString &spec);
+
+    void
+    setSinglePass(bool enabled);
+
+public slots:
+
+    void
+    start();
+
+    void
+    cancel();
+
+private slots:
+
+    void
+    testerStarted(qint64 total);
+
+    void
+    testerWritten(qint64 bytes, double avg_speed);
+
+    void
+    testerVerified(qint64 bytes, double avg_speed);
+
+    void
+    testerCreateFailed(int index, qint64 start);
+
+    void
+    testerFailed(qint64 start, int size);
+
+    void
+    testerFinished(bool success, int error_type);
+
+private:
+
+    static qint64
+    sysfsBytes(const QString &name, const QString &attribute);
+
+    void
+    startNext();
+
+    int
+    partitionIndex(QObject *tester) const;
+
+    QString
+    _device;
+
+    qint64
+    device_size;
+
+    QList<Partition>
+    _partitions;
+
+    int
+    parallel;
+
+    int
+    safety_buffer;
+
+    QString
+    data_provider;
+
+    bool
+    single_pass;
+
+    int
+    next_partition;
+
+    int
+    running;
+
+    bool
+    success;
+
+    bool
+    _canceled;
+
+    QHash<QObject*, int>
+    tester_index;
+
+    QList<QPointer<VolumeTester> >
+    testers;
+
+};
+
+#endif
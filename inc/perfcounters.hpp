@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef PERFCOUNTERS_HPP
+#define PERFCOUNTERS_HPP
+
+#include <cassert>
+#include <cstring>
+#include <cerrno>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define USE_PERF_COUNTERS
+#endif
+
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+
+class PerfCounters
+{
+public:
+
+    enum Counter
+    {
+        Cycles,
+        Instructions,
+        CacheMisses,
+        BranchMisses,
+        CounterCount,
+    };
+
+    static QStringList
+    names();
+
+    PerfCounters();
+
+    ~PerfCounters();
+
+    bool
+    open();
+
+    void
+    close();
+
+    bool
+    isAvailable() const;
+
+    bool
+    isUserOnly() const;
+
+    void
+    start();
+
+    void
+    stop();
+
+    qint64
+    value(Counter counter) const;
+
+    QVariantMap
+    toVariantMap() const;
+
+private:
+
+    Q_DISABLE_COPY(PerfCounters)
+
+    int
+    fds[CounterCount];
+
+    qint64
+    values[CounterCount];
+
+    bool
+    user_only;
+
+};
+
+#endif
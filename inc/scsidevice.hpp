@@ -0,0 +1,115 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef SCSIDEVICE_HPP
+#define SCSIDEVICE_HPP
+
+#include <cassert>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <scsi/sg.h>
+#endif
+
+#include <QString>
+#include <QFile>
+
+class ScsiDevice
+{
+public:
+
+    static bool
+    isSupported();
+
+    ScsiDevice(const QString &path = QString());
+
+    ~ScsiDevice();
+
+    void
+    setPath(const QString &path);
+
+    QString
+    path() const;
+
+    bool
+    open(bool writable = false);
+
+    void
+    close();
+
+    bool
+    isOpen() const;
+
+    bool
+    inquiry(QString *vendor, QString *product, QString *revision);
+
+    bool
+    readCapacity(qint64 *blocks, int *block_size);
+
+    bool
+    read(qint64 lba, int blocks, char *data);
+
+    bool
+    write(qint64 lba, int blocks, const char *data);
+
+    bool
+    synchronizeCache();
+
+    bool
+    setTimeout(int msec);
+
+    QString
+    errorString() const;
+
+private:
+
+    enum Direction
+    {
+        None,
+        FromDevice,
+        ToDevice,
+    };
+
+    bool
+    command(const uchar *cdb, int cdb_size, Direction direction,
+        void *data, int size, int required = -1);
+
+    QString
+    _path;
+
+    int
+    fd;
+
+    int
+    timeout;
+
+    int
+    block_length;
+
+    QString
+    error;
+
+};
+
+#endif
@@ -0,0 +1,67 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef THROUGHPUTHISTORY_HPP
+#define THROUGHPUTHISTORY_HPP
+
+#include <QFile>
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QSettings>
+#include <QString>
+#include <QStringList>
+
+class ThroughputHistory
+{
+public:
+
+    static QString
+    key(const QString &mountpoint);
+
+    ThroughputHistory(const QString &key);
+
+    bool
+    isValid() const;
+
+    double
+    speed(int phase) const;
+
+    int
+    count(int phase) const;
+
+    void
+    add(int phase, qint64 bytes, qint64 runtime);
+
+private:
+
+    enum
+    {
+        MAX_COUNT = 10,
+    };
+
+    static QString
+    sysfsValue(const QString &path);
+
+    QString
+    group;
+
+};
+
+#endif
@@ -0,0 +1,104 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef TIMESERIES_HPP
+#define TIMESERIES_HPP
+
+#include <cstring>
+
+#include <QVector>
+#include <QVariant>
+#include <QMutex>
+
+class TimeSeries
+{
+public:
+
+    struct Bucket
+    {
+        qint64
+        begin;
+
+        qint64
+        end;
+
+        qint64
+        count;
+
+        double
+        min;
+
+        double
+        max;
+
+        double
+        sum;
+
+    };
+
+    static double
+    mean(const Bucket &bucket);
+
+    static QVariantList
+    toVariantList(const QVector<Bucket> &buckets);
+
+    TimeSeries(int capacity = 512, int factor = 4, int levels = 12);
+
+    void
+    clear();
+
+    void
+    add(qint64 begin, qint64 end, double value);
+
+    Bucket
+    summary() const;
+
+    QVector<Bucket>
+    buckets(int max_count = 0, qint64 from = 0, qint64 to = -1) const;
+
+    qint64
+    memoryUsage() const;
+
+private:
+
+    static void
+    merge(Bucket &into, const Bucket &bucket);
+
+    void
+    compact(int level);
+
+    mutable QMutex
+    mutex;
+
+    int
+    capacity;
+
+    int
+    factor;
+
+    QVector<QVector<Bucket> >
+    levels;
+
+    Bucket
+    total;
+
+};
+
+#endif
@@ -23,7 +23,9 @@
 
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <random>
 #include <unistd.h>
 #include <fcntl.h>
 
@@ -34,6 +36,11 @@
 #include <errno.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <linux/fs.h> /* FITRIM */
+#endif
+
 #include <QObject>
 #include <QVariant>
 #include <QPair>
@@ -42,6 +49,28 @@
 #include <QStorageInfo>
 #include <QPointer>
 #include <QElapsedTimer>
+#include <QScopedPointer>
+#include <QThread>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QVector>
+#include <QProcess>
+#include <QDateTime>
+#include <QSharedPointer>
+
+#include "dataprovider.hpp"
+#include "kernellog.hpp"
+#include "flightrecorder.hpp"
+#include "throughputhistory.hpp"
+#include "allocationcounter.hpp"
+#include "latencyhistogram.hpp"
+#include "benchmarkstatistics.hpp"
+#include "livestats.hpp"
+#include "perfcounters.hpp"
+#include "workload.hpp"
+#include "forensiccapture.hpp"
+#include "timeseries.hpp"
 
 #define USE_FSYNC
 #ifdef NO_FSYNC
@@ -59,6 +88,15 @@ class VolumeTester : public QObject
 
 signals:
 
+    void
+    agingStarted(qint64 total);
+
+    void
+    agingProgress(qint64 bytes);
+
+    void
+    aged(int files, qint64 bytes);
+
     void
     initializationStarted(qint64 total);
 
@@ -68,6 +106,15 @@ signals:
     void
     verifyStarted();
 
+    void
+    remountStarted();
+
+    void
+    workloadStarted(int seconds);
+
+    void
+    workloadProgress(int seconds, qint64 bytes, double avg_speed);
+
     void
     initialized(qint64 bytes, double avg_speed);
 
@@ -95,6 +142,25 @@ signals:
     void
     removeFailed(const QString &path);
 
+    void
+    kernelMessage(qint64 time, const QString &message,
+        int phase, qint64 offset, double speed);
+
+    void
+    flightRecord(const QString &report);
+
+    void
+    allocations(int phase, qint64 count, qint64 bytes);
+
+    void
+    phaseStatistics(int phase, const QVariantMap &statistics);
+
+    void
+    discarded(bool success, qint64 bytes);
+
+    void
+    captured(int regions, qint64 bytes);
+
     void
     finished(bool success = false, int error_type = Error::Unknown);
 
@@ -112,9 +178,89 @@ public:
             Resize          = 1 << 4,
             Write           = 1 << 5,
             Verify          = 1 << 7,
+            Remount         = 1 << 8,
+        };
+    };
+
+    struct Phase
+    {
+        enum Type
+        {
+            None,
+            Initialize,
+            Write,
+            Verify,
+            Workload,
         };
     };
 
+    struct Plan
+    {
+        qint64
+        bytes_available;
+
+        qint64
+        safety_buffer;
+
+        qint64
+        bytes_total;
+
+        int
+        file_count;
+
+        qint64
+        file_size;
+
+        qint64
+        last_file_size;
+
+        int
+        block_count;
+
+        qint64
+        block_size;
+
+        qint64
+        last_block_size;
+
+        int
+        streams;
+
+        qint64
+        verify_bytes;
+
+        qint64
+        memory_data;
+
+        qint64
+        memory_buffers;
+
+        qint64
+        memory_layout;
+
+        double
+        initialize_speed;
+
+        double
+        write_speed;
+
+        double
+        verify_speed;
+
+        int
+        history_count;
+
+        qint64
+        initialize_seconds;
+
+        qint64
+        write_seconds;
+
+        qint64
+        verify_seconds;
+
+    };
+
     static const int
     KB = 1024;
 
@@ -127,14 +273,74 @@ public:
     static QStringList
     availableMountpoints();
 
+    static bool
+    canRemount();
+
+    static bool
+    isSampled(qint64 index, int percent);
+
     VolumeTester(const QString &mountpoint);
 
     bool
     setSafetyBuffer(int new_buffer);
 
+    bool
+    setDataProvider(const QString &spec);
+
+    QString
+    dataProvider() const;
+
+    void
+    setNetworkProfile(bool enabled);
+
+    bool
+    setStreamCount(int count);
+
+    bool
+    isNetworkFileSystem() const;
+
+    void
+    setRemount(bool enabled);
+
+    void
+    setSinglePass(bool enabled);
+
+    bool
+    setSentinelCheck(bool enabled);
+
+    bool
+    setVerifySampling(int percent);
+
+    void
+    setDiscard(bool enabled);
+
+    void
+    setPerfCounters(bool enabled);
+
+    bool
+    setWarmup(int seconds);
+
+    bool
+    setAging(int percent, quint64 seed);
+
+    bool
+    setWorkload(const QString &spec);
+
+    bool
+    setCapture(const QString &path, qint64 neighborhood);
+
     bool
     isValid() const;
 
+    Plan
+    plan() const;
+
+    QSharedPointer<TimeSeries>
+    throughputSeries() const;
+
+    QSharedPointer<TimeSeries>
+    latencySeries() const;
+
     QString
     mountpoint() const;
 
@@ -178,17 +384,29 @@ private slots:
     bool
     writeFull();
 
+    bool
+    fill();
+
+    bool
+    remount();
+
     bool
     verifyFull();
 
-    void
-    generateTestPattern();
+    bool
+    runWorkload();
 
     void
     removeFile(QObject *file);
 
 private:
 
+    class Stream;
+    friend class Stream;
+
+    class Watchdog;
+    friend class Watchdog;
+
     struct BlockInfo
     {
         qint64
@@ -236,12 +454,119 @@ private:
 
     };
 
-    QByteArray
-    blockData(int file_index, int block_index) const;
+    struct TimelineEntry
+    {
+        int
+        phase;
+
+        qint64
+        offset;
+
+        int
+        size;
+
+        qint64
+        begin;
+
+        qint64
+        end;
+
+    };
+
+    QList<FileInfo>
+    layout(qint64 total) const;
+
+    void
+    fillBlock(int file_index, int block_index, char *data) const;
+
+    int
+    verifyBlock(int file_index, int block_index, const char *data) const;
+
+    void
+    fillRange(int file_index, int block_index, qint64 offset, int size,
+        char *data) const;
+
+    int
+    verifyRange(int file_index, int block_index, qint64 offset, int size,
+        const char *data) const;
 
     bool
     abortRequested() const;
 
+    bool
+    checkFile(int index);
+
+    bool
+    age();
+
+    void
+    removeAgingFiles();
+
+    bool
+    openSentinelFiles(const QString &path, QFile &sync_file,
+        QFile &read_file, bool *fadvise) const;
+
+    bool
+    checkSentinels(int file_index, int block_index, const char *data,
+        QFile &read_file, bool fadvise, char *sentinel);
+
+    bool
+    runPhase(int phase, bool (VolumeTester::*function)());
+
+    static bool
+    mountOptions(const QString &mountpoint,
+        QString *device, QString *type, QString *options);
+
+    static QString
+    fuseblkDriver(const QString &device);
+
+    bool
+    runStreams(bool verify);
+
+    QFile*
+    openWorkloadFile(const QString &path) const;
+
+    bool
+    writeStream(int stream);
+
+    bool
+    verifyStream(int stream);
+
+    bool
+    workloadStream(int stream);
+
+    void
+    streamFailed(int type, qint64 start, int size);
+
+    void
+    recordBlock(int phase, qint64 offset, int size, qint64 begin);
+
+    void
+    recordMismatch(int file_index, int block_index, const char *data,
+        int index);
+
+    void
+    recordRequest(bool write, qint64 offset, int size, qint64 begin);
+
+    void
+    recordSample(int size, qint64 begin, qint64 end);
+
+    void
+    captureFailure(int phase, qint64 offset, int size, const char *data,
+        qint64 mismatch);
+
+    QByteArray
+    readRegion(qint64 offset, int size) const;
+
+    QVariantList
+    blockIds(qint64 offset, int size) const;
+
+    void
+    readKernelLog();
+
+    void
+    discardFreeSpace();
+
     qint64
     block_size_max;
 
@@ -257,8 +582,8 @@ private:
     QString
     file_prefix;
 
-    QByteArray
-    pattern;
+    QScopedPointer<DataProvider>
+    data_provider;
 
     qint64
     bytes_total;
@@ -281,6 +606,129 @@ private:
     QList<FileInfo>
     file_infos;
 
+    bool
+    network_profile;
+
+    int
+    stream_count;
+
+    QAtomicInt
+    stream_error;
+
+    QAtomicInteger<qint64>
+    stream_bytes;
+
+    QAtomicInteger<qint64>
+    stream_allocations;
+
+    QAtomicInteger<qint64>
+    stream_allocated_bytes;
+
+    QMutex
+    stream_mutex;
+
+    qint64
+    stream_failed_start;
+
+    int
+    stream_failed_size;
+
+    bool
+    remount_volume;
+
+    bool
+    single_pass;
+
+    bool
+    sentinel_check;
+
+    qint64
+    sentinel_reads;
+
+    qint64
+    sentinel_bytes;
+
+    qint64
+    sentinel_time;
+
+    int
+    verify_sampling;
+
+    bool
+    discard_free_space;
+
+    KernelLog
+    kernel_log;
+
+    QElapsedTimer
+    test_timer;
+
+    QVector<TimelineEntry>
+    timeline;
+
+    QMutex
+    timeline_mutex;
+
+    FlightRecorder
+    flight_recorder;
+
+    LatencyHistogram
+    phase_latency;
+
+    QSharedPointer<TimeSeries>
+    throughput_series;
+
+    QSharedPointer<TimeSeries>
+    latency_series;
+
+    qint64
+    phase_bytes;
+
+    qint64
+    phase_begin;
+
+    qint64
+    warmup;
+
+    int
+    aging_percent;
+
+    quint64
+    aging_seed;
+
+    QVector<QPair<qint64, qint64> >
+    phase_blocks;
+
+    Workload
+    workload;
+
+    qint64
+    workload_end;
+
+    LatencyHistogram
+    workload_latency[2];
+
+    qint64
+    workload_bytes[2];
+
+    QString
+    capture_path;
+
+    qint64
+    capture_neighborhood;
+
+    ForensicCapture
+    capture;
+
+    LiveStats
+    live_stats;
+
+    bool
+    perf_enabled;
+
+    PerfCounters
+    perf_counters;
+
 };
 
 #endif
@@ -0,0 +1,108 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#ifndef WORKLOAD_HPP
+#define WORKLOAD_HPP
+
+#include <random>
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QPair>
+
+class Workload
+{
+public:
+
+    struct Operation
+    {
+        bool
+        write;
+
+        qint64
+        offset;
+
+        int
+        size;
+
+    };
+
+    static const int
+    ALIGNMENT = 4096;
+
+    Workload(const QString &spec = QString());
+
+    bool
+    isValid() const;
+
+    QString
+    spec() const;
+
+    int
+    readPercent() const;
+
+    int
+    randomPercent() const;
+
+    int
+    queueDepth() const;
+
+    int
+    seconds() const;
+
+    int
+    maxSize() const;
+
+    Operation
+    next(std::mt19937_64 &generator, qint64 &position, qint64 total) const;
+
+private:
+
+    static int
+    parseSize(const QString &text);
+
+    bool
+    valid;
+
+    QString
+    _spec;
+
+    int
+    read_percent;
+
+    int
+    random_percent;
+
+    int
+    queue_depth;
+
+    int
+    _seconds;
+
+    QList<QPair<int, int> >
+    sizes;
+
+    int
+    weight_total;
+
+};
+
+#endif
@@ -0,0 +1,252 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "allocationcounter.hpp"
+
+/*! \class AllocationCounter
+ *
+ * \brief The AllocationCounter class counts heap allocations
+ * made by the current thread.
+ *
+ * All heap allocations go through malloc() and friends
+ * (calloc(), realloc(), the aligned variants, valloc() and pvalloc()),
+ * including operator new and the allocations of Qt containers.
+ * With glibc, these functions are replaced by wrappers
+ * calling the original implementation (__libc_malloc() etc.)
+ * and passing the size to the allocation hook.
+ * The default hook, count(), adds it to the counts of the calling thread.
+ * Another hook can be installed with setHook(),
+ * for example, to abort on an unexpected allocation in a test.
+ *
+ * Allocations within the scope of a Suspend object are not counted.
+ *
+ * Build with NO_ALLOCATION_COUNTER to disable the wrappers.
+ *
+ */
+
+#ifdef USE_ALLOCATION_COUNTER
+
+extern "C"
+{
+
+void*
+__libc_malloc(size_t size);
+
+void*
+__libc_calloc(size_t count, size_t size);
+
+void*
+__libc_realloc(void *ptr, size_t size);
+
+void*
+__libc_memalign(size_t alignment, size_t size);
+
+void*
+__libc_valloc(size_t size);
+
+void*
+__libc_pvalloc(size_t size);
+
+void
+__libc_free(void *ptr);
+
+}
+
+namespace
+{
+
+__thread qint64
+thread_count = 0;
+
+__thread qint64
+thread_bytes = 0;
+
+__thread int
+thread_suspended = 0;
+
+AllocationCounter::Hook
+hook = &AllocationCounter::count;
+
+inline void
+allocated(size_t size)
+{
+    if (thread_suspended) return;
+    AllocationCounter::Hook function = hook;
+    if (function) function(size);
+}
+
+}
+
+extern "C"
+{
+
+void*
+malloc(size_t size) __THROW
+{
+    allocated(size);
+    return __libc_malloc(size);
+}
+
+void*
+calloc(size_t count, size_t size) __THROW
+{
+    allocated(count * size);
+    return __libc_calloc(count, size);
+}
+
+void*
+realloc(void *ptr, size_t size) __THROW
+{
+    if (size) allocated(size);
+    return __libc_realloc(ptr, size);
+}
+
+void*
+memalign(size_t alignment, size_t size) __THROW
+{
+    allocated(size);
+    return __libc_memalign(alignment, size);
+}
+
+void*
+aligned_alloc(size_t alignment, size_t size) __THROW
+{
+    allocated(size);
+    return __libc_memalign(alignment, size);
+}
+
+int
+posix_memalign(void **ptr, size_t alignment, size_t size) __THROW
+{
+    //Power of two multiple of sizeof(void*), like glibc
+    if (!alignment || alignment % sizeof(void*) ||
+        (alignment & (alignment - 1)))
+        return EINVAL;
+    allocated(size);
+    void *p = __libc_memalign(alignment, size);
+    if (!p) return ENOMEM;
+    *ptr = p;
+    return 0;
+}
+
+void*
+valloc(size_t size) __THROW
+{
+    allocated(size);
+    return __libc_valloc(size);
+}
+
+void*
+pvalloc(size_t size) __THROW
+{
+    allocated(size);
+    return __libc_pvalloc(size);
+}
+
+void
+free(void *ptr) __THROW
+{
+    __libc_free(ptr);
+}
+
+}
+
+#endif
+
+AllocationCounter::Suspend::Suspend()
+{
+    #ifdef USE_ALLOCATION_COUNTER
+    thread_suspended++;
+    #endif
+}
+
+AllocationCounter::Suspend::~Suspend()
+{
+    #ifdef USE_ALLOCATION_COUNTER
+    thread_suspended--;
+    #endif
+}
+
+/*!
+ * Returns true if allocations are counted (glibc only).
+ */
+bool
+AllocationCounter::isEnabled()
+{
+    #ifdef USE_ALLOCATION_COUNTER
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+/*!
+ * Installs a function that is called for every allocation
+ * and returns the previous one.
+ * The function must not allocate memory itself.
+ * To keep the counts, it should call count().
+ * Should be called before any other threads are started.
+ */
+AllocationCounter::Hook
+AllocationCounter::setHook(Hook new_hook)
+{
+    #ifdef USE_ALLOCATION_COUNTER
+    Hook previous = hook;
+    hook = new_hook;
+    return previous;
+    #else
+    Q_UNUSED(new_hook);
+    return 0;
+    #endif
+}
+
+/*!
+ * Adds an allocation of the specified size to the counts
+ * of the current thread (default hook).
+ */
+void
+AllocationCounter::count(size_t size)
+{
+    #ifdef USE_ALLOCATION_COUNTER
+    thread_count++;
+    thread_bytes += size;
+    #else
+    Q_UNUSED(size);
+    #endif
+}
+
+/*!
+ * Returns the number of allocations and the number of bytes allocated
+ * by the current thread so far.
+ */
+AllocationCounter::Counts
+AllocationCounter::current()
+{
+    Counts counts;
+    #ifdef USE_ALLOCATION_COUNTER
+    counts.count = thread_count;
+    counts.bytes = thread_bytes;
+    #else
+    counts.count = 0;
+    counts.bytes = 0;
+    #endif
+    return counts;
+}
+
@@ -0,0 +1,375 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "benchmarkstatistics.hpp"
+
+/*! \class BenchmarkStatistics
+ *
+ * \brief The BenchmarkStatistics class summarizes throughput samples
+ * (MB/s) and compares two sets of samples.
+ *
+ * Within a run, the throughput is described by batch means:
+ * fromBlocks() divides the blocks of a phase into batches
+ * of consecutive blocks, each one measured by the wall clock,
+ * which also works with parallel streams.
+ * Batch means of one run are strongly correlated (the same drive state,
+ * caches, garbage collection), so they only show the dispersion
+ * within the run (median, median absolute deviation).
+ *
+ * The unit of replication is a round: one sample per round,
+ * the throughput of the phase after the warm-up.
+ * The mean of the rounds is reported with a 95% confidence interval
+ * (Student's t distribution) and compare() uses Welch's t-test
+ * to tell if two runs differ significantly.
+ * At least MIN_ROUNDS samples are needed on each side.
+ *
+ */
+
+namespace
+{
+
+/*!
+ * Continued fraction of the incomplete beta function (modified Lentz).
+ */
+double
+betaFraction(double x, double a, double b)
+{
+    const double tiny = 1e-300;
+    double c = 1;
+    double d = 1 - (a + b) * x / (a + 1);
+    if (std::fabs(d) < tiny) d = tiny;
+    d = 1 / d;
+    double h = d;
+    for (int m = 1; m <= 300; m++)
+    {
+        //Even step
+        double aa = m * (b - m) * x / ((a - 1 + 2 * m) * (a + 2 * m));
+        d = 1 + aa * d;
+        if (std::fabs(d) < tiny) d = tiny;
+        c = 1 + aa / c;
+        if (std::fabs(c) < tiny) c = tiny;
+        d = 1 / d;
+        h *= d * c;
+
+        //Odd step
+        aa = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 1 + 2 * m));
+        d = 1 + aa * d;
+        if (std::fabs(d) < tiny) d = tiny;
+        c = 1 + aa / c;
+        if (std::fabs(c) < tiny) c = tiny;
+        d = 1 / d;
+        double delta = d * c;
+        h *= delta;
+        if (std::fabs(delta - 1) < 1e-12) break;
+    }
+    return h;
+}
+
+/*!
+ * Regularized incomplete beta function I_x(a, b).
+ */
+double
+incompleteBeta(double x, double a, double b)
+{
+    if (x <= 0) return 0;
+    if (x >= 1) return 1;
+    double front = std::exp(std::lgamma(a + b) - std::lgamma(a) -
+        std::lgamma(b) + a * std::log(x) + b * std::log(1 - x));
+    if (x < (a + 1) / (a + b + 2))
+        return front * betaFraction(x, a, b) / a;
+    return 1 - front * betaFraction(1 - x, b, a) / b;
+}
+
+/*!
+ * Two-sided p-value of t in Student's t distribution.
+ */
+double
+studentP(double t, double df)
+{
+    return incompleteBeta(df / (df + t * t), df / 2, 0.5);
+}
+
+/*!
+ * Returns t such that the two-sided p-value is p (bisection).
+ */
+double
+studentQuantile(double p, double df)
+{
+    double low = 0, high = 1;
+    while (studentP(high, df) > p && high < 1e6)
+        high *= 2;
+    for (int i = 0; i < 100; i++)
+    {
+        double middle = (low + high) / 2;
+        if (studentP(middle, df) > p)
+            low = middle;
+        else
+            high = middle;
+    }
+    return (low + high) / 2;
+}
+
+}
+
+/*!
+ * Returns the batch means of the specified blocks
+ * (bytes, completion time in nanoseconds, in order of completion).
+ * The first batch starts at the specified time (end of the warm-up).
+ */
+BenchmarkStatistics
+BenchmarkStatistics::fromBlocks(const QVector<QPair<qint64, qint64> > &blocks,
+    qint64 start, int batches)
+{
+    BenchmarkStatistics statistics;
+    int count = blocks.size();
+    if (!count || batches < 1) return statistics;
+    batches = qMin(batches, count);
+
+    //Batches of consecutive blocks (wall clock, parallel streams included)
+    qint64 batch_start = start;
+    for (int i = 0; i < batches; i++)
+    {
+        int first = (qint64)count * i / batches;
+        int last = (qint64)count * (i + 1) / batches;
+        qint64 bytes = 0;
+        for (int j = first; j < last; j++)
+            bytes += blocks.at(j).first;
+        qint64 end = blocks.at(last - 1).second;
+        if (end > batch_start)
+        {
+            double seconds = (double)(end - batch_start) / 1000000000;
+            statistics.add((double)bytes / (1024 * 1024) / seconds);
+        }
+        batch_start = end;
+    }
+
+    return statistics;
+}
+
+/*!
+ * Returns the samples stored by toVariantMap().
+ */
+BenchmarkStatistics
+BenchmarkStatistics::fromVariantMap(const QVariantMap &map)
+{
+    BenchmarkStatistics statistics;
+    foreach (QVariant value, map.value("samples").toList())
+        statistics.add(value.toDouble());
+    return statistics;
+}
+
+/*!
+ * Compares the samples (rounds) of b with those of a.
+ * The difference is the change of the mean in percent,
+ * the p-value is two-sided (Welch's t-test).
+ * With fewer than MIN_ROUNDS samples on either side,
+ * the difference is never significant (p = 1).
+ */
+BenchmarkStatistics::Comparison
+BenchmarkStatistics::compare(const BenchmarkStatistics &a,
+    const BenchmarkStatistics &b, double alpha)
+{
+    Comparison comparison;
+    comparison.difference =
+        a.mean() ? (b.mean() - a.mean()) / a.mean() * 100 : 0;
+    comparison.p_value = 1;
+    comparison.significant = false;
+    int n1 = a.count();
+    int n2 = b.count();
+    if (n1 < MIN_ROUNDS || n2 < MIN_ROUNDS) return comparison;
+
+    //Standard error of the difference, Welch-Satterthwaite degrees of freedom
+    double v1 = a.stddev() * a.stddev() / n1;
+    double v2 = b.stddev() * b.stddev() / n2;
+    double se = std::sqrt(v1 + v2);
+    if (se <= 0)
+    {
+        //No variance at all, any difference is significant
+        comparison.p_value = a.mean() == b.mean() ? 1 : 0;
+        comparison.significant = comparison.p_value < alpha;
+        return comparison;
+    }
+    double df = (v1 + v2) * (v1 + v2) /
+        (v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1));
+    double t = (b.mean() - a.mean()) / se;
+    comparison.p_value = studentP(t, df);
+    comparison.significant = comparison.p_value < alpha;
+
+    return comparison;
+}
+
+BenchmarkStatistics::BenchmarkStatistics()
+{
+}
+
+void
+BenchmarkStatistics::add(double value)
+{
+    values << value;
+}
+
+/*!
+ * Adds the samples of another round.
+ */
+void
+BenchmarkStatistics::add(const BenchmarkStatistics &other)
+{
+    values << other.values;
+}
+
+int
+BenchmarkStatistics::count()
+const
+{
+    return values.size();
+}
+
+QList<double>
+BenchmarkStatistics::samples()
+const
+{
+    return values;
+}
+
+double
+BenchmarkStatistics::median()
+const
+{
+    return percentile(50);
+}
+
+double
+BenchmarkStatistics::mean()
+const
+{
+    if (values.isEmpty()) return 0;
+    double sum = 0;
+    foreach (double value, values)
+        sum += value;
+    return sum / values.size();
+}
+
+double
+BenchmarkStatistics::stddev()
+const
+{
+    int n = values.size();
+    if (n < 2) return 0;
+    double m = mean();
+    double sum = 0;
+    foreach (double value, values)
+        sum += (value - m) * (value - m);
+    return std::sqrt(sum / (n - 1));
+}
+
+/*!
+ * Returns the median absolute deviation from the median.
+ */
+double
+BenchmarkStatistics::mad()
+const
+{
+    double m = median();
+    BenchmarkStatistics deviations;
+    foreach (double value, values)
+        deviations.add(std::fabs(value - m));
+    return deviations.median();
+}
+
+/*!
+ * Returns the p-th percentile (0 <= p <= 100),
+ * interpolated between the closest samples.
+ */
+double
+BenchmarkStatistics::percentile(double p)
+const
+{
+    QList<double> list = sorted();
+    if (list.isEmpty()) return 0;
+    double position = qBound(0.0, p / 100, 1.0) * (list.size() - 1);
+    int index = (int)position;
+    if (index + 1 >= list.size()) return list.last();
+    double fraction = position - index;
+    return list.at(index) + (list.at(index + 1) - list.at(index)) * fraction;
+}
+
+/*!
+ * Returns the lower end of the 95% confidence interval of the mean
+ * (Student's t distribution), the mean itself with fewer than 2 samples.
+ */
+double
+BenchmarkStatistics::confidenceLow()
+const
+{
+    return mean() - confidenceHalfWidth();
+}
+
+/*!
+ * Returns the upper end of the 95% confidence interval of the mean.
+ */
+double
+BenchmarkStatistics::confidenceHigh()
+const
+{
+    return mean() + confidenceHalfWidth();
+}
+
+/*!
+ * Returns samples, median, confidence interval, mean, stddev and mad.
+ * Only the samples are needed to restore the statistics.
+ */
+QVariantMap
+BenchmarkStatistics::toVariantMap()
+const
+{
+    QVariantList list;
+    foreach (double value, values)
+        list << value;
+
+    QVariantMap map;
+    map["samples"] = list;
+    map["count"] = count();
+    map["median"] = median();
+    map["ci_low"] = confidenceLow();
+    map["ci_high"] = confidenceHigh();
+    map["mean"] = mean();
+    map["stddev"] = stddev();
+    map["mad"] = mad();
+    return map;
+}
+
+QList<double>
+BenchmarkStatistics::sorted()
+const
+{
+    QList<double> list = values;
+    std::sort(list.begin(), list.end());
+    return list;
+}
+
+double
+BenchmarkStatistics::confidenceHalfWidth()
+const
+{
+    int n = values.size();
+    if (n < 2) return 0;
+    return studentQuantile(0.05, n - 1) * stddev() / std::sqrt((double)n);
+}
+
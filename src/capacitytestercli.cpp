@@ -28,13 +28,45 @@ CapacityTesterCli::CapacityTesterCli(QObject *parent)
                    in(stdin),
                    is_yes(false),
                    safety_buffer(-1),
-                   total_mb(0)
+                   is_network(false),
+                   is_remount(false),
+                   is_single_pass(false),
+                   is_sentinels(false),
+                   stream_count(0),
+                   is_scsi(false),
+                   transfer_length(0),
+                   is_zoned(false),
+                   open_zones(0),
+                   is_badblocks(false),
+                   bad_block_size(0),
+                   queue_depth(0),
+                   is_json(false),
+                   verify_sample(100),
+                   is_discard(false),
+                   is_perf(false),
+                   is_benchmark(false),
+                   warmup_seconds(0),
+                   benchmark_rounds(1),
+                   benchmark_round(1),
+                   aging_percent(0),
+                   aging_seed(1),
+                   aging_stage(0),
+                   aging_total(0),
+                   aging_files(0),
+                   aging_bytes(0),
+                   workload_seconds(0),
+                   capture_neighborhood(1024 * 1024),
+                   is_wipe(false),
+                   wipe_capacity(0),
+                   discard_result(-1),
+                   discard_bytes(0),
+                   total_mb(0),
+                   image_total(0),
+                   image_data(0),
+                   image_skipped(0),
+                   is_all_partitions(false),
+                   parallel_count(0)
 {
-    //Heading
-    out << "CapacityTester" << endl
-        << "==============" << endl
-        << endl;
-
     //Command line argument parser
     QCommandLineParser parser;
     parser.addHelpOption();
@@ -48,22 +80,199 @@ CapacityTesterCli::CapacityTesterCli(QObject *parent)
         tr("Shows volume information.")));
     parser.addOption(QCommandLineOption(QStringList() << "t" << "test",
         tr("Starts volume test.")));
+    parser.addOption(QCommandLineOption(QStringList() << "plan",
+        tr("Shows the test files, memory requirements and estimated duration "
+           "of a volume test without touching the volume.")));
+    parser.addOption(QCommandLineOption(QStringList() << "all-partitions",
+        tr("Tests all mounted partitions of the device the volume "
+           "is located on and reports the result for the whole device "
+           "(use with -test, mountpoint or device).")));
+    parser.addOption(QCommandLineOption(QStringList() << "parallel",
+        tr("Changes the number of partitions tested at the same time "
+           "(default 1, one after the other)."),
+        "partitions"));
+    parser.addOption(QCommandLineOption(QStringList() << "device-info",
+        tr("Shows device information and compares the capacity "
+           "reported by the device with the block layer and filesystems."),
+        "device"));
+    parser.addOption(QCommandLineOption(QStringList() << "test-device",
+        tr("Tests a raw device (destroys all data on it)."),
+        "device"));
+    parser.addOption(QCommandLineOption(QStringList() << "sg",
+        tr("Sends SCSI commands through SG_IO instead of using "
+           "the block layer (raw device test).")));
+    parser.addOption(QCommandLineOption(QStringList() << "transfer-length",
+        tr("Changes the size of a single read or write request "
+           "(raw device test)."),
+        "bytes"));
+    parser.addOption(QCommandLineOption(QStringList() << "zoned",
+        tr("Tests a zoned device (SMR, ZNS) zone by zone, "
+           "enabled automatically for host-managed devices "
+           "(raw device test).")));
+    parser.addOption(QCommandLineOption(QStringList() << "open-zones",
+        tr("Changes the number of zones written at the same time "
+           "(zoned device test)."),
+        "zones"));
+    parser.addOption(QCommandLineOption(QStringList() << "badblocks",
+        tr("Writes and verifies the patterns of badblocks -w "
+           "(0xAA, 0x55, 0xFF, 0x00) and a random pattern, "
+           "collecting bad blocks (raw device test).")));
+    parser.addOption(QCommandLineOption(QStringList() << "bad-block-list",
+        tr("Saves the bad blocks to the specified file (mke2fs -l)."),
+        "file"));
+    parser.addOption(QCommandLineOption(QStringList() << "bad-block-size",
+        tr("Changes the block size of the bad block list "
+           "(default 4096, same as mke2fs -b)."),
+        "bytes"));
+    parser.addOption(QCommandLineOption(QStringList() << "queue-depth",
+        tr("Changes the number of transfers in flight (badblocks)."),
+        "transfers"));
+    parser.addOption(QCommandLineOption(QStringList() << "wipe",
+        tr("Overwrites the free space of a volume or a whole raw device "
+           "with a keyed random stream and prints a wipe certificate."),
+        "path"));
+    parser.addOption(QCommandLineOption(QStringList() << "verify-sample",
+        tr("Verifies only the specified percentage of the blocks "
+           "(0 skips the verification)."),
+        "percent"));
+    parser.addOption(QCommandLineOption(QStringList() << "discard",
+        tr("Discards (TRIM) the tested space afterwards "
+           "(requires root for volumes).")));
+    parser.addOption(QCommandLineOption(QStringList() << "certificate",
+        tr("Saves the wipe certificate to the specified file."),
+        "file"));
+    parser.addOption(QCommandLineOption(QStringList() << "perf",
+        tr("Counts CPU cycles, instructions, cache misses and branch misses "
+           "per phase (hardware counters, Linux).")));
+    parser.addOption(QCommandLineOption(QStringList() << "warmup",
+        tr("Excludes the first seconds of each phase "
+           "from the benchmark statistics."),
+        "seconds"));
+    parser.addOption(QCommandLineOption(QStringList() << "rounds",
+        tr("Repeats the volume test and reports the mean throughput "
+           "of the rounds with its confidence interval."),
+        "rounds"));
+    parser.addOption(QCommandLineOption(QStringList() << "benchmark",
+        tr("Saves the throughput samples of the test to the specified file "
+           "(JSON) for -compare."),
+        "file"));
+    parser.addOption(QCommandLineOption(QStringList() << "compare",
+        tr("Compares two saved benchmarks (the second one "
+           "as argument) and tells if they differ significantly."),
+        "file"));
+    parser.addOption(QCommandLineOption(QStringList() << "aging",
+        tr("Tests the volume clean and again after fragmenting "
+           "the specified percentage of the free space "
+           "and reports the difference."),
+        "percent"));
+    parser.addOption(QCommandLineOption(QStringList() << "aging-seed",
+        tr("Changes the seed of the files created for aging (default 1)."),
+        "seed"));
+    parser.addOption(QCommandLineOption(QStringList() << "workload",
+        tr("Runs a mixed workload over the test files after writing them "
+           "and reports throughput and latency of reads and writes "
+           "(reads are verified), e.g., "
+           "read=70,random=80,depth=4,time=60,bs=4k:60/64k:30/1m:10."),
+        "spec"));
+    parser.addOption(QCommandLineOption(QStringList() << "capture",
+        tr("Saves the contents of failing regions to the specified file "
+           "as soon as they are found, with the seeds of the test data "
+           "(compressed, for -analyze)."),
+        "file"));
+    parser.addOption(QCommandLineOption(QStringList() << "capture-neighborhood",
+        tr("Changes how much is captured before and after "
+           "a failing region (MB, default 1)."),
+        "mb"));
+    parser.addOption(QCommandLineOption(QStringList() << "analyze",
+        tr("Compares a capture with the expected data (offline)."),
+        "file"));
+    parser.addOption(QCommandLineOption(QStringList() << "timeseries",
+        tr("Saves throughput and latency over time to the specified file "
+           "(JSON), updated every minute during the test."),
+        "file"));
+    parser.addOption(QCommandLineOption(QStringList() << "monitor",
+        tr("Shows the progress of all running tests (shared memory).")));
+    parser.addOption(QCommandLineOption(QStringList() << "geometry",
+        tr("Estimates erase block size, page size and open allocation units "
+           "of a flash drive by timing reads and writes "
+           "(device or mountpoint)."),
+        "path"));
+    parser.addOption(QCommandLineOption(QStringList() << "clone",
+        tr("Writes an image to all specified targets "
+           "(block devices, files or mountpoints) and verifies them."),
+        "image"));
+    parser.addOption(QCommandLineOption(QStringList() << "write-image",
+        tr("Writes an image to the specified target and verifies it, "
+           "skipping holes and regions containing only zeros."),
+        "image"));
+    parser.addOption(QCommandLineOption(QStringList() << "sparse",
+        tr("Skips holes and zero regions when cloning.")));
     parser.addOption(QCommandLineOption(QStringList() << "y" << "yes",
         tr("Answers questions with yes.")));
     parser.addOption(QCommandLineOption(QStringList() << "safety-buffer",
         tr("Changes the size of the safety buffer zone."),
         "safety-buffer"));
+    parser.addOption(QCommandLineOption(QStringList() << "pattern",
+        tr("Selects the test data: %1.\n"
+           "constant, keystream and file require an argument, "
+           "e.g., constant:0xAA, keystream:1234 or file:/path, "
+           "random takes an optional seed (random:1234).").
+           arg(DataProvider::names().join(", ")),
+        "pattern"));
+    parser.addOption(QCommandLineOption(QStringList() << "network",
+        tr("Uses the network profile (NFS, SMB): parallel streams, "
+           "larger blocks, uncached verification.")));
+    parser.addOption(QCommandLineOption(QStringList() << "remount",
+        tr("Unmounts and mounts the volume again before verifying "
+           "(requires root).")));
+    parser.addOption(QCommandLineOption(QStringList() << "single-pass",
+        tr("Creates the test files by writing the test data "
+           "(no initialization, FAT/exFAT written only once).")));
+    parser.addOption(QCommandLineOption(QStringList() << "sentinels",
+        tr("Writes every block synchronously and reads back its start, end "
+           "and a random position right away, uncached "
+           "(dropped writes found at the block that caused them).")));
+    parser.addOption(QCommandLineOption(QStringList() << "streams",
+        tr("Changes the number of parallel streams (network profile)."),
+        "streams"));
+    parser.addOption(QCommandLineOption(QStringList() << "output-format",
+        tr("Selects the format of the results: normal or json.\n"
+           "json prints throughput and latencies in fio's JSON format "
+           "when the test is completed, other output goes to stderr."),
+        "format"));
     parser.addPositionalArgument("mountpoint",
-        tr("Volume to be tested."), "[mountpoint]");
+        tr("Volume to be tested (or targets to be written)."),
+        "[mountpoint]");
 
     //Parse arguments
     parser.process(app);
 
+    //Output format, keep stdout clean for JSON report
+    QString output_format = parser.value("output-format");
+    if (output_format == "json")
+    {
+        is_json = true;
+        QFile *file = new QFile(this);
+        file->open(stderr, QIODevice::WriteOnly | QIODevice::Unbuffered);
+        out.setDevice(file);
+    }
+    else if (!output_format.isEmpty() && output_format != "normal")
+    {
+        err << "Invalid output format: " << output_format << endl;
+        close(1);
+        return;
+    }
+
+    //Heading
+    out << "CapacityTester" << endl
+        << "==============" << endl
+        << endl;
+
     //Abort if too many positional arguments
     const QStringList args = parser.positionalArguments();
     QString mountpoint;
     if (!args.isEmpty()) mountpoint = args.at(0);
-    if (args.size() > 1)
+    if (args.size() > 1 && !parser.isSet("clone"))
     {
         err << "Too many arguments." << endl;
         close(1);
@@ -79,6 +288,250 @@ CapacityTesterCli::CapacityTesterCli(QObject *parent)
         if (ok) safety_buffer = number;
     }
 
+    //Custom test data
+    data_provider = parser.value("pattern");
+    if (!data_provider.isEmpty())
+    {
+        DataProvider *provider = DataProvider::create(data_provider);
+        if (!provider)
+        {
+            err << "Invalid pattern: " << data_provider << endl;
+            close(1);
+            return;
+        }
+        delete provider;
+    }
+
+    //Network profile
+    if (parser.isSet("network"))
+    {
+        is_network = true;
+    }
+    if (parser.isSet("remount"))
+    {
+        if (!VolumeTester::canRemount())
+        {
+            err << "Remounting the volume requires root privileges." << endl;
+            close(1);
+            return;
+        }
+        is_remount = true;
+    }
+    if (parser.isSet("single-pass"))
+    {
+        is_single_pass = true;
+    }
+    if (parser.isSet("sentinels"))
+    {
+        if (is_network)
+        {
+            err << "Sentinels cannot be used with the network profile." << endl;
+            close(1);
+            return;
+        }
+        is_sentinels = true;
+    }
+    QString str_streams = parser.value("streams");
+    if (!str_streams.isEmpty())
+    {
+        bool ok;
+        int number = str_streams.toInt(&ok);
+        if (ok) stream_count = number;
+    }
+
+    //All partitions of a device
+    if (parser.isSet("all-partitions"))
+    {
+        is_all_partitions = true;
+    }
+    QString str_parallel = parser.value("parallel");
+    if (!str_parallel.isEmpty())
+    {
+        bool ok;
+        int number = str_parallel.toInt(&ok);
+        if (!ok || number < 1)
+        {
+            err << "Invalid number of partitions: " << str_parallel << endl;
+            close(1);
+            return;
+        }
+        parallel_count = number;
+    }
+
+    //Raw device test
+    if (parser.isSet("sg"))
+    {
+        is_scsi = true;
+    }
+    QString str_transfer_length = parser.value("transfer-length");
+    if (!str_transfer_length.isEmpty())
+    {
+        bool ok;
+        int number = str_transfer_length.toInt(&ok);
+        if (ok) transfer_length = number;
+    }
+    if (parser.isSet("zoned"))
+    {
+        is_zoned = true;
+    }
+    QString str_open_zones = parser.value("open-zones");
+    if (!str_open_zones.isEmpty())
+    {
+        bool ok;
+        int number = str_open_zones.toInt(&ok);
+        if (ok) open_zones = number;
+    }
+
+    //Pattern sequence, bad block list
+    if (parser.isSet("badblocks"))
+    {
+        is_badblocks = true;
+    }
+    bad_block_path = parser.value("bad-block-list");
+    QString str_bad_block_size = parser.value("bad-block-size");
+    if (!str_bad_block_size.isEmpty())
+    {
+        bool ok;
+        int number = str_bad_block_size.toInt(&ok);
+        if (ok) bad_block_size = number;
+    }
+    QString str_queue_depth = parser.value("queue-depth");
+    if (!str_queue_depth.isEmpty())
+    {
+        bool ok;
+        int number = str_queue_depth.toInt(&ok);
+        if (ok) queue_depth = number;
+    }
+
+    //Wipe, sampled verification
+    QString str_verify_sample = parser.value("verify-sample");
+    if (!str_verify_sample.isEmpty())
+    {
+        bool ok;
+        int number = str_verify_sample.toInt(&ok);
+        if (!ok || number < 0 || number > 100)
+        {
+            err << "Invalid sample percentage: " << str_verify_sample << endl;
+            close(1);
+            return;
+        }
+        verify_sample = number;
+    }
+    if (parser.isSet("discard"))
+    {
+        is_discard = true;
+    }
+    certificate_path = parser.value("certificate");
+
+    //CPU counters
+    if (parser.isSet("perf"))
+    {
+        is_perf = true;
+    }
+
+    //Benchmark
+    QString str_warmup = parser.value("warmup");
+    if (!str_warmup.isEmpty())
+    {
+        bool ok;
+        int number = str_warmup.toInt(&ok);
+        if (!ok || number < 0)
+        {
+            err << "Invalid warm-up time: " << str_warmup << endl;
+            close(1);
+            return;
+        }
+        warmup_seconds = number;
+        is_benchmark = true;
+    }
+    QString str_rounds = parser.value("rounds");
+    if (!str_rounds.isEmpty())
+    {
+        bool ok;
+        int number = str_rounds.toInt(&ok);
+        if (!ok || number < 1)
+        {
+            err << "Invalid number of rounds: " << str_rounds << endl;
+            close(1);
+            return;
+        }
+        benchmark_rounds = number;
+        is_benchmark = true;
+    }
+    benchmark_path = parser.value("benchmark");
+    if (!benchmark_path.isEmpty())
+    {
+        is_benchmark = true;
+    }
+
+    //Aging (clean run, then aged run)
+    QString str_aging = parser.value("aging");
+    if (!str_aging.isEmpty())
+    {
+        bool ok;
+        int number = str_aging.toInt(&ok);
+        if (!ok || number < 1 || number > 90)
+        {
+            err << "Invalid aging percentage: " << str_aging << endl;
+            close(1);
+            return;
+        }
+        if (benchmark_rounds > 1)
+        {
+            err << "Aging cannot be combined with rounds." << endl;
+            close(1);
+            return;
+        }
+        aging_percent = number;
+    }
+    QString str_aging_seed = parser.value("aging-seed");
+    if (!str_aging_seed.isEmpty())
+    {
+        bool ok;
+        quint64 number = str_aging_seed.toULongLong(&ok);
+        if (ok) aging_seed = number;
+    }
+
+    //Mixed workload after writing
+    QString str_workload = parser.value("workload");
+    if (!str_workload.isEmpty())
+    {
+        Workload workload(str_workload);
+        if (!workload.isValid())
+        {
+            err << "Invalid workload: " << str_workload << endl;
+            close(1);
+            return;
+        }
+        workload_spec = str_workload;
+    }
+
+    //Failing regions saved on the host
+    capture_path = parser.value("capture");
+    QString str_neighborhood = parser.value("capture-neighborhood");
+    if (!str_neighborhood.isEmpty())
+    {
+        bool ok;
+        int number = str_neighborhood.toInt(&ok);
+        if (!ok || number < 0 || number > 64)
+        {
+            err << "Invalid neighborhood: " << str_neighborhood << endl;
+            close(1);
+            return;
+        }
+        capture_neighborhood = (qint64)number * 1024 * 1024;
+    }
+
+    //Throughput and latency over time, saved while the test is running
+    timeseries_path = parser.value("timeseries");
+    if (!timeseries_path.isEmpty())
+    {
+        connect(&timeseries_timer,
+                SIGNAL(timeout()),
+                this,
+                SLOT(saveTimeSeries()));
+    }
+
     //Answer with yes
     if (parser.isSet("yes"))
     {
@@ -96,10 +549,57 @@ CapacityTesterCli::CapacityTesterCli(QObject *parent)
         showVolumeInfo(mountpoint);
         close();
     }
+    else if (parser.isSet("plan"))
+    {
+        showPlan(mountpoint);
+        close();
+    }
+    else if (parser.isSet("test") && is_all_partitions)
+    {
+        startPartitionTest(mountpoint);
+    }
     else if (parser.isSet("test"))
     {
         startVolumeTest(mountpoint);
     }
+    else if (parser.isSet("device-info"))
+    {
+        showDeviceInfo(parser.value("device-info"));
+        close();
+    }
+    else if (parser.isSet("test-device"))
+    {
+        startDeviceTest(parser.value("test-device"));
+    }
+    else if (parser.isSet("monitor"))
+    {
+        showMonitor();
+        close();
+    }
+    else if (parser.isSet("compare"))
+    {
+        compareBenchmarks(parser.value("compare"), mountpoint);
+    }
+    else if (parser.isSet("analyze"))
+    {
+        analyzeCapture(parser.value("analyze"));
+    }
+    else if (parser.isSet("wipe"))
+    {
+        startWipe(parser.value("wipe"));
+    }
+    else if (parser.isSet("geometry"))
+    {
+        startGeometry(parser.value("geometry"));
+    }
+    else if (parser.isSet("clone"))
+    {
+        startImageWrite(parser.value("clone"), args, parser.isSet("sparse"));
+    }
+    else if (parser.isSet("write-image"))
+    {
+        startImageWrite(parser.value("write-image"), args, true);
+    }
     else
     {
         parser.showHelp();
@@ -279,6 +779,203 @@ CapacityTesterCli::showVolumeInfo(const QString &mountpoint)
 
 }
 
+void
+CapacityTesterCli::showPlan(const QString &mountpoint)
+{
+    //Volume, same settings as the test
+    VolumeTester tester(mountpoint);
+    if (!tester.isValid())
+    {
+        err << "The specified volume is not valid." << endl;
+        return close(1);
+    }
+    tester.setSafetyBuffer(safety_buffer);
+    tester.setNetworkProfile(is_network);
+    tester.setSinglePass(is_single_pass);
+    tester.setVerifySampling(verify_sample);
+    if (stream_count)
+        tester.setStreamCount(stream_count);
+    if (!data_provider.isEmpty())
+        tester.setDataProvider(data_provider);
+    VolumeTester::Plan plan = tester.plan();
+
+    //Test area
+    out << "Volume:\t\t" << mountpoint << endl;
+    out << endl;
+    out << tr("Available:") << "\t"
+        << Size(plan.bytes_available).formatted()
+        << " / " << plan.bytes_available << " B" << endl;
+    out << tr("Safety buffer:") << "\t"
+        << Size(plan.safety_buffer).formatted()
+        << " / " << plan.safety_buffer << " B" << endl;
+    out << tr("Test area:") << "\t"
+        << Size(plan.bytes_total).formatted()
+        << " / " << plan.bytes_total << " B" << endl;
+    out << endl;
+
+    //Layout
+    out << tr("Files:") << "\t\t"
+        << tr("%1 x %2").
+            arg(plan.file_count).
+            arg(Size(plan.file_size).formatted());
+    if (plan.file_count && plan.last_file_size != plan.file_size)
+        out << tr(" (last: %1)").arg(Size(plan.last_file_size).formatted());
+    out << endl;
+    out << tr("Blocks:") << "\t\t"
+        << tr("%1 x %2").
+            arg(plan.block_count).
+            arg(Size(plan.block_size).formatted());
+    if (plan.block_count && plan.last_block_size != plan.block_size)
+        out << tr(" (last: %1)").arg(Size(plan.last_block_size).formatted());
+    out << endl;
+    out << tr("Streams:") << "\t" << plan.streams << endl;
+    out << tr("Verified:") << "\t"
+        << Size(plan.verify_bytes).formatted()
+        << " (" << verify_sample << "%)" << endl;
+    out << endl;
+
+    //Memory
+    qint64 memory =
+        plan.memory_data + plan.memory_buffers + plan.memory_layout;
+    out << tr("Memory:") << "\t\t"
+        << Size(memory).formatted() << endl;
+    out << "\t\t" << tr("Test data:") << "\t"
+        << Size(plan.memory_data).formatted() << endl;
+    out << "\t\t" << tr("Buffers:") << "\t"
+        << Size(plan.memory_buffers).formatted() << endl;
+    out << "\t\t" << tr("Layout:") << "\t"
+        << Size(plan.memory_layout).formatted() << endl;
+    out << endl;
+
+    //Duration per phase
+    qint64 total_seconds = 0;
+    if (plan.initialize_seconds == -1 || plan.write_seconds == -1 ||
+        plan.verify_seconds == -1)
+        total_seconds = -1;
+    else
+        total_seconds = plan.initialize_seconds + plan.write_seconds +
+            plan.verify_seconds;
+    out << tr("Initialization:") << "\t"
+        << durationString(plan.initialize_seconds);
+    if (plan.initialize_speed && !is_single_pass)
+        out << QString(" (%1 MB/s)").arg(plan.initialize_speed, 0, 'f', 1);
+    out << endl;
+    out << tr("Write:") << "\t\t" << durationString(plan.write_seconds);
+    if (plan.write_speed)
+        out << QString(" (%1 MB/s)").arg(plan.write_speed, 0, 'f', 1);
+    out << endl;
+    out << tr("Verify:") << "\t\t" << durationString(plan.verify_seconds);
+    if (plan.verify_speed && plan.verify_bytes)
+        out << QString(" (%1 MB/s)").arg(plan.verify_speed, 0, 'f', 1);
+    out << endl;
+    out << tr("Total:") << "\t\t" << durationString(total_seconds) << endl;
+    if (plan.history_count)
+        out << tr("Estimated from %1 previous test(s) of this drive model.").
+            arg(plan.history_count) << endl;
+    else
+        out << tr("No previous test of this drive model, "
+            "the duration is estimated after the first test.") << endl;
+
+    //Problems that would stop the test
+    QStringList problems;
+    if (plan.bytes_total <= 0)
+        problems << tr("The volume is full "
+            "(or smaller than the safety buffer).");
+    if (!tester.conflictFiles().isEmpty())
+        problems << tr("Old test files have been found, delete them first.");
+    if (!tester.rootFiles().isEmpty())
+        problems << tr("The volume is not empty, "
+            "only the free space is tested.");
+    if (!is_network && tester.isNetworkFileSystem())
+        problems << tr("The volume is a network filesystem, use -network.");
+    if (!problems.isEmpty())
+    {
+        out << endl;
+        foreach (QString problem, problems)
+        {
+            out << "!\t" << problem << endl;
+        }
+    }
+
+}
+
+/*!
+ * Formats a number of seconds as h:mm:ss, "unknown" if negative.
+ */
+QString
+CapacityTesterCli::durationString(qint64 seconds)
+{
+    if (seconds < 0) return tr("unknown");
+    return QString("%1:%2:%3").
+        arg(seconds / 3600).
+        arg((seconds / 60) % 60, 2, 10, QChar('0')).
+        arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+void
+CapacityTesterCli::showMonitor()
+{
+    QStringList names = LiveStats::segments();
+    if (names.isEmpty())
+    {
+        out << tr("No tests running.") << endl;
+        return;
+    }
+
+    out << QString("%1\t%2\t%3\t%4\t%5\t%6\t%7").
+        arg("PID", -8).
+        arg("State", -9).
+        arg("Phase", -10).
+        arg("Progress", 8).
+        arg("Speed", 12).
+        arg("Errors", 6).
+        arg("Target")
+        << endl;
+    foreach (QString name, names)
+    {
+        LiveStats::Data data;
+        if (!LiveStats::read(name, &data)) continue;
+
+        //Process gone (killed)
+        bool stale = false;
+        #ifdef USE_LIVESTATS
+        stale = kill(data.pid, 0) == -1 && errno == ESRCH;
+        #endif
+        QString state;
+        if (stale)
+            state = tr("stale");
+        else if (data.state == LiveStats::Running)
+            state = tr("running");
+        else if (data.state == LiveStats::Succeeded)
+            state = tr("passed");
+        else
+            state = tr("failed");
+
+        QString phase;
+        if (data.phase == VolumeTester::Phase::Initialize)
+            phase = tr("init");
+        else if (data.phase == VolumeTester::Phase::Write)
+            phase = tr("write");
+        else if (data.phase == VolumeTester::Phase::Verify)
+            phase = tr("verify");
+        else if (data.phase == VolumeTester::Phase::Workload)
+            phase = tr("workload");
+
+        int p = data.bytes_total ?
+            ((double)data.bytes_done / data.bytes_total) * 100 : 0;
+        data.target[sizeof(data.target) - 1] = 0;
+        out << QString("%1\t%2\t%3\t%4\t%5\t%6\t%7").
+            arg(data.pid, -8).
+            arg(state, -9).
+            arg(phase, -10).
+            arg(QString("%1%").arg(p), 8).
+            arg(QString("%1 MB/s").arg(data.avg_speed, 0, 'f', 1), 12).
+            arg(data.errors, 6).
+            arg(QString::fromUtf8(data.target))
+            << endl;
+    }
+}
+
 void
 CapacityTesterCli::startVolumeTest(const QString &mountpoint)
 {
@@ -299,7 +996,24 @@ CapacityTesterCli::startVolumeTest(const QString &mountpoint)
         return close(1);
     }
 
-    //Ask again if volume not empty
+    //Synchronous writes required for sentinels
+    if (is_sentinels && !tester.setSentinelCheck(true))
+    {
+        err << tr("Sentinels are not supported on this system.") << endl;
+        return close(1);
+    }
+
+    //Suggest network profile
+    if (!is_network && tester.isNetworkFileSystem())
+    {
+        out << tr(
+            "The volume is a network filesystem, "
+            "use -network for better throughput.")
+            << endl;
+    }
+
+    //Ask again if volume not empty (wipe: free space only)
+    if (!is_wipe)
     {
         QStringList root_files = tester.rootFiles();
         if (!root_files.isEmpty())
@@ -315,8 +1029,30 @@ CapacityTesterCli::startVolumeTest(const QString &mountpoint)
     }
 
     //Worker
+    test_target = mountpoint;
     worker = new VolumeTester(mountpoint);
     worker->setSafetyBuffer(safety_buffer);
+    worker->setNetworkProfile(is_network);
+    worker->setRemount(is_remount);
+    worker->setSinglePass(is_single_pass);
+    worker->setSentinelCheck(is_sentinels);
+    worker->setVerifySampling(verify_sample);
+    worker->setDiscard(is_discard);
+    worker->setPerfCounters(is_perf);
+    worker->setWarmup(warmup_seconds);
+    worker->setWorkload(workload_spec);
+    if (!worker->setCapture(capture_path, capture_neighborhood))
+    {
+        err << tr("Cannot create capture file: %1").arg(capture_path) << endl;
+        delete worker;
+        return close(1);
+    }
+    if (aging_stage == 1)
+        worker->setAging(aging_percent, aging_seed);
+    if (stream_count)
+        worker->setStreamCount(stream_count);
+    if (!data_provider.isEmpty())
+        worker->setDataProvider(data_provider);
 
     //Thread for worker
     QThread *thread = new QThread;
@@ -328,6 +1064,20 @@ CapacityTesterCli::startVolumeTest(const QString &mountpoint)
             worker,
             SLOT(start()));
 
+    //Aging started, progress and result
+    connect(worker,
+            SIGNAL(agingStarted(qint64)),
+            this,
+            SLOT(agingStarted(qint64)));
+    connect(worker,
+            SIGNAL(agingProgress(qint64)),
+            this,
+            SLOT(agingProgress(qint64)));
+    connect(worker,
+            SIGNAL(aged(int, qint64)),
+            this,
+            SLOT(aged(int, qint64)));
+
     //Initialization started
     connect(worker,
             SIGNAL(initializationStarted(qint64)),
@@ -364,6 +1114,64 @@ CapacityTesterCli::startVolumeTest(const QString &mountpoint)
             this,
             SLOT(verifyStarted()));
 
+    //Remount started
+    connect(worker,
+            SIGNAL(remountStarted()),
+            this,
+            SLOT(remountStarted()));
+
+    //Workload started and progress
+    connect(worker,
+            SIGNAL(workloadStarted(int)),
+            this,
+            SLOT(workloadStarted(int)));
+    connect(worker,
+            SIGNAL(workloadProgress(int, qint64, double)),
+            this,
+            SLOT(workloadProgress(int, qint64, double)));
+
+    //Flight recorder dump (stall or failure)
+    connect(worker,
+            SIGNAL(flightRecord(const QString&)),
+            this,
+            SLOT(flightRecord(const QString&)));
+
+    //Allocations per phase
+    connect(worker,
+            SIGNAL(allocations(int, qint64, qint64)),
+            this,
+            SLOT(allocations(int, qint64, qint64)));
+
+    //Throughput and latencies per phase
+    connect(worker,
+            SIGNAL(phaseStatistics(int, const QVariantMap&)),
+            this,
+            SLOT(phaseStatistics(int, const QVariantMap&)));
+
+    //Discard result
+    connect(worker,
+            SIGNAL(discarded(bool, qint64)),
+            this,
+            SLOT(discarded(bool, qint64)));
+
+    //Time series, kept after the worker is gone
+    throughput_series = worker->throughputSeries();
+    latency_series = worker->latencySeries();
+    if (!timeseries_path.isEmpty())
+        timeseries_timer.start(60000);
+
+    //Failing regions captured
+    connect(worker,
+            SIGNAL(captured(int, qint64)),
+            this,
+            SLOT(captured(int, qint64)));
+
+    //Kernel message concerning the device
+    connect(worker,
+            SIGNAL(kernelMessage(qint64, const QString&, int, qint64, double)),
+            this,
+            SLOT(kernelMessage(qint64, const QString&, int, qint64, double)));
+
     //Test failed handler (after write/verify failed, with delay)
     connect(worker,
             SIGNAL(failed(int)),
@@ -406,8 +1214,9 @@ CapacityTesterCli::startVolumeTest(const QString &mountpoint)
     //Start test in background
     thread->start();
 
-    //Start timer
-    tmr_total_test_time.start();
+    //Start timer (all rounds, clean and aged run)
+    if (benchmark_round == 1 && aging_stage == 0)
+        tmr_total_test_time.start();
 
 }
 
@@ -437,6 +1246,50 @@ CapacityTesterCli::failedVolumeTest(int error_type)
 void
 CapacityTesterCli::completedVolumeTest(bool success, int error_type)
 {
+    //Benchmark, test again until all rounds are done
+    if (is_benchmark) addBenchmarkRound();
+    if (is_benchmark && success && benchmark_round < benchmark_rounds)
+    {
+        benchmark_round++;
+        phase_statistics.clear();
+        workload_statistics.clear();
+        allocation_lines.clear();
+        out << endl;
+        out << endl;
+        out << tr("Round %1 of %2").
+            arg(benchmark_round).
+            arg(benchmark_rounds)
+            << endl;
+        startVolumeTest(test_target);
+        return;
+    }
+
+    //Aging, clean run done, test again with aged filesystem
+    if (aging_percent && aging_stage == 0 && success)
+    {
+        for (int i = 0; i < phase_statistics.size(); i++)
+        {
+            const QVariantMap &statistics = phase_statistics.at(i).second;
+            qint64 bytes = statistics.value("bytes").toLongLong();
+            qint64 runtime = statistics.value("runtime").toLongLong();
+            clean_speeds[phase_statistics.at(i).first] = runtime ?
+                ((double)bytes / VolumeTester::MB) /
+                ((double)runtime / 1000) : 0;
+        }
+        aging_stage = 1;
+        phase_statistics.clear();
+        workload_statistics.clear();
+        allocation_lines.clear();
+        out << endl;
+        out << endl;
+        out << tr("Clean run done, aging the volume (%1%, seed %2)").
+            arg(aging_percent).
+            arg(aging_seed)
+            << endl;
+        startVolumeTest(test_target);
+        return;
+    }
+
     //Result
     out << endl;
     out << endl;
@@ -448,7 +1301,8 @@ CapacityTesterCli::completedVolumeTest(bool success, int error_type)
     {
         bool probably_bad = true;
         if (error_type & VolumeTester::Error::Create ||
-            error_type & VolumeTester::Error::Permissions)
+            error_type & VolumeTester::Error::Permissions ||
+            error_type & VolumeTester::Error::Remount)
             probably_bad = false;
         QString comment = probably_bad ?
             tr("The volume might be bad.") :
@@ -463,30 +1317,254 @@ CapacityTesterCli::completedVolumeTest(bool success, int error_type)
             comment += tr("\nWrite failed.");
         if (error_type & VolumeTester::Error::Verify)
             comment += tr("\nVerification failed.");
+        if (error_type & VolumeTester::Error::Remount)
+            comment += tr("\nRemounting the volume failed, "
+                "test files may have to be removed manually.");
         out << tr("Test failed.\n") << comment << endl;
     }
 
-    //Time
-    out << endl;
-    qint64 total_seconds = tmr_total_test_time.elapsed() / 1000;
-    qlonglong elapsed_minutes = total_seconds / 60;
+    //Heap allocations per phase (progress signals excluded)
+    if (!allocation_lines.isEmpty())
+    {
+        out << endl;
+        out << tr("Allocations:") << endl;
+        foreach (QString line, allocation_lines)
+        {
+            out << line << endl;
+        }
+    }
+
+    //Sentinel reads, overhead compared to the write phase
+    for (int i = 0; i < phase_statistics.size(); i++)
+    {
+        const QVariantMap &statistics = phase_statistics.at(i).second;
+        if (!statistics.contains("sentinels")) continue;
+        qint64 runtime = statistics.value("runtime").toLongLong();
+        qint64 sentinel_runtime =
+            statistics.value("sentinel_runtime").toLongLong();
+        double overhead = runtime ? (double)sentinel_runtime / runtime * 100 : 0;
+        out << endl;
+        out << tr("Sentinels:") << "\t"
+            << tr("%1 reads (%2), %3 s, %4% of the write time").
+                arg(statistics.value("sentinels").toLongLong()).
+                arg(Size(statistics.value("sentinel_bytes").toLongLong()).
+                    formatted()).
+                arg((double)sentinel_runtime / 1000, 0, 'f', 1).
+                arg(overhead, 0, 'f', 1)
+            << endl;
+    }
+
+    //Workload, throughput and latencies per request type
+    if (!workload_statistics.isEmpty())
+    {
+        out << endl;
+        out << tr("Workload:") << "\t"
+            << workload_statistics.value("workload").toString() << endl;
+        double sec =
+            (double)workload_statistics.value("runtime").toLongLong() / 1000;
+        QStringList names = QStringList() << "read" << "write";
+        QStringList labels = QStringList() << tr("Read:") << tr("Write:");
+        for (int i = 0; i < names.size(); i++)
+        {
+            QVariantMap map = workload_statistics.value(names.at(i)).toMap();
+            qint64 count = map.value("count").toLongLong();
+            if (!count) continue;
+            qint64 bytes = map.value("bytes").toLongLong();
+            QVariantMap percentiles = map.value("percentiles").toMap();
+            double p50 = percentiles.value(QString::number(50.0, 'f', 6)).
+                toDouble() / 1000000;
+            double p99 = percentiles.value(QString::number(99.0, 'f', 6)).
+                toDouble() / 1000000;
+            out << labels.at(i).leftJustified(15) << "\t"
+                << tr("%1 MB/s, %2 IOPS, latency %3 ms (p50), %4 ms (p99)").
+                    arg(sec ? ((double)bytes / VolumeTester::MB) / sec : 0,
+                        0, 'f', 1).
+                    arg(sec ? (qint64)(count / sec) : 0).
+                    arg(p50, 0, 'f', 2).
+                    arg(p99, 0, 'f', 2)
+                << endl;
+        }
+    }
+
+    //CPU counters per GB transferred
+    if (is_perf && !phase_statistics.isEmpty())
+    {
+        out << endl;
+        out << tr("CPU counters (per GB):") << endl;
+        for (int i = 0; i < phase_statistics.size(); i++)
+        {
+            out << counterLine(phase_statistics.at(i).first,
+                phase_statistics.at(i).second) << endl;
+        }
+    }
+
+    //Throughput per zone (zoned device)
+    if (!zone_lines.isEmpty()) showZones();
+
+    //Throughput statistics of all rounds
+    if (is_benchmark) showBenchmark();
+
+    //Clean compared with aged filesystem
+    if (aging_stage == 1) showAging();
+
+    //Bad block list (badblocks)
+    if (is_badblocks) showBadBlocks();
+
+    //Kernel messages, with block being written or read at that time
+    if (!kernel_messages.isEmpty())
+    {
+        out << endl;
+        out << tr("Kernel messages:") << endl;
+        foreach (QString line, kernel_messages)
+        {
+            out << line << endl;
+        }
+    }
+
+    //Throughput and latency over time, final version
+    if (!timeseries_path.isEmpty() && throughput_series)
+    {
+        timeseries_timer.stop();
+        saveTimeSeries();
+        TimeSeries::Bucket summary = throughput_series->summary();
+        out << endl;
+        out << tr("Time series:") << "\t"
+            << tr("%1 samples, %2 - %3 MB/s, saved to %4").
+                arg(summary.count).
+                arg(summary.min, 0, 'f', 1).
+                arg(summary.max, 0, 'f', 1).
+                arg(timeseries_path)
+            << endl;
+    }
+
+    //Time
+    out << endl;
+    qint64 total_seconds = tmr_total_test_time.elapsed() / 1000;
+    qlonglong elapsed_minutes = total_seconds / 60;
     qlonglong elapsed_seconds = total_seconds % 60;
     QString str_m_s = QString("%1:%2").
         arg(elapsed_minutes, 2, 10, QChar('0')).
         arg(elapsed_seconds, 2, 10, QChar('0'));
     out << "Time:\t\t" << str_m_s << endl;
 
+    //Wipe certificate
+    if (is_wipe) showWipeCertificate(success);
+
+    //fio report (stdout), one job per phase (workload as mixed job)
+    if (is_json)
+    {
+        FioReport report(QString("%1-%2").
+            arg(app.applicationName()).
+            arg(app.applicationVersion()));
+        for (int i = 0; i < phase_statistics.size(); i++)
+        {
+            int phase = phase_statistics.at(i).first;
+            bool write = phase == VolumeTester::Phase::Write;
+            int failed = write ? VolumeTester::Error::Write :
+                VolumeTester::Error::Verify;
+            report.addJob(write ? "write" : "verify",
+                write ? "write" : "read",
+                test_target,
+                phase_statistics.at(i).second,
+                !success && (error_type & failed) ? EIO : 0);
+        }
+        if (!workload_statistics.isEmpty())
+        {
+            int failed = VolumeTester::Error::Write |
+                VolumeTester::Error::Verify;
+            report.addJob("workload", "randrw", test_target,
+                workload_statistics,
+                !success && (error_type & failed) ? EIO : 0);
+        }
+        QTextStream json(stdout);
+        json << report.toJson() << flush;
+    }
+
     if (success)
         close(); //success (code 0)
     else
         close(9); //error
 }
 
+void
+CapacityTesterCli::agingStarted(qint64 total)
+{
+    aging_total = total;
+
+    out << endl;
+    out << "Aging...\t";
+    out << QString(4, 32);
+    out << flush;
+
+}
+
+void
+CapacityTesterCli::agingProgress(qint64 bytes)
+{
+    int p = aging_total ? ((double)bytes / aging_total) * 100 : 0;
+
+    //Print progress
+    QString str_p = QString("%1%").arg(p).rightJustified(4);
+    out << QString(4, 8);
+    out << str_p;
+    out << flush;
+
+}
+
+void
+CapacityTesterCli::aged(int files, qint64 bytes)
+{
+    aging_files = files;
+    aging_bytes = bytes;
+}
+
+void
+CapacityTesterCli::showAging()
+{
+    out << endl;
+    out << tr("Aging (%1%, seed %2):").
+        arg(aging_percent).
+        arg(aging_seed)
+        << "\t"
+        << tr("%1 files kept (%2), free space fragmented").
+            arg(aging_files).
+            arg(Size(aging_bytes).formatted())
+        << endl;
+    out << QString("%1\t%2\t%3\t%4").
+        arg("", -8).
+        arg(tr("clean"), 12).
+        arg(tr("aged"), 12).
+        arg(tr("change"), 8)
+        << endl;
+    for (int i = 0; i < phase_statistics.size(); i++)
+    {
+        int phase = phase_statistics.at(i).first;
+        const QVariantMap &statistics = phase_statistics.at(i).second;
+        qint64 bytes = statistics.value("bytes").toLongLong();
+        qint64 runtime = statistics.value("runtime").toLongLong();
+        double aged_speed = runtime ?
+            ((double)bytes / VolumeTester::MB) / ((double)runtime / 1000) : 0;
+        double clean_speed = clean_speeds.value(phase);
+        double change = clean_speed ?
+            (aged_speed - clean_speed) / clean_speed * 100 : 0;
+        out << QString("%1\t%2\t%3\t%4").
+            arg(phase == VolumeTester::Phase::Write ?
+                tr("Write:") : tr("Verify:"), -8).
+            arg(QString("%1 MB/s").arg(clean_speed, 0, 'f', 1), 12).
+            arg(QString("%1 MB/s").arg(aged_speed, 0, 'f', 1), 12).
+            arg(QString("%1%").arg(change, 0, 'f', 1), 8)
+            << endl;
+    }
+}
+
 void
 CapacityTesterCli::initializationStarted(qint64 total)
 {
     total_mb = total / VolumeTester::MB;
 
+    //Single pass, files created while writing
+    if (is_single_pass) return;
+
     out << endl;
     out << "Initializing...\t";
     out << QString(4, 32);
@@ -536,6 +1614,149 @@ CapacityTesterCli::verifyStarted()
 
 }
 
+void
+CapacityTesterCli::workloadStarted(int seconds)
+{
+    workload_seconds = seconds;
+
+    out << endl;
+    out << "Workload...\t";
+    out << QString(4, 32); //100%
+    out << QString(1, 32);
+    str_workload_speed.clear();
+    out << flush;
+
+}
+
+void
+CapacityTesterCli::workloadProgress(int seconds, qint64 bytes,
+    double avg_speed)
+{
+    Q_UNUSED(bytes);
+    int p = workload_seconds ?
+        qMin(((double)seconds / workload_seconds) * 100, 100.0) : 0;
+
+    //Print progress
+    QString str_p = QString("%1%").arg(p).rightJustified(4);
+    QString str_avg =
+        QString("%1 MB/s").
+        arg((int)avg_speed);
+    out << QString(4, 8);
+    out << QString(1 + str_workload_speed.size(), 8);
+    str_workload_speed = str_avg;
+    out << str_p;
+    out << " " << str_avg;
+    out << flush;
+
+}
+
+void
+CapacityTesterCli::remountStarted()
+{
+    out << endl;
+    out << "Remounting...";
+    out << flush;
+
+}
+
+void
+CapacityTesterCli::flightRecord(const QString &report)
+{
+    out << endl;
+    out << endl;
+    out << report << endl;
+    out << flush;
+
+}
+
+void
+CapacityTesterCli::allocations(int phase, qint64 count, qint64 bytes)
+{
+    if (!AllocationCounter::isEnabled()) return;
+
+    QString name;
+    if (phase == VolumeTester::Phase::Initialize)
+        name = tr("Initialization:");
+    else if (phase == VolumeTester::Phase::Write)
+        name = tr("Write:");
+    else if (phase == VolumeTester::Phase::Verify)
+        name = tr("Verification:");
+    else if (phase == VolumeTester::Phase::Workload)
+        name = tr("Workload:");
+    allocation_lines << QString("%1\t%2 (%3)").
+        arg(name.leftJustified(15)).
+        arg(count).
+        arg(Size(bytes).formatted());
+}
+
+void
+CapacityTesterCli::phaseStatistics(int phase, const QVariantMap &statistics)
+{
+    //Workload reported separately (per request type)
+    if (phase == VolumeTester::Phase::Workload)
+    {
+        workload_statistics = statistics;
+        return;
+    }
+
+    //Initialization only resizes the test files
+    if (phase != VolumeTester::Phase::Write &&
+        phase != VolumeTester::Phase::Verify) return;
+    phase_statistics << qMakePair(phase, statistics);
+}
+
+QString
+CapacityTesterCli::counterLine(int phase, const QVariantMap &statistics)
+{
+    QString name = phase == VolumeTester::Phase::Write ?
+        tr("Write:") : tr("Verification:");
+    QVariantMap counters = statistics.value("counters").toMap();
+    if (counters.isEmpty())
+    {
+        return QString("%1\t%2").
+            arg(name.leftJustified(15)).
+            arg(tr("not available (no access to hardware counters)"));
+    }
+
+    //Ratios per GB (1000 based suffixes)
+    double gb = (double)statistics.value("bytes").toLongLong() /
+        (1024 * 1024 * 1024);
+    QStringList parts;
+    QStringList names = PerfCounters::names();
+    QStringList labels = QStringList()
+        << tr("cycles") << tr("instructions")
+        << tr("cache misses") << tr("branch misses");
+    for (int i = 0; i < names.size(); i++)
+    {
+        if (!counters.contains(names.at(i))) continue;
+        double per_gb = gb ? counters.value(names.at(i)).toDouble() / gb : 0;
+        QString value;
+        if (per_gb >= 1e9)
+            value = QString("%1 G").arg(per_gb / 1e9, 0, 'f', 2);
+        else if (per_gb >= 1e6)
+            value = QString("%1 M").arg(per_gb / 1e6, 0, 'f', 2);
+        else
+            value = QString("%1 K").arg(per_gb / 1e3, 0, 'f', 2);
+        parts << QString("%1 %2").arg(labels.at(i)).arg(value);
+    }
+
+    //Instructions per cycle
+    double cycles = counters.value("cycles").toDouble();
+    if (cycles && counters.contains("instructions"))
+        parts << QString("IPC %1").
+            arg(counters.value("instructions").toDouble() / cycles, 0, 'f', 2);
+
+    //Throughput
+    qint64 runtime = statistics.value("runtime").toLongLong();
+    if (runtime)
+        parts << QString("%1 MB/s").
+            arg(gb * 1024 / ((double)runtime / 1000), 0, 'f', 1);
+
+    if (counters.value("user_only").toBool())
+        parts << tr("user code only");
+    return QString("%1\t%2").arg(name.leftJustified(15)).arg(parts.join(", "));
+}
+
 void
 CapacityTesterCli::written(qint64 written, double avg_speed)
 {
@@ -578,3 +1799,1527 @@ CapacityTesterCli::verified(qint64 read, double avg_speed)
 
 }
 
+void
+CapacityTesterCli::kernelMessage(qint64 time, const QString &message,
+    int phase, qint64 offset, double speed)
+{
+    //Time since start of test
+    qint64 total_seconds = time / 1000;
+    QString str_time = QString("%1:%2.%3").
+        arg(total_seconds / 60, 2, 10, QChar('0')).
+        arg(total_seconds % 60, 2, 10, QChar('0')).
+        arg(time % 1000, 3, 10, QChar('0'));
+
+    //Block in progress
+    QString str_block;
+    if (phase == VolumeTester::Phase::Initialize)
+        str_block = tr("initializing");
+    else if (phase == VolumeTester::Phase::Write)
+        str_block = tr("writing");
+    else if (phase == VolumeTester::Phase::Verify)
+        str_block = tr("verifying");
+    else if (phase == VolumeTester::Phase::Workload)
+        str_block = tr("workload");
+    if (offset >= 0)
+        str_block += QString(" %1, %2 MB/s").
+            arg(Size(offset).formatted()).
+            arg(speed, 0, 'f', 1);
+
+    kernel_messages << QString("%1\t%2\t%3").
+        arg(str_time).
+        arg(str_block.leftJustified(30)).
+        arg(message);
+}
+
+void
+CapacityTesterCli::showDeviceInfo(const QString &device)
+{
+    //Device
+    DeviceTester tester(device);
+    if (!tester.isValid())
+    {
+        err << "The specified device is not valid." << endl;
+        return close(1);
+    }
+
+    //Capacity according to block layer
+    QString block_device = DeviceTester::blockDevice(device);
+    out << "Device:\t\t" << device;
+    if (block_device != device) out << " (" << block_device << ")";
+    out << endl;
+    Size size = tester.bytesTotal();
+    out << tr("Size:") << "\t\t"
+        << size.formatted()
+        << " / "
+        << size.toLongLong() << " B"
+        << endl;
+
+    //Capacity according to device (READ CAPACITY)
+    int sector_size = 0;
+    QString name;
+    qint64 claimed_bytes = tester.claimedCapacity(&sector_size, &name);
+    Size claimed = claimed_bytes;
+    if (claimed_bytes >= 0)
+    {
+        if (!name.isEmpty())
+            out << tr("Name:") << "\t\t" << name << endl;
+        out << tr("Claimed:") << "\t"
+            << claimed.formatted()
+            << " / "
+            << claimed.toLongLong() << " B"
+            << " / "
+            << tr("%1 B blocks").arg(sector_size)
+            << endl;
+    }
+    out << endl;
+
+    //Filesystems on device
+    qint64 filesystem_total = 0;
+    foreach (QStorageInfo storage, tester.filesystems())
+    {
+        Size capacity = storage.bytesTotal();
+        filesystem_total += storage.bytesTotal();
+        out << "*\t"
+            << QString::fromLocal8Bit(storage.device())
+            << "\t"
+            << capacity.formatted().leftJustified(10)
+            << "\t"
+            << storage.rootPath()
+            << endl;
+    }
+    if (filesystem_total) out << endl;
+
+    //Cross-check
+    if (claimed_bytes >= 0 && claimed_bytes != size.toLongLong())
+    {
+        out << tr(
+            "The capacity reported by the device "
+            "does not match the size of the block device.")
+            << endl;
+    }
+    qint64 capacity = claimed_bytes >= 0 ? claimed_bytes : size.toLongLong();
+    if (filesystem_total > capacity)
+    {
+        out << tr(
+            "The filesystems are larger than the device, "
+            "the device or the partition table is not valid.")
+            << endl;
+    }
+    if (filesystem_total)
+    {
+        out << tr(
+            "The device contains mounted filesystems, "
+            "it cannot be tested.")
+            << endl;
+    }
+
+}
+
+void
+CapacityTesterCli::startDeviceTest(const QString &device)
+{
+    //Device
+    DeviceTester tester(device);
+    if (!tester.isValid())
+    {
+        err << "The specified device is not valid." << endl;
+        return close(1);
+    }
+    if (is_scsi && !tester.setBackend(DeviceTester::Scsi))
+    {
+        err << tr("SCSI pass-through (SG_IO) is not supported.") << endl;
+        return close(1);
+    }
+
+    //Capacity cross-check
+    showDeviceInfo(device);
+    if (!tester.filesystems().isEmpty()) return close(1);
+
+    //Zoned device, host-managed devices reject random writes
+    QString zone_model = DeviceTester::zoneModel(device);
+    if (!is_zoned && zone_model == "host-managed")
+    {
+        out << tr("Zoned device (%1), testing zone by zone.").
+            arg(zone_model)
+            << endl;
+        is_zoned = true;
+    }
+    if (is_zoned && is_scsi)
+    {
+        err << tr("Zoned devices are tested through the block layer.")
+            << endl;
+        return close(1);
+    }
+
+    //Pattern sequence (badblocks)
+    if (is_badblocks && is_scsi)
+    {
+        err << tr("The badblocks test uses the block layer.") << endl;
+        return close(1);
+    }
+    if (is_badblocks && is_zoned)
+    {
+        err << tr("The badblocks test cannot be used with zoned devices.")
+            << endl;
+        return close(1);
+    }
+    if (bad_block_size && !tester.setBadBlockSize(bad_block_size))
+    {
+        err << tr("Invalid bad block size: %1").arg(bad_block_size) << endl;
+        return close(1);
+    }
+
+    //Device will be overwritten
+    out << endl;
+    out << tr("All data on %1 will be destroyed. Continue?").
+        arg(device)
+        << endl;
+    if (!confirm()) return close(2);
+
+    //Worker
+    test_target = device;
+    device_worker = new DeviceTester(device);
+    device_worker->setBackend(is_scsi ? DeviceTester::Scsi :
+        DeviceTester::BlockLayer);
+    if (transfer_length)
+        device_worker->setTransferLength(transfer_length);
+    device_worker->setVerifySampling(verify_sample);
+    device_worker->setDiscard(is_discard);
+    device_worker->setPerfCounters(is_perf);
+    device_worker->setZoned(is_zoned);
+    if (open_zones)
+        device_worker->setOpenZones(open_zones);
+    if (is_badblocks)
+        device_worker->setPatternSequence(DeviceTester::badblocksPatterns());
+    if (bad_block_size)
+        device_worker->setBadBlockSize(bad_block_size);
+    if (queue_depth)
+        device_worker->setQueueDepth(queue_depth);
+    if (!data_provider.isEmpty())
+        device_worker->setDataProvider(data_provider);
+
+    //Thread for worker
+    QThread *thread = new QThread;
+    device_worker->moveToThread(thread);
+
+    //Start worker when thread starts
+    connect(thread,
+            SIGNAL(started()),
+            device_worker,
+            SLOT(start()));
+
+    //Started (size known)
+    connect(device_worker,
+            SIGNAL(started(qint64)),
+            this,
+            SLOT(deviceTestStarted(qint64)));
+
+    //Written
+    connect(device_worker,
+            SIGNAL(written(qint64, double)),
+            this,
+            SLOT(written(qint64, double)));
+
+    //Verified
+    connect(device_worker,
+            SIGNAL(verified(qint64, double)),
+            this,
+            SLOT(verified(qint64, double)));
+
+    //Write started
+    connect(device_worker,
+            SIGNAL(writeStarted()),
+            this,
+            SLOT(writeStarted()));
+
+    //Verify started
+    connect(device_worker,
+            SIGNAL(verifyStarted()),
+            this,
+            SLOT(verifyStarted()));
+
+    //Allocations per phase
+    connect(device_worker,
+            SIGNAL(allocations(int, qint64, qint64)),
+            this,
+            SLOT(allocations(int, qint64, qint64)));
+
+    //Throughput and latencies per phase
+    connect(device_worker,
+            SIGNAL(phaseStatistics(int, const QVariantMap&)),
+            this,
+            SLOT(phaseStatistics(int, const QVariantMap&)));
+
+    //Discard result
+    connect(device_worker,
+            SIGNAL(discarded(bool, qint64)),
+            this,
+            SLOT(discarded(bool, qint64)));
+
+    //Throughput per zone (zoned device)
+    connect(device_worker,
+            SIGNAL(zoneTested(int, qint64, qint64, double, double)),
+            this,
+            SLOT(zoneTested(int, qint64, qint64, double, double)));
+
+    //Next pattern (badblocks)
+    connect(device_worker,
+            SIGNAL(patternStarted(int, const QString&)),
+            this,
+            SLOT(patternStarted(int, const QString&)));
+
+    //Bad block found (badblocks)
+    connect(device_worker,
+            SIGNAL(badBlock(qint64)),
+            this,
+            SLOT(badBlock(qint64)));
+
+    //Test completed handler (successful or not)
+    connect(device_worker,
+            SIGNAL(finished(bool, int)),
+            this,
+            SLOT(completedVolumeTest(bool, int)));
+
+    //Stop thread when worker done
+    connect(device_worker,
+            SIGNAL(finished()),
+            thread,
+            SLOT(quit()));
+
+    //Delete worker when done
+    connect(device_worker,
+            SIGNAL(finished()),
+            device_worker,
+            SLOT(deleteLater()));
+
+    //Delete thread when thread done
+    connect(thread,
+            SIGNAL(finished()),
+            thread,
+            SLOT(deleteLater()));
+
+    //Get started
+    out << "Starting device test... " << flush;
+
+    //Start test in background
+    thread->start();
+
+    //Start timer
+    tmr_total_test_time.start();
+
+}
+
+void
+CapacityTesterCli::deviceTestStarted(qint64 total)
+{
+    total_mb = total / VolumeTester::MB;
+}
+
+void
+CapacityTesterCli::zoneTested(int zone, qint64 start, qint64 capacity,
+    double write_speed, double read_speed)
+{
+    zone_lines << QString("%1\t%2\t%3\t%4 MB/s\t%5").
+        arg(zone, 6).
+        arg(start, 14).
+        arg(Size(capacity).formatted().rightJustified(10)).
+        arg(write_speed, 8, 'f', 1).
+        arg(read_speed ?
+            QString("%1 MB/s").arg(read_speed, 8, 'f', 1) : QString("-"));
+    zone_speeds << qMakePair(write_speed, read_speed);
+}
+
+void
+CapacityTesterCli::patternStarted(int index, const QString &pattern)
+{
+    out << endl;
+    out << tr("Pattern %1/%2:\t%3").
+        arg(index + 1).
+        arg(DeviceTester::badblocksPatterns().size()).
+        arg(pattern);
+    out << flush;
+
+}
+
+void
+CapacityTesterCli::badBlock(qint64 block)
+{
+    bad_blocks << block;
+}
+
+void
+CapacityTesterCli::showBadBlocks()
+{
+    //Block numbers, like badblocks -o (one per line, ascending)
+    std::sort(bad_blocks.begin(), bad_blocks.end());
+    QStringList lines;
+    foreach (qint64 block, bad_blocks)
+    {
+        lines << QString::number(block);
+    }
+
+    out << endl;
+    out << tr("Bad blocks:") << "\t" << bad_blocks.size()
+        << " (" << tr("%1 B blocks").arg(bad_block_size ?
+            bad_block_size : 4096) << ")"
+        << endl;
+    const int limit = 32;
+    for (int i = 0; i < lines.size() && i < limit; i++)
+    {
+        out << lines.at(i) << endl;
+    }
+    if (lines.size() > limit) out << "..." << endl;
+
+    //Save list, empty if there are none
+    if (!bad_block_path.isEmpty())
+    {
+        QFile file(bad_block_path);
+        QByteArray data = lines.join("\n").toUtf8();
+        if (!lines.isEmpty()) data += "\n";
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text) ||
+            file.write(data) == -1)
+            err << tr("Cannot save bad block list: %1").arg(bad_block_path)
+                << endl;
+    }
+}
+
+void
+CapacityTesterCli::showZones()
+{
+    out << endl;
+    out << tr("Zones:") << endl;
+    out << tr("  zone\t        offset\t  capacity\t     write\t      read")
+        << endl;
+
+    //All zones, or the slowest ones (by write speed) of a large device
+    const int limit = 32;
+    if (zone_lines.size() <= limit)
+    {
+        foreach (QString line, zone_lines)
+        {
+            out << line << endl;
+        }
+        return;
+    }
+    QList<QPair<double, int> > slowest;
+    double write_min = 0, write_max = 0, write_sum = 0;
+    double read_min = 0, read_max = 0, read_sum = 0;
+    int read_count = 0;
+    for (int i = 0; i < zone_speeds.size(); i++)
+    {
+        double write = zone_speeds.at(i).first;
+        double read = zone_speeds.at(i).second;
+        if (!i || write < write_min) write_min = write;
+        if (!i || write > write_max) write_max = write;
+        write_sum += write;
+        if (read)
+        {
+            if (!read_count || read < read_min) read_min = read;
+            if (!read_count || read > read_max) read_max = read;
+            read_sum += read;
+            read_count++;
+        }
+        slowest << qMakePair(write, i);
+    }
+    std::sort(slowest.begin(), slowest.end());
+    for (int i = 0; i < 8; i++)
+    {
+        out << zone_lines.at(slowest.at(i).second) << endl;
+    }
+    out << tr("(%1 zones, slowest shown)").arg(zone_lines.size()) << endl;
+    out << tr("Write:\t\tmin %1 / avg %2 / max %3 MB/s").
+        arg(write_min, 0, 'f', 1).
+        arg(write_sum / zone_speeds.size(), 0, 'f', 1).
+        arg(write_max, 0, 'f', 1)
+        << endl;
+    if (read_count)
+    {
+        out << tr("Read:\t\tmin %1 / avg %2 / max %3 MB/s").
+            arg(read_min, 0, 'f', 1).
+            arg(read_sum / read_count, 0, 'f', 1).
+            arg(read_max, 0, 'f', 1)
+            << endl;
+    }
+}
+
+void
+CapacityTesterCli::startWipe(const QString &path)
+{
+    //Keyed random stream, the key is part of the certificate
+    if (data_provider.isEmpty())
+    {
+        quint64 key = 0;
+        QFile random("/dev/urandom");
+        if (!random.open(QIODevice::ReadOnly) ||
+            random.read((char*)&key, sizeof(key)) != sizeof(key))
+            key = (quint64)QDateTime::currentMSecsSinceEpoch() << 16 ^
+                (quint64)QCoreApplication::applicationPid();
+        data_provider = QString("keystream:%1").arg(key);
+    }
+
+    //Target: whole device or free space
+    is_wipe = true;
+    wipe_target = path;
+    wipe_started = QDateTime::currentDateTime();
+    if (DeviceTester::isDevice(path))
+    {
+        DeviceTester tester(path);
+        wipe_capacity = tester.bytesTotal();
+        tester.claimedCapacity(0, &wipe_name);
+        startDeviceTest(path);
+    }
+    else
+    {
+        VolumeTester tester(path);
+        wipe_capacity = tester.bytesAvailable();
+        wipe_name = tester.name();
+        startVolumeTest(path);
+    }
+}
+
+void
+CapacityTesterCli::discarded(bool success, qint64 bytes)
+{
+    discard_result = success;
+    discard_bytes = bytes;
+}
+
+void
+CapacityTesterCli::showWipeCertificate(bool success)
+{
+    //Bytes and speed per phase
+    qint64 written = 0, verified = 0;
+    double write_speed = 0, verify_speed = 0;
+    for (int i = 0; i < phase_statistics.size(); i++)
+    {
+        const QVariantMap &statistics = phase_statistics.at(i).second;
+        qint64 bytes = statistics.value("bytes").toLongLong();
+        qint64 runtime = statistics.value("runtime").toLongLong();
+        double speed = runtime ? ((double)bytes / VolumeTester::MB) /
+            ((double)runtime / 1000) : 0;
+        if (phase_statistics.at(i).first == VolumeTester::Phase::Write)
+        {
+            written = bytes;
+            write_speed = speed;
+        }
+        else
+        {
+            verified = bytes;
+            verify_speed = speed;
+        }
+    }
+    double coverage = wipe_capacity ? (double)written / wipe_capacity * 100 : 0;
+    bool is_device = DeviceTester::isDevice(wipe_target);
+
+    QStringList lines;
+    lines << tr("Wipe certificate");
+    lines << "================";
+    lines << tr("Target:") + "\t\t" + wipe_target +
+        (wipe_name.isEmpty() ? "" : " (" + wipe_name + ")");
+    lines << tr("Scope:") + "\t\t" + (is_device ?
+        tr("whole device") :
+        tr("free space of volume (existing files not overwritten)"));
+    lines << tr("Method:") + "\t\t" +
+        tr("overwrite with %1").arg(data_provider.isEmpty() ?
+            "random" : data_provider);
+    lines << tr("Started:") + "\t" + wipe_started.toString(Qt::ISODate);
+    lines << tr("Finished:") + "\t" +
+        QDateTime::currentDateTime().toString(Qt::ISODate);
+    lines << tr("Capacity:") + "\t" + QString("%1 / %2 B").
+        arg(Size(wipe_capacity).formatted()).
+        arg(wipe_capacity);
+    lines << tr("Overwritten:") + "\t" + QString("%1 / %2 B (%3%)").
+        arg(Size(written).formatted()).
+        arg(written).
+        arg(coverage, 0, 'f', 2);
+    lines << tr("Write speed:") + "\t" +
+        QString("%1 MB/s").arg(write_speed, 0, 'f', 1);
+    if (verify_sample)
+    {
+        lines << tr("Verified:") + "\t" + QString("%1 / %2 B (%3)").
+            arg(Size(verified).formatted()).
+            arg(verified).
+            arg(verify_sample < 100 ?
+                tr("%1% sample").arg(verify_sample) : tr("full"));
+        lines << tr("Verify speed:") + "\t" +
+            QString("%1 MB/s").arg(verify_speed, 0, 'f', 1);
+    }
+    else
+    {
+        lines << tr("Verified:") + "\t" + tr("not verified");
+    }
+    QString discard = is_discard ? tr("skipped") : tr("not requested");
+    if (discard_result == 1)
+        discard = tr("done (%1)").arg(Size(discard_bytes).formatted());
+    else if (discard_result == 0)
+        discard = tr("failed");
+    lines << tr("Discard:") + "\t" + discard;
+    lines << tr("Result:") + "\t\t" + (success ? tr("PASSED") : tr("FAILED"));
+    lines << tr("Program:") + "\t" +
+        app.applicationName() + " " + app.applicationVersion();
+
+    //Digest of the above, detects later modifications
+    QByteArray text = lines.join("\n").toUtf8();
+    lines << tr("SHA-256:") + "\t" + QString::fromLatin1(
+        QCryptographicHash::hash(text, QCryptographicHash::Sha256).toHex());
+
+    out << endl;
+    foreach (QString line, lines)
+    {
+        out << line << endl;
+    }
+
+    //Save certificate
+    if (!certificate_path.isEmpty())
+    {
+        QFile file(certificate_path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text) ||
+            file.write(lines.join("\n").toUtf8() + "\n") == -1)
+            err << tr("Cannot save certificate: %1").arg(certificate_path)
+                << endl;
+    }
+}
+
+/*!
+ * Adds the throughput samples of the last round (write and verify).
+ */
+void
+CapacityTesterCli::addBenchmarkRound()
+{
+    for (int i = 0; i < phase_statistics.size(); i++)
+    {
+        int phase = phase_statistics.at(i).first;
+        QVariantMap map =
+            phase_statistics.at(i).second.value("benchmark").toMap();
+        if (map.isEmpty()) continue;
+        benchmark_batches[phase].add(BenchmarkStatistics::fromVariantMap(map));
+        benchmark_speeds[phase].add(map.value("speed").toDouble());
+    }
+}
+
+void
+CapacityTesterCli::showBenchmark()
+{
+    out << endl;
+    out << tr("Benchmark (%1 round(s), warm-up %2 s):").
+        arg(benchmark_round).
+        arg(warmup_seconds)
+        << endl;
+
+    //Rounds are the unit of replication, batch means only show
+    //the dispersion within a round (correlated)
+    QVariantMap phases;
+    foreach (int phase, benchmark_speeds.keys())
+    {
+        const BenchmarkStatistics &rounds = benchmark_speeds[phase];
+        const BenchmarkStatistics &batches = benchmark_batches[phase];
+        QString name = phase == VolumeTester::Phase::Write ?
+            "write" : "verify";
+        out << QString("%1:").arg(name).leftJustified(8);
+        if (rounds.count() > 1)
+            out << tr("mean %1 MB/s (95% CI %2 - %3), sd %4, %5 rounds").
+                arg(rounds.mean(), 0, 'f', 1).
+                arg(rounds.confidenceLow(), 0, 'f', 1).
+                arg(rounds.confidenceHigh(), 0, 'f', 1).
+                arg(rounds.stddev(), 0, 'f', 1).
+                arg(rounds.count());
+        else
+            out << tr("%1 MB/s (single round, no confidence interval)").
+                arg(rounds.mean(), 0, 'f', 1);
+        out << endl;
+
+        //Throughput of each round (after warm-up)
+        QStringList speeds;
+        foreach (double speed, rounds.samples())
+            speeds << QString::number(speed, 'f', 1);
+        if (speeds.size() > 1)
+            out << "\t" << tr("rounds: %1 MB/s").arg(speeds.join(", "))
+                << endl;
+
+        //Dispersion within the rounds
+        out << "\t" << tr("batches: median %1 MB/s, MAD %2, %3 samples").
+                arg(batches.median(), 0, 'f', 1).
+                arg(batches.mad(), 0, 'f', 1).
+                arg(batches.count())
+            << endl;
+
+        QVariantMap map = rounds.toVariantMap();
+        map["batches"] = batches.toVariantMap();
+        phases[name] = map;
+    }
+
+    //Save samples for comparison
+    if (!benchmark_path.isEmpty())
+    {
+        QVariantMap root;
+        root["target"] = test_target;
+        root["rounds"] = benchmark_round;
+        root["warmup"] = warmup_seconds;
+        root["time"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+        root["phases"] = phases;
+        QFile file(benchmark_path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text) ||
+            file.write(QJsonDocument(QJsonObject::fromVariantMap(root)).
+                toJson()) == -1)
+            err << tr("Cannot save benchmark: %1").arg(benchmark_path)
+                << endl;
+        else
+            out << tr("Benchmark saved to %1.").arg(benchmark_path) << endl;
+    }
+}
+
+void
+CapacityTesterCli::compareBenchmarks(const QString &path_a,
+    const QString &path_b)
+{
+    //Saved benchmarks (see showBenchmark())
+    QVariantMap phases[2];
+    QStringList paths = QStringList() << path_a << path_b;
+    for (int i = 0; i < 2; i++)
+    {
+        QFile file(paths.at(i));
+        QJsonDocument document;
+        if (file.open(QIODevice::ReadOnly))
+            document = QJsonDocument::fromJson(file.readAll());
+        if (!document.isObject())
+        {
+            err << tr("Cannot read benchmark: %1").arg(paths.at(i)) << endl;
+            return close(1);
+        }
+        phases[i] = document.object().toVariantMap().value("phases").toMap();
+        out << QString("%1:\t%2").arg(i ? "B" : "A").arg(paths.at(i))
+            << endl;
+    }
+    out << endl;
+
+    //Each phase in both benchmarks, B compared with A
+    bool different = false;
+    foreach (QString name, phases[0].keys())
+    {
+        if (!phases[1].contains(name)) continue;
+        BenchmarkStatistics a =
+            BenchmarkStatistics::fromVariantMap(phases[0][name].toMap());
+        BenchmarkStatistics b =
+            BenchmarkStatistics::fromVariantMap(phases[1][name].toMap());
+        BenchmarkStatistics::Comparison comparison =
+            BenchmarkStatistics::compare(a, b);
+        out << QString("%1:").arg(name).leftJustified(8)
+            << tr("A %1 MB/s (%2 rounds), B %3 MB/s (%4 rounds), %5%6%").
+                arg(a.mean(), 0, 'f', 1).
+                arg(a.count()).
+                arg(b.mean(), 0, 'f', 1).
+                arg(b.count()).
+                arg(comparison.difference >= 0 ? "+" : "").
+                arg(comparison.difference, 0, 'f', 1)
+            << endl;
+
+        //One sample per round, a single run says nothing about variance
+        if (a.count() < BenchmarkStatistics::MIN_ROUNDS ||
+            b.count() < BenchmarkStatistics::MIN_ROUNDS)
+        {
+            out << "\t" << tr("not enough rounds to compare (at least %1)").
+                arg(BenchmarkStatistics::MIN_ROUNDS)
+                << endl;
+            continue;
+        }
+        out << "\t" << (comparison.significant ?
+            tr("significant difference (p = %1 < 0.05)") :
+            tr("no significant difference (p = %1)")).
+                arg(comparison.p_value, 0, 'g', 3)
+            << endl;
+        if (comparison.significant) different = true;
+    }
+
+    close(different ? 3 : 0);
+}
+
+/*!
+ * Saves the throughput and latency series of the current test
+ * (at most 1000 buckets each) with their summary.
+ */
+void
+CapacityTesterCli::saveTimeSeries()
+{
+    if (!throughput_series || !latency_series) return;
+
+    QVariantMap root;
+    QStringList names = QStringList() << "throughput" << "latency";
+    QStringList units = QStringList() << "MB/s" << "ms";
+    for (int i = 0; i < names.size(); i++)
+    {
+        const TimeSeries &series = i ? *latency_series : *throughput_series;
+        TimeSeries::Bucket summary = series.summary();
+        QVariantMap map;
+        map["unit"] = units.at(i);
+        map["count"] = summary.count;
+        map["min"] = summary.min;
+        map["mean"] = TimeSeries::mean(summary);
+        map["max"] = summary.max;
+        map["buckets"] = TimeSeries::toVariantList(series.buckets(1000));
+        root[names.at(i)] = map;
+    }
+
+    QFile file(timeseries_path);
+    if (!file.open(QIODevice::WriteOnly) ||
+        file.write(QJsonDocument(QJsonObject::fromVariantMap(root)).
+            toJson()) == -1)
+    {
+        err << tr("Cannot save time series: %1").arg(timeseries_path)
+            << endl;
+    }
+}
+
+void
+CapacityTesterCli::captured(int regions, qint64 bytes)
+{
+    out << endl;
+    out << tr("Capture:") << "\t"
+        << tr("%1 region(s) (%2) saved to %3").
+            arg(regions).
+            arg(Size(bytes).formatted()).
+            arg(capture_path)
+        << endl;
+    out << flush;
+
+}
+
+void
+CapacityTesterCli::analyzeCapture(const QString &path)
+{
+    //Capture saved during a test (see VolumeTester::setCapture())
+    QVariantMap header;
+    QList<ForensicCapture::Region> regions;
+    if (!ForensicCapture::read(path, &header, &regions))
+    {
+        err << tr("Cannot read capture: %1").arg(path) << endl;
+        return close(1);
+    }
+    out << tr("Device:") << "\t\t" << header.value("device").toString()
+        << endl;
+    out << tr("Started:") << "\t" << header.value("started").toString()
+        << endl;
+    out << tr("Test data:") << "\t" << header.value("provider").toString()
+        << endl;
+
+    //Expected data generated again from the seed
+    QScopedPointer<DataProvider> provider(
+        DataProvider::create(header.value("provider").toString()));
+    if (!provider)
+    {
+        err << tr("Cannot generate the test data.") << endl;
+        return close(1);
+    }
+
+    out << endl;
+    foreach (const ForensicCapture::Region &region, regions)
+    {
+        QString str_region = QString("%1 %2 (%3)").
+            arg(region.kind.leftJustified(9)).
+            arg(region.offset).
+            arg(Size(region.size).formatted());
+        if (region.info.value("read_error").toBool())
+        {
+            out << str_region << "\t" << tr("unreadable") << endl;
+            continue;
+        }
+
+        //Expected data with the id sequences of the blocks
+        QByteArray expected(region.size, (char)0);
+        provider->fill(expected.data(), region.size, region.offset);
+        QStringList foreign;
+        foreach (QVariant block, region.info.value("blocks").toList())
+        {
+            QVariantMap map = block.toMap();
+            QByteArray id = QByteArray::fromHex(
+                map.value("id").toString().toLatin1());
+            qint64 pos = map.value("offset").toLongLong() - region.offset;
+            if (pos < 0 || pos + id.size() > region.size) continue;
+            memcpy(expected.data() + pos, id.constData(), id.size());
+
+            //Id of another block (address wraparound)
+            QByteArray actual_id = region.data.mid(pos, id.size());
+            int end = region.data.indexOf('\1', pos);
+            if (actual_id != id && end > pos && end - pos < 24)
+            {
+                QString other =
+                    QString::fromLatin1(region.data.mid(pos, end - pos));
+                if (QRegExp("\\d+:\\d+").exactMatch(other))
+                    foreign << other;
+            }
+        }
+
+        //Wrong bytes
+        int wrong = 0;
+        int first = -1;
+        bool zeros = true;
+        bool ones = true;
+        for (int i = 0; i < region.size; i++)
+        {
+            char c = region.data.at(i);
+            if (c != 0) zeros = false;
+            if (c != (char)0xFF) ones = false;
+            if (c == expected.at(i)) continue;
+            if (first == -1) first = i;
+            wrong++;
+        }
+
+        QString result;
+        if (!wrong)
+            result = tr("as expected");
+        else
+            result = tr("%1 byte(s) wrong, first at %2").
+                arg(wrong).
+                arg(region.offset + first);
+        if (wrong && zeros)
+            result += tr(", all zero");
+        else if (wrong && ones)
+            result += tr(", all 0xFF");
+        if (!foreign.isEmpty())
+            result += tr(", contains block(s) %1").arg(foreign.join(" "));
+        out << str_region << "\t" << result << endl;
+    }
+
+    close();
+}
+
+void
+CapacityTesterCli::startGeometry(const QString &path)
+{
+    //Device or mountpoint
+    geometry_worker = new FlashGeometry(path);
+    if (!geometry_worker->isValid())
+    {
+        delete geometry_worker;
+        err << "The specified device or volume is not valid." << endl;
+        return close(1);
+    }
+
+    //The write test destroys data on a raw device, skip it if declined
+    if (geometry_worker->isDevice())
+    {
+        out << tr(
+            "The open allocation unit test overwrites data "
+            "at the beginning of %1. Run it?").
+            arg(path)
+            << endl;
+        geometry_worker->setWriteTest(confirm());
+    }
+
+    //Thread for worker
+    QThread *thread = new QThread;
+    geometry_worker->moveToThread(thread);
+
+    //Start worker when thread starts
+    connect(thread,
+            SIGNAL(started()),
+            geometry_worker,
+            SLOT(start()));
+
+    //Alignment measured
+    connect(geometry_worker,
+            SIGNAL(alignmentMeasured(qint64, double, double, double)),
+            this,
+            SLOT(geometryAlignment(qint64, double, double, double)));
+
+    //Open units measured
+    connect(geometry_worker,
+            SIGNAL(openUnitsMeasured(int, double)),
+            this,
+            SLOT(geometryOpenUnits(int, double)));
+
+    //Result
+    connect(geometry_worker,
+            SIGNAL(detected(qint64, qint64, int)),
+            this,
+            SLOT(geometryDetected(qint64, qint64, int)));
+
+    //Error
+    connect(geometry_worker,
+            SIGNAL(failed(const QString&)),
+            this,
+            SLOT(geometryFailed(const QString&)));
+
+    //Completed handler (successful or not)
+    connect(geometry_worker,
+            SIGNAL(finished(bool)),
+            this,
+            SLOT(completedGeometry(bool)));
+
+    //Stop thread when worker done
+    connect(geometry_worker,
+            SIGNAL(finished()),
+            thread,
+            SLOT(quit()));
+
+    //Delete worker when done
+    connect(geometry_worker,
+            SIGNAL(finished()),
+            geometry_worker,
+            SLOT(deleteLater()));
+
+    //Delete thread when thread done
+    connect(thread,
+            SIGNAL(finished()),
+            thread,
+            SLOT(deleteLater()));
+
+    //Get started
+    out << "Analyzing flash geometry... " << endl;
+    out << endl;
+
+    //Start in background
+    thread->start();
+
+    //Start timer
+    tmr_total_test_time.start();
+
+}
+
+void
+CapacityTesterCli::geometryAlignment(qint64 align, double pre, double on,
+    double post)
+{
+    //Like flashbench -a, times in microseconds
+    double diff = on - (pre + post) / 2;
+    out << QString("align %1\tpre %2 us\ton %3 us\tpost %4 us\tdiff %5 us").
+        arg(Size(align).formatted(), -10).
+        arg(pre, 0, 'f', 1).
+        arg(on, 0, 'f', 1).
+        arg(post, 0, 'f', 1).
+        arg(diff, 0, 'f', 1)
+        << endl;
+}
+
+void
+CapacityTesterCli::geometryOpenUnits(int units, double avg_speed)
+{
+    out << QString("%1 erase block(s) written alternately\t%2 MB/s").
+        arg(units, 2).
+        arg(avg_speed, 0, 'f', 1)
+        << endl;
+}
+
+void
+CapacityTesterCli::geometryDetected(qint64 erase_block, qint64 page,
+    int open_units)
+{
+    out << endl;
+    out << tr("Erase block size:") << "\t"
+        << (erase_block ? Size(erase_block).formatted() : tr("unknown"))
+        << endl;
+    out << tr("Page size:") << "\t\t"
+        << (page ? Size(page).formatted() : tr("unknown"))
+        << endl;
+    out << tr("Open units:") << "\t\t"
+        << (open_units ? QString::number(open_units) : tr("not measured"))
+        << endl;
+
+    //Tuning
+    if (erase_block)
+    {
+        out << endl;
+        out << tr(
+            "Partitions and filesystem clusters should be aligned to %1, "
+            "writes should be a multiple of it (-transfer-length).").
+            arg(Size(erase_block).formatted())
+            << endl;
+        if (open_units)
+            out << tr(
+                "Up to %1 streams or files can be written at the same time "
+                "without losing speed.").
+                arg(open_units)
+                << endl;
+    }
+}
+
+void
+CapacityTesterCli::geometryFailed(const QString &message)
+{
+    out << endl;
+    out << tr("Analysis failed: %1").arg(message) << endl;
+}
+
+void
+CapacityTesterCli::completedGeometry(bool success)
+{
+    if (success)
+        close(); //success (code 0)
+    else
+        close(9); //error
+}
+
+void
+CapacityTesterCli::startImageWrite(const QString &image,
+    const QStringList &targets, bool sparse)
+{
+    //Writer
+    ImageWriter writer(image, targets);
+    if (!writer.isValid())
+    {
+        err << "The specified image or targets are not valid." << endl;
+        return close(1);
+    }
+
+    //Targets will be overwritten
+    out << tr("The image %1 (%2) will be written to:").
+        arg(image).
+        arg(Size(writer.imageSize()).formatted())
+        << endl;
+    foreach (QString path, writer.targets())
+    {
+        out << "*\t" << path << endl;
+    }
+    out << tr("All data on these targets will be overwritten. Continue?")
+        << endl;
+    if (!confirm()) return close(2);
+
+    //Worker
+    image_writer = new ImageWriter(image, targets);
+    image_writer->setSparse(sparse);
+
+    //Thread for worker
+    QThread *thread = new QThread;
+    image_writer->moveToThread(thread);
+
+    //Start worker when thread starts
+    connect(thread,
+            SIGNAL(started()),
+            image_writer,
+            SLOT(start()));
+
+    //Started
+    connect(image_writer,
+            SIGNAL(started(qint64, int)),
+            this,
+            SLOT(imageStarted(qint64, int)));
+
+    //Written
+    connect(image_writer,
+            SIGNAL(written(int, qint64, double)),
+            this,
+            SLOT(imageWritten(int, qint64, double)));
+
+    //Verified
+    connect(image_writer,
+            SIGNAL(verified(int, qint64, double)),
+            this,
+            SLOT(imageVerified(int, qint64, double)));
+
+    //Image read (data size known)
+    connect(image_writer,
+            SIGNAL(sourceRead(qint64, qint64)),
+            this,
+            SLOT(imageRead(qint64, qint64)));
+
+    //Target failed
+    connect(image_writer,
+            SIGNAL(targetFailed(int, qint64, int)),
+            this,
+            SLOT(imageTargetFailed(int, qint64, int)));
+
+    //Completed handler (successful or not)
+    connect(image_writer,
+            SIGNAL(finished(bool)),
+            this,
+            SLOT(completedImageWrite(bool)));
+
+    //Stop thread when worker done
+    connect(image_writer,
+            SIGNAL(finished()),
+            thread,
+            SLOT(quit()));
+
+    //Delete worker when done
+    connect(image_writer,
+            SIGNAL(finished()),
+            image_writer,
+            SLOT(deleteLater()));
+
+    //Delete thread when thread done
+    connect(thread,
+            SIGNAL(finished()),
+            thread,
+            SLOT(deleteLater()));
+
+    //Get started
+    out << "Writing image... " << flush;
+
+    //Start in background
+    thread->start();
+
+    //Start timer
+    tmr_total_test_time.start();
+
+}
+
+void
+CapacityTesterCli::imageStarted(qint64 total, int targets)
+{
+    image_total = total;
+    image_data = total;
+    image_skipped = 0;
+    image_paths = image_writer ? image_writer->targets() : QStringList();
+    image_written.clear();
+    image_verified.clear();
+    image_errors.clear();
+    for (int i = 0; i < targets; i++)
+    {
+        image_written << 0;
+        image_verified << 0;
+        image_errors << 0;
+    }
+
+    out << endl;
+    out << "Progress:\t";
+    out << QString(4, 32);
+    out << flush;
+
+}
+
+void
+CapacityTesterCli::imageWritten(int target, qint64 bytes, double avg_speed)
+{
+    Q_UNUSED(avg_speed);
+    if (target < 0 || target >= image_written.size()) return;
+    image_written[target] = bytes;
+    showImageProgress();
+}
+
+void
+CapacityTesterCli::imageVerified(int target, qint64 bytes, double avg_speed)
+{
+    Q_UNUSED(avg_speed);
+    if (target < 0 || target >= image_verified.size()) return;
+    image_verified[target] = bytes;
+    showImageProgress();
+}
+
+void
+CapacityTesterCli::imageRead(qint64 data, qint64 skipped)
+{
+    image_data = data;
+    image_skipped = skipped;
+}
+
+void
+CapacityTesterCli::imageTargetFailed(int target, qint64 start,
+    int error_type)
+{
+    Q_UNUSED(start);
+    if (target < 0 || target >= image_errors.size()) return;
+    image_errors[target] |= error_type;
+}
+
+void
+CapacityTesterCli::showImageProgress()
+{
+    //Progress of slowest target still running (write and verify)
+    int p = 100;
+    for (int i = 0, ii = image_written.size(); i < ii; i++)
+    {
+        if (image_errors.at(i)) continue;
+        qint64 done = image_written.at(i) + image_verified.at(i);
+        int target_p =
+            image_total ? ((double)done / (2 * image_total)) * 100 : 100;
+        p = qMin(p, target_p);
+    }
+
+    //Print progress
+    QString str_p = QString("%1%").arg(p).rightJustified(4);
+    out << QString(4, 8);
+    out << str_p;
+    out << flush;
+
+}
+
+void
+CapacityTesterCli::completedImageWrite(bool success)
+{
+    //Result per target
+    out << endl;
+    out << endl;
+    for (int i = 0, ii = image_paths.size(); i < ii; i++)
+    {
+        int error_type = i < image_errors.size() ? image_errors.at(i) : 0;
+        QString result = tr("OK");
+        if (error_type & VolumeTester::Error::Aborted)
+            result = tr("ABORTED");
+        else if (error_type & VolumeTester::Error::Full)
+            result = tr("FAILED: too small");
+        else if (error_type & VolumeTester::Error::Create)
+            result = tr("FAILED: cannot open");
+        else if (error_type & VolumeTester::Error::Write)
+            result = tr("FAILED: write error");
+        else if (error_type & VolumeTester::Error::Verify)
+            result = tr("FAILED: verification failed");
+        out << result.leftJustified(30) << "\t" << image_paths.at(i) << endl;
+    }
+    out << endl;
+    if (image_skipped)
+    {
+        int skipped_percentage =
+            image_total ? ((double)image_skipped / image_total) * 100 : 0;
+        out << tr("Data:") << "\t\t"
+            << Size(image_data).formatted()
+            << " / "
+            << tr("%1 skipped (%2%)").
+                arg(Size(image_skipped).formatted()).
+                arg(skipped_percentage)
+            << endl;
+        out << endl;
+    }
+    if (success)
+        out << tr("All targets have been written and verified.") << endl;
+    else
+        out << tr("Writing the image failed.") << endl;
+
+    //Time
+    out << endl;
+    qint64 total_seconds = tmr_total_test_time.elapsed() / 1000;
+    qlonglong elapsed_minutes = total_seconds / 60;
+    qlonglong elapsed_seconds = total_seconds % 60;
+    QString str_m_s = QString("%1:%2").
+        arg(elapsed_minutes, 2, 10, QChar('0')).
+        arg(elapsed_seconds, 2, 10, QChar('0'));
+    out << "Time:\t\t" << str_m_s << endl;
+
+    if (success)
+        close(); //success (code 0)
+    else
+        close(9); //error
+}
+
+void
+CapacityTesterCli::startPartitionTest(const QString &path)
+{
+    //Partitions of device
+    PartitionTester tester(path);
+    if (!tester.isValid())
+    {
+        err << "No mounted partitions found for the specified device." << endl;
+        return close(1);
+    }
+
+    //Test files will be written to all partitions
+    out << tr("Device:\t\t%1 (%2)").
+        arg(tester.device()).
+        arg(Size(tester.deviceSize()).formatted())
+        << endl;
+    out << tr("The free space of these partitions will be tested:") << endl;
+    foreach (PartitionTester::Partition partition, tester.partitions())
+    {
+        out << "*\t" << partition.device << "\t" << partition.mountpoint
+            << endl;
+    }
+    out << tr("Continue?") << endl;
+    if (!confirm()) return close(2);
+
+    //Coordinator (runs in this thread, one worker thread per partition)
+    partition_tester = new PartitionTester(path);
+    partition_tester->setParent(this);
+    partition_tester->setSafetyBuffer(safety_buffer);
+    partition_tester->setSinglePass(is_single_pass);
+    if (parallel_count)
+        partition_tester->setParallel(parallel_count);
+    if (!data_provider.isEmpty())
+        partition_tester->setDataProvider(data_provider);
+
+    //Partition started
+    connect(partition_tester,
+            SIGNAL(partitionStarted(int)),
+            this,
+            SLOT(partitionStarted(int)));
+
+    //Written
+    connect(partition_tester,
+            SIGNAL(written(int, qint64, double)),
+            this,
+            SLOT(partitionProgress(int, qint64, double)));
+
+    //Verified
+    connect(partition_tester,
+            SIGNAL(verified(int, qint64, double)),
+            this,
+            SLOT(partitionProgress(int, qint64, double)));
+
+    //Partition done
+    connect(partition_tester,
+            SIGNAL(partitionFinished(int, bool, int)),
+            this,
+            SLOT(partitionFinished(int, bool, int)));
+
+    //Completed handler (successful or not)
+    connect(partition_tester,
+            SIGNAL(finished(bool)),
+            this,
+            SLOT(completedPartitionTest(bool)));
+
+    //Get started
+    out << "Testing partitions... " << endl;
+
+    //Start timer
+    tmr_total_test_time.start();
+
+    //Start first test(s)
+    partition_tester->start();
+
+}
+
+void
+CapacityTesterCli::partitionStarted(int index)
+{
+    QList<PartitionTester::Partition> partitions =
+        partition_tester->partitions();
+    out << endl;
+    out << tr("Started:\t%1 (%2)").
+        arg(partitions.at(index).device).
+        arg(partitions.at(index).mountpoint)
+        << endl;
+    out << "Progress:\t";
+    out << QString(4, 32);
+    out << flush;
+}
+
+void
+CapacityTesterCli::partitionProgress(int index, qint64 bytes,
+    double avg_speed)
+{
+    Q_UNUSED(index);
+    Q_UNUSED(bytes);
+    Q_UNUSED(avg_speed);
+
+    //Progress of all partitions (write and verify)
+    qint64 total = 0;
+    qint64 done = 0;
+    foreach (PartitionTester::Partition partition,
+        partition_tester->partitions())
+    {
+        total += 2 * partition.tested;
+        done += partition.written + partition.verified;
+    }
+    int p = total ? ((double)done / total) * 100 : 0;
+
+    //Print progress
+    QString str_p = QString("%1%").arg(p).rightJustified(4);
+    out << QString(4, 8);
+    out << str_p;
+    out << flush;
+
+}
+
+void
+CapacityTesterCli::partitionFinished(int index, bool success, int error_type)
+{
+    Q_UNUSED(error_type);
+    QList<PartitionTester::Partition> partitions =
+        partition_tester->partitions();
+    out << endl;
+    out << tr("Finished:\t%1 (%2)").
+        arg(partitions.at(index).device).
+        arg(success ? tr("OK") : tr("FAILED"))
+        << endl;
+}
+
+void
+CapacityTesterCli::completedPartitionTest(bool success)
+{
+    QList<PartitionTester::Partition> partitions =
+        partition_tester->partitions();
+    qint64 device_size = partition_tester->deviceSize();
+
+    //Device report, partitions in physical order
+    out << endl;
+    out << tr("Device:\t\t%1 (%2)").
+        arg(partition_tester->device()).
+        arg(Size(device_size).formatted())
+        << endl;
+    out << endl;
+    qint64 position = 0;
+    qint64 tested = 0;
+    foreach (PartitionTester::Partition partition, partitions)
+    {
+        //Space between partitions
+        if (partition.start > position)
+        {
+            out << QString("%1 - %2").
+                arg(position, 14).
+                arg(partition.start - 1, 14)
+                << "\t" << tr("not tested (%1)").
+                    arg(Size(partition.start - position).formatted())
+                << endl;
+        }
+        position = qMax(position, partition.start + partition.size);
+
+        //Result of partition
+        QString result = tr("OK");
+        if (!partition.done || partition.error_type &
+            VolumeTester::Error::Aborted)
+            result = tr("ABORTED");
+        else if (partition.error_type & VolumeTester::Error::Create)
+            result = tr("FAILED: cannot create test files");
+        else if (partition.error_type & VolumeTester::Error::Write)
+            result = tr("FAILED: write error");
+        else if (partition.error_type & VolumeTester::Error::Verify)
+            result = tr("FAILED: verification failed");
+        else if (partition.error_type)
+            result = tr("FAILED");
+        if (partition.error_type && partition.failed_start != -1)
+        {
+            result += tr(" at %1 (test area)").
+                arg(Size(partition.failed_start).formatted());
+        }
+        out << QString("%1 - %2").
+            arg(partition.start, 14).
+            arg(partition.start + partition.size - 1, 14)
+            << "\t" << partition.device
+            << " (" << Size(partition.size).formatted() << ")"
+            << "\t" << partition.mountpoint
+            << endl;
+        out << "\t\t\t\t" << result << endl;
+        out << "\t\t\t\t"
+            << tr("Tested: %1, write: %2 MB/s, verify: %3 MB/s").
+                arg(Size(partition.tested).formatted()).
+                arg(partition.write_speed, 0, 'f', 1).
+                arg(partition.verify_speed, 0, 'f', 1)
+            << endl;
+        tested += partition.tested;
+    }
+    if (device_size > position)
+    {
+        out << QString("%1 - %2").
+            arg(position, 14).
+            arg(device_size - 1, 14)
+            << "\t" << tr("not tested (%1)").
+                arg(Size(device_size - position).formatted())
+            << endl;
+    }
+    out << endl;
+    int tested_percentage =
+        device_size ? ((double)tested / device_size) * 100 : 0;
+    out << tr("Tested:\t\t%1 of %2 (%3%, free space only)").
+        arg(Size(tested).formatted()).
+        arg(Size(device_size).formatted()).
+        arg(tested_percentage)
+        << endl;
+    out << endl;
+    if (success)
+        out << tr("All partitions have been tested successfully.") << endl;
+    else
+        out << tr("The test failed on at least one partition.") << endl;
+
+    //Time
+    out << endl;
+    qint64 total_seconds = tmr_total_test_time.elapsed() / 1000;
+    qlonglong elapsed_minutes = total_seconds / 60;
+    qlonglong elapsed_seconds = total_seconds % 60;
+    QString str_m_s = QString("%1:%2").
+        arg(elapsed_minutes, 2, 10, QChar('0')).
+        arg(elapsed_seconds, 2, 10, QChar('0'));
+    out << "Time:\t\t" << str_m_s << endl;
+
+    if (success)
+        close(); //success (code 0)
+    else
+        close(9); //error
+}
+
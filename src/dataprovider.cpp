@@ -0,0 +1,537 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "dataprovider.hpp"
+
+/*! \class DataProvider
+ *
+ * \brief The DataProvider class is the interface for the test data
+ * that is written to and expected from a volume.
+ *
+ * A DataProvider fills a buffer with the data that belongs at a given
+ * absolute offset of the test area and checks a buffer that has been
+ * read back from that offset, both in place.
+ * The data must only depend on the offset, so any part of the test area
+ * can be generated or checked independently and in any order.
+ * Both functions are const and may be called from several threads.
+ *
+ * Providers are selected by name, optionally followed by an argument:
+ * "random", "zero", "constant:0xAA", "walking-ones", "walking-zeros",
+ * "keystream:1234" or "file:/path/to/content".
+ *
+ */
+
+namespace
+{
+
+//Word generators, one 64-bit word per index (little endian in memory)
+//Kept trivial so the loops below can be vectorized by the compiler
+
+struct RepeatingWord
+{
+    quint64
+    word;
+
+    inline quint64
+    operator()(qint64 index) const
+    {
+        Q_UNUSED(index);
+        return word;
+    }
+};
+
+struct SplitMix64
+{
+    quint64
+    seed;
+
+    inline quint64
+    operator()(qint64 index) const
+    {
+        quint64 z = seed + ((quint64)index + 1) * 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
+template<typename Generator>
+inline uchar
+byteAt(const Generator &generator, qint64 pos)
+{
+    return (uchar)(generator(pos / 8) >> ((pos % 8) * 8));
+}
+
+template<typename Generator>
+void
+fillWords(const Generator &generator, char *data, int size, qint64 offset)
+{
+    int i = 0;
+
+    //Head, up to the next word boundary
+    for (; i < size && (offset + i) % 8; i++)
+        data[i] = byteAt(generator, offset + i);
+
+    //Whole words
+    qint64 index = (offset + i) / 8;
+    int words = (size - i) / 8;
+    char *p = data + i;
+    for (int w = 0; w < words; w++)
+    {
+        quint64 word = qToLittleEndian(generator(index + w));
+        memcpy(p + w * 8, &word, 8); //unaligned store
+    }
+    i += words * 8;
+
+    //Tail
+    for (; i < size; i++)
+        data[i] = byteAt(generator, offset + i);
+
+}
+
+template<typename Generator>
+int
+verifyWords(const Generator &generator, const char *data, int size,
+    qint64 offset)
+{
+    int i = 0;
+
+    //Head, up to the next word boundary
+    for (; i < size && (offset + i) % 8; i++)
+    {
+        if ((uchar)data[i] != byteAt(generator, offset + i))
+            return i;
+    }
+
+    //Whole words, checked in chunks
+    //Differences are accumulated per chunk to keep the inner loop branchless
+    const int chunk_words = 64;
+    qint64 index = (offset + i) / 8;
+    int words = (size - i) / 8;
+    const char *p = data + i;
+    for (int c = 0; c < words; c += chunk_words)
+    {
+        int end = qMin(c + chunk_words, words);
+        quint64 diff = 0;
+        for (int w = c; w < end; w++)
+        {
+            quint64 word;
+            memcpy(&word, p + w * 8, 8); //unaligned load
+            diff |= qFromLittleEndian(word) ^ generator(index + w);
+        }
+        if (!diff) continue;
+
+        //Mismatch somewhere in this chunk, find first byte
+        for (int j = i + c * 8, jj = i + end * 8; j < jj; j++)
+        {
+            if ((uchar)data[j] != byteAt(generator, offset + j))
+                return j;
+        }
+    }
+    i += words * 8;
+
+    //Tail
+    for (; i < size; i++)
+    {
+        if ((uchar)data[i] != byteAt(generator, offset + i))
+            return i;
+    }
+
+    return -1;
+}
+
+}
+
+/*!
+ * Returns the names of all built-in providers.
+ */
+QStringList
+DataProvider::names()
+{
+    return QStringList()
+        << "random"
+        << "zero"
+        << "constant"
+        << "walking-ones"
+        << "walking-zeros"
+        << "keystream"
+        << "file";
+}
+
+/*!
+ * Creates a provider according to the specified string,
+ * which consists of a name and an optional argument,
+ * separated by a colon, e.g., "constant:0x55".
+ *
+ * Returns 0 if the name is unknown or the argument is invalid.
+ * The caller takes ownership of the returned object.
+ */
+DataProvider*
+DataProvider::create(const QString &spec)
+{
+    QString name = spec.section(':', 0, 0).trimmed().toLower();
+    QString arg = spec.section(':', 1);
+    bool has_arg = spec.contains(':');
+    bool ok = true;
+
+    DataProvider *provider = 0;
+    if (name.isEmpty() || name == "random")
+    {
+        //Optional seed and pattern size (bytes), e.g., "random:42:16777216"
+        quint64 seed = 0;
+        int size = 16 * 1024 * 1024;
+        if (has_arg)
+        {
+            seed = arg.section(':', 0, 0).toULongLong(&ok, 0);
+            if (!ok || !seed) return 0;
+            if (arg.contains(':'))
+                size = arg.section(':', 1).toInt(&ok, 0);
+            if (!ok || size <= 0) return 0;
+        }
+        provider = new RandomDataProvider(size, seed);
+    }
+    else if (name == "zero")
+    {
+        if (has_arg) return 0;
+        provider = new ConstantDataProvider(name, 0);
+    }
+    else if (name == "constant")
+    {
+        //Byte value, decimal or hex (0x prefix)
+        uint byte = arg.toUInt(&ok, 0);
+        if (!ok || byte > 255) return 0;
+        provider = new ConstantDataProvider(
+            name, (quint64)byte * 0x0101010101010101ULL);
+    }
+    else if (name == "walking-ones")
+    {
+        //01 02 04 08 10 20 40 80
+        if (has_arg) return 0;
+        provider = new ConstantDataProvider(name, 0x8040201008040201ULL);
+    }
+    else if (name == "walking-zeros")
+    {
+        //FE FD FB F7 EF DF BF 7F
+        if (has_arg) return 0;
+        provider = new ConstantDataProvider(name, ~0x8040201008040201ULL);
+    }
+    else if (name == "keystream")
+    {
+        //Seed must be given, otherwise the stream can't be reproduced
+        quint64 seed = arg.toULongLong(&ok, 0);
+        if (!ok) return 0;
+        provider = new KeystreamDataProvider(seed);
+    }
+    else if (name == "file")
+    {
+        if (arg.isEmpty()) return 0;
+        FileDataProvider *file_provider = new FileDataProvider(arg);
+        if (!file_provider->isValid())
+        {
+            delete file_provider;
+            return 0;
+        }
+        provider = file_provider;
+    }
+
+    if (provider)
+        provider->_spec = spec;
+
+    return provider;
+}
+
+DataProvider::DataProvider()
+{
+}
+
+DataProvider::~DataProvider()
+{
+}
+
+/*!
+ * Returns the string this provider has been created from.
+ */
+QString
+DataProvider::spec()
+const
+{
+    return _spec.isEmpty() ? name() : _spec;
+}
+
+/*!
+ * Returns a string create() accepts to generate the same data again,
+ * e.g., to analyze a capture offline.
+ * Same as spec() unless the data depends on a generated seed.
+ */
+QString
+DataProvider::reproducibleSpec()
+const
+{
+    return spec();
+}
+
+/*!
+ * \fn void DataProvider::fill(char *data, int size, qint64 offset) const
+ *
+ * Fills size bytes at data with the test data that belongs
+ * at the specified offset.
+ */
+
+/*!
+ * \fn int DataProvider::verify(const char *data, int size, qint64 offset)
+ *
+ * Checks size bytes at data against the test data that belongs
+ * at the specified offset.
+ * Returns the index of the first mismatching byte or -1 if all match.
+ */
+
+/*! \class BufferDataProvider
+ *
+ * \brief Base class for providers that repeat a fixed buffer.
+ *
+ * The byte at offset x is buffer[x % buffer size].
+ */
+
+BufferDataProvider::BufferDataProvider()
+                  : buffer(0),
+                    buffer_size(0)
+{
+}
+
+void
+BufferDataProvider::setBuffer(const char *data, qint64 size)
+{
+    buffer = data;
+    buffer_size = size;
+}
+
+void
+BufferDataProvider::fill(char *data, int size, qint64 offset)
+const
+{
+    assert(buffer && buffer_size > 0);
+
+    //Copy buffer, wrapping around at its end
+    qint64 pos = offset % buffer_size;
+    for (int i = 0; i < size;)
+    {
+        int n = qMin((qint64)(size - i), buffer_size - pos);
+        memcpy(data + i, buffer + pos, n);
+        i += n;
+        pos = 0;
+    }
+
+}
+
+int
+BufferDataProvider::verify(const char *data, int size, qint64 offset)
+const
+{
+    assert(buffer && buffer_size > 0);
+
+    //Compare with buffer, wrapping around at its end
+    qint64 pos = offset % buffer_size;
+    for (int i = 0; i < size;)
+    {
+        int n = qMin((qint64)(size - i), buffer_size - pos);
+        if (memcmp(data + i, buffer + pos, n) != 0)
+        {
+            //Mismatch, find first byte
+            for (int j = 0; j < n; j++)
+            {
+                if (data[i + j] != buffer[pos + j])
+                    return i + j;
+            }
+        }
+        i += n;
+        pos = 0;
+    }
+
+    return -1;
+}
+
+/*! \class RandomDataProvider
+ *
+ * \brief Repeats a random pattern which is generated once.
+ *
+ * This is the default pattern. It contains no 0 or 255 bytes,
+ * which is what a dead or missing chip usually returns.
+ * Without a seed, a new one is taken from the current time.
+ */
+
+RandomDataProvider::RandomDataProvider(int size, quint64 seed)
+                  : _seed(seed ? seed : (quint64)time(0)),
+                    pattern(size, (char)0)
+{
+    assert(size > 0);
+
+    //Random bytes except 0 and 255 (0 < byte < 255)
+    SplitMix64 generator;
+    generator.seed = _seed;
+    fillWords(generator, pattern.data(), size, 0);
+    uchar *p = (uchar*)pattern.data();
+    for (int i = 0; i < size; i++)
+        p[i] = p[i] % 254 + 1;
+
+    setBuffer(pattern.constData(), pattern.size());
+}
+
+QString
+RandomDataProvider::name()
+const
+{
+    return "random";
+}
+
+QString
+RandomDataProvider::reproducibleSpec()
+const
+{
+    return QString("random:%1:%2").arg(_seed).arg(pattern.size());
+}
+
+quint64
+RandomDataProvider::seed()
+const
+{
+    return _seed;
+}
+
+/*! \class FileDataProvider
+ *
+ * \brief Repeats the contents of a user-supplied file.
+ *
+ * The file is mapped into memory rather than read.
+ */
+
+FileDataProvider::FileDataProvider(const QString &path)
+                : file(path),
+                  map(0)
+{
+    if (file.open(QIODevice::ReadOnly) && file.size() > 0)
+    {
+        map = file.map(0, file.size());
+        if (map) setBuffer((const char*)map, file.size());
+    }
+}
+
+FileDataProvider::~FileDataProvider()
+{
+    if (map) file.unmap(map);
+}
+
+QString
+FileDataProvider::name()
+const
+{
+    return "file";
+}
+
+bool
+FileDataProvider::isValid()
+const
+{
+    return map != 0;
+}
+
+/*! \class ConstantDataProvider
+ *
+ * \brief Repeats a single 64-bit word, like a constant byte
+ * or a walking bit sequence.
+ */
+
+ConstantDataProvider::ConstantDataProvider(const QString &name, quint64 word)
+                    : _name(name),
+                      _word(word)
+{
+}
+
+QString
+ConstantDataProvider::name()
+const
+{
+    return _name;
+}
+
+void
+ConstantDataProvider::fill(char *data, int size, qint64 offset)
+const
+{
+    RepeatingWord generator;
+    generator.word = _word;
+    fillWords(generator, data, size, offset);
+}
+
+int
+ConstantDataProvider::verify(const char *data, int size, qint64 offset)
+const
+{
+    RepeatingWord generator;
+    generator.word = _word;
+    return verifyWords(generator, data, size, offset);
+}
+
+/*! \class KeystreamDataProvider
+ *
+ * \brief Generates a keystream from a fixed seed.
+ *
+ * The stream is counter-based, so any offset can be generated directly.
+ * It can be reproduced by other tools: the 64-bit word at offset 8 * i,
+ * stored in little-endian byte order, is the SplitMix64 output
+ * for the state seed + (i + 1) * 0x9E3779B97F4A7C15.
+ */
+
+KeystreamDataProvider::KeystreamDataProvider(quint64 seed)
+                     : _seed(seed)
+{
+}
+
+QString
+KeystreamDataProvider::name()
+const
+{
+    return "keystream";
+}
+
+quint64
+KeystreamDataProvider::seed()
+const
+{
+    return _seed;
+}
+
+void
+KeystreamDataProvider::fill(char *data, int size, qint64 offset)
+const
+{
+    SplitMix64 generator;
+    generator.seed = _seed;
+    fillWords(generator, data, size, offset);
+}
+
+int
+KeystreamDataProvider::verify(const char *data, int size, qint64 offset)
+const
+{
+    SplitMix64 generator;
+    generator.seed = _seed;
+    return verifyWords(generator, data, size, offset);
+}
+
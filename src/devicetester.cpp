@@ -0,0 +1,1434 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "devicetester.hpp"
+
+/*! \class DeviceTester
+ *
+ * \brief The DeviceTester class tests a raw device (destructive).
+ *
+ * The whole device is written with test data and read back,
+ * there is no filesystem involved. The device must not be mounted.
+ *
+ * Two backends are available. The block layer backend uses direct I/O
+ * on the block device. The SCSI backend sends READ and WRITE commands
+ * of exactly the configured transfer length through SG_IO,
+ * the capacity is the one reported by READ CAPACITY
+ * and the device cache is flushed with SYNCHRONIZE CACHE.
+ *
+ * The absolute offset is stamped into the test data every 4 KB,
+ * so a device that maps several addresses to the same memory cell
+ * is detected even if the pattern repeats.
+ *
+ * Zoned devices (host-managed SMR drives, ZNS SSDs) only accept writes
+ * at the write pointer of a zone. In zoned mode, the zones are reset
+ * and written sequentially by several threads, each one filling
+ * one zone at a time, so several zones are open at the same time.
+ * The kernel's null_blk module can emulate such a device
+ * (zoned=1, see README).
+ *
+ * In pattern mode, a sequence of patterns is written and verified
+ * like badblocks -w does, but with large direct transfers,
+ * several of them in flight at the same time.
+ * Errors don't stop the test, the failing blocks are collected
+ * in a bad block list instead. The patterns are written as they are,
+ * without offset stamps, like badblocks does. Pattern mode can't be
+ * combined with zoned mode.
+ *
+ */
+
+/*! \class DeviceTester::ZoneStream
+ *
+ * \brief One of several threads writing or verifying the zones
+ * of a zoned device in parallel, see runZones().
+ */
+class DeviceTester::ZoneStream : public QThread
+{
+public:
+
+    ZoneStream(DeviceTester *tester, bool verify)
+             : tester(tester),
+               verify(verify),
+               ok(false)
+    {
+    }
+
+    bool
+    succeeded() const
+    {
+        return ok;
+    }
+
+protected:
+
+    void
+    run()
+    {
+        ok = tester->zoneStream(verify);
+    }
+
+private:
+
+    DeviceTester
+    *tester;
+
+    bool
+    verify;
+
+    bool
+    ok;
+
+};
+
+/*!
+ * Returns true if the path is a block or character (SCSI generic) device.
+ */
+bool
+DeviceTester::isDevice(const QString &path)
+{
+    #if defined(_WIN32)
+    Q_UNUSED(path);
+    return false;
+    #else
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) == -1) return false;
+    return S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode);
+    #endif
+}
+
+/*!
+ * Returns the block device for the specified device.
+ * SCSI generic devices (/dev/sg1) are resolved to the disk (/dev/sdb).
+ */
+QString
+DeviceTester::blockDevice(const QString &path)
+{
+    QString canonical = QFileInfo(path).canonicalFilePath();
+    if (canonical.isEmpty()) return path;
+
+    QString name = QFileInfo(canonical).fileName();
+    if (name.startsWith("sg"))
+    {
+        QDir dir("/sys/class/scsi_generic/" + name + "/device/block");
+        QStringList disks = dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        if (!disks.isEmpty()) return "/dev/" + disks.first();
+    }
+
+    return canonical;
+}
+
+/*!
+ * Returns the patterns of badblocks -w (0xAA, 0x55, 0xFF, 0x00)
+ * followed by a random pattern, see setPatternSequence().
+ */
+QStringList
+DeviceTester::badblocksPatterns()
+{
+    return QStringList()
+        << "constant:0xAA"
+        << "constant:0x55"
+        << "constant:0xFF"
+        << "constant:0x00"
+        << "random";
+}
+
+/*!
+ * Returns the zone model of a block device according to sysfs:
+ * "none", "host-aware" or "host-managed" (Linux).
+ * A host-managed device rejects writes that are not sequential.
+ * Returns an empty string if it's unknown.
+ */
+QString
+DeviceTester::zoneModel(const QString &path)
+{
+    QString name = QFileInfo(blockDevice(path)).fileName();
+    QFile file("/sys/block/" + name + "/queue/zoned");
+    if (!file.open(QIODevice::ReadOnly)) return QString();
+    return QString::fromLatin1(file.readAll().trimmed());
+}
+
+DeviceTester::DeviceTester(const QString &device)
+            : _device(device),
+              _backend(BlockLayer),
+              transfer_length(0),
+              verify_sampling(100),
+              discard_device(false),
+              fd(-1),
+              lock_fd(-1),
+              block_size(0),
+              bytes_total(0),
+              buffer(0),
+              _canceled(false),
+              error_type(VolumeTester::Error::Unknown),
+              phase_bytes(0),
+              perf_enabled(false),
+              zoned_mode(false),
+              open_zones(4),
+              zone_stream_count(1),
+              zone_failed_start(0),
+              zone_failed_size(0),
+              bad_block_size(4096),
+              queue_depth(4),
+              bad_block_errors(0)
+{
+}
+
+DeviceTester::~DeviceTester()
+{
+    close();
+}
+
+/*!
+ * Selects the I/O backend, the SCSI backend requires SG_IO support.
+ */
+bool
+DeviceTester::setBackend(Backend backend)
+{
+    if (backend == Scsi && !ScsiDevice::isSupported()) return false;
+    _backend = backend;
+    return true;
+}
+
+DeviceTester::Backend
+DeviceTester::backend()
+const
+{
+    return _backend;
+}
+
+/*!
+ * Changes the size of a single read or write request.
+ * It's rounded down to a multiple of the block size of the device.
+ * The default is 1 MB for the block layer and 64 KB for SCSI commands
+ * (the kernel rejects SCSI commands larger than max_sectors_kb).
+ */
+bool
+DeviceTester::setTransferLength(int bytes)
+{
+    if (bytes < 512) return false;
+    transfer_length = bytes;
+    return true;
+}
+
+int
+DeviceTester::transferLength()
+const
+{
+    if (transfer_length) return transfer_length;
+    return _backend == Scsi ? 64 * 1024 : MB;
+}
+
+bool
+DeviceTester::setDataProvider(const QString &spec)
+{
+    DataProvider *provider = DataProvider::create(spec);
+    if (!provider) return false;
+    data_provider.reset(provider);
+    return true;
+}
+
+/*!
+ * Verifies only the specified percentage of the transfers
+ * (see VolumeTester::isSampled()), 0 skips the verification.
+ * The default is 100 (full verification).
+ */
+bool
+DeviceTester::setVerifySampling(int percent)
+{
+    if (percent < 0 || percent > 100) return false;
+    verify_sampling = percent;
+    return true;
+}
+
+/*!
+ * Discards the whole device (BLKDISCARD) after a successful test,
+ * so a flash drive can erase it. See discarded().
+ */
+void
+DeviceTester::setDiscard(bool enabled)
+{
+    discard_device = enabled;
+}
+
+/*!
+ * Counts CPU cycles, instructions, cache misses and branch misses
+ * per phase (see PerfCounters), reported by phaseStatistics()
+ * as "counters". Disabled by default.
+ */
+void
+DeviceTester::setPerfCounters(bool enabled)
+{
+    perf_enabled = enabled;
+}
+
+/*!
+ * Tests a zoned device zone by zone (block layer backend, Linux).
+ * The zones are reset (BLKRESETZONE) and written sequentially
+ * up to their capacity, offline and read-only zones are skipped.
+ * After the verification, the zones are reset again.
+ * The throughput of every zone is reported by zoneTested().
+ * Disabled by default, see zoneModel().
+ */
+void
+DeviceTester::setZoned(bool enabled)
+{
+    zoned_mode = enabled;
+}
+
+/*!
+ * Changes the number of zones written or verified at the same time
+ * in zoned mode, limited by the maximum number of open zones
+ * of the device. The default is 4.
+ */
+bool
+DeviceTester::setOpenZones(int count)
+{
+    if (count < 1) return false;
+    open_zones = count;
+    return true;
+}
+
+/*!
+ * Enables the pattern mode: each pattern (see DataProvider::create())
+ * is written to the whole device and verified before the next one.
+ * The device is split into segments of 64 transfers,
+ * which are handled by several streams (see setQueueDepth()).
+ * A failed transfer doesn't stop the test, every block of it is
+ * written, or read and verified, on its own and the ones that fail
+ * are reported by badBlock(). The test fails if there are bad blocks.
+ * The offset is not stamped into the data (see fillBuffer()),
+ * so the constant patterns are written solid, like badblocks does.
+ * Not supported in zoned mode, start() fails.
+ * An empty list disables the pattern mode (default).
+ * Returns false if a pattern is not valid.
+ */
+bool
+DeviceTester::setPatternSequence(const QStringList &patterns)
+{
+    foreach (QString spec, patterns)
+    {
+        DataProvider *provider = DataProvider::create(spec);
+        if (!provider) return false;
+        delete provider;
+    }
+    pattern_sequence = patterns;
+    return true;
+}
+
+/*!
+ * Changes the size of the blocks in the bad block list (pattern mode),
+ * which must match the block size of the filesystem (mke2fs -b)
+ * and be a multiple of the logical block size of the device.
+ * The default is 4096 bytes.
+ */
+bool
+DeviceTester::setBadBlockSize(int bytes)
+{
+    if (bytes < 512 || (bytes & (bytes - 1))) return false;
+    bad_block_size = bytes;
+    return true;
+}
+
+int
+DeviceTester::badBlockSize()
+const
+{
+    return bad_block_size;
+}
+
+/*!
+ * Changes the number of transfers in flight in pattern mode
+ * (parallel streams). The default is 4.
+ */
+bool
+DeviceTester::setQueueDepth(int count)
+{
+    if (count < 1) return false;
+    queue_depth = count;
+    return true;
+}
+
+bool
+DeviceTester::isValid()
+const
+{
+    return isDevice(_device);
+}
+
+QString
+DeviceTester::device()
+const
+{
+    return _device;
+}
+
+/*!
+ * Returns the size of the device as reported by the block layer.
+ */
+qint64
+DeviceTester::bytesTotal()
+const
+{
+    qint64 size = 0;
+    #if !defined(_WIN32)
+    QString path = blockDevice(_device);
+    int dev_fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+    if (dev_fd == -1) return 0;
+    #if defined(__linux__) && defined(BLKGETSIZE64)
+    quint64 bytes = 0;
+    if (ioctl(dev_fd, BLKGETSIZE64, &bytes) == 0)
+        size = bytes;
+    else
+    #endif
+    size = lseek(dev_fd, 0, SEEK_END);
+    ::close(dev_fd);
+    #endif
+    return size < 0 ? 0 : size;
+}
+
+/*!
+ * Returns the capacity the device claims to have (READ CAPACITY)
+ * or -1 if it cannot be queried, e.g., because SG_IO is not supported.
+ * The vendor and product name are returned as well (INQUIRY).
+ */
+qint64
+DeviceTester::claimedCapacity(int *sector_size, QString *name)
+const
+{
+    ScsiDevice dev(_device);
+    if (!dev.open()) return -1;
+
+    qint64 blocks = 0;
+    int length = 0;
+    if (!dev.readCapacity(&blocks, &length)) return -1;
+    if (sector_size) *sector_size = length;
+
+    if (name)
+    {
+        QString vendor, product, revision;
+        if (dev.inquiry(&vendor, &product, &revision))
+            *name = QString("%1 %2 %3").
+                arg(vendor).arg(product).arg(revision).simplified();
+    }
+
+    return blocks * length;
+}
+
+/*!
+ * Returns the mounted filesystems located on the device.
+ */
+QList<QStorageInfo>
+DeviceTester::filesystems()
+const
+{
+    QList<QStorageInfo> list;
+    QString path = blockDevice(_device);
+    foreach (QStorageInfo storage, QStorageInfo::mountedVolumes())
+    {
+        QString storage_device = QString::fromLocal8Bit(storage.device());
+        if (storage_device.startsWith(path))
+            list << storage;
+    }
+    return list;
+}
+
+/*!
+ * Returns a description of the last I/O error.
+ */
+QString
+DeviceTester::errorString()
+const
+{
+    return error;
+}
+
+void
+DeviceTester::start()
+{
+    //Refuse to overwrite mounted filesystems
+    if (!isValid() || !filesystems().isEmpty())
+    {
+        error = tr("device not valid or mounted");
+        emit failed(VolumeTester::Error::Permissions);
+        emit finished(false, VolumeTester::Error::Permissions);
+        return;
+    }
+
+    //Test data
+    if (!data_provider)
+        data_provider.reset(new RandomDataProvider(16 * MB));
+
+    //Open device, get size
+    if (!open())
+    {
+        error_type |= VolumeTester::Error::Create;
+        emit failed(error_type);
+        emit finished(false, error_type);
+        return;
+    }
+
+    //Zones of a zoned device, bytes_total is their capacity
+    if (zoned_mode && !reportZones())
+    {
+        close();
+        error_type |= VolumeTester::Error::Create;
+        emit failed(error_type);
+        emit finished(false, error_type);
+        return;
+    }
+
+    //Pattern mode, transfers made of whole bad blocks
+    if (!pattern_sequence.isEmpty())
+    {
+        bool valid = false;
+        if (_backend != BlockLayer)
+            error = tr("pattern mode requires the block layer");
+        else if (zoned_mode)
+            //Failed write moves the write pointer, later blocks rejected
+            error = tr("pattern mode not supported in zoned mode");
+        else if (bad_block_size % block_size)
+            error = tr("bad block size not a multiple of %1 B").
+                arg(block_size);
+        else
+            valid = true;
+        transfer_length =
+            qMax(transfer_length / bad_block_size, 1) * bad_block_size;
+        if (!valid)
+        {
+            close();
+            error_type |= VolumeTester::Error::Create;
+            emit failed(error_type);
+            emit finished(false, error_type);
+            return;
+        }
+    }
+
+    //Progress for local monitors (shared memory)
+    live_stats.open(_device, bytes_total);
+
+    //CPU counters for this thread (and streams started by it)
+    if (perf_enabled) perf_counters.open();
+
+    //Test phases:
+    //1 Full write (whole device, one transfer at a time)
+    //2 Cache flush (fsync or SYNCHRONIZE CACHE)
+    //3 Full read (or a sample, or none)
+    //4 Discard (optional)
+    //Zoned: zones written in parallel, reset after the verification
+    //Patterns: 1 and 3 for every pattern, collecting bad blocks
+    bool (DeviceTester::*write_phase)() = zoned_mode ?
+        &DeviceTester::writeZones : &DeviceTester::writeFull;
+    bool (DeviceTester::*verify_phase)() = zoned_mode ?
+        &DeviceTester::verifyZones : &DeviceTester::verifyFull;
+    bool success;
+    if (!pattern_sequence.isEmpty())
+        success = runPatterns();
+    else
+        success =
+            runPhase(VolumeTester::Phase::Write, write_phase) &&
+            (!verify_sampling ||
+                runPhase(VolumeTester::Phase::Verify, verify_phase));
+    if (zoned_mode)
+    {
+        //Zones left full otherwise
+        if (success && !resetZones())
+        {
+            error = tr("resetting the zones failed: %1").arg(error);
+            error_type |= VolumeTester::Error::Write;
+            emit writeFailed(0, 0);
+            success = false;
+        }
+
+        //Throughput per zone (time spent in its transfers)
+        for (int i = 0; i < zones.size(); i++)
+        {
+            const Zone &zone = zones.at(i);
+            if (!zone.write_bytes) continue;
+            double write_speed = zone.write_time ?
+                ((double)zone.write_bytes / MB) /
+                ((double)zone.write_time / 1000000000) : 0;
+            double read_speed = zone.read_time ?
+                ((double)zone.read_bytes / MB) /
+                ((double)zone.read_time / 1000000000) : 0;
+            emit zoneTested(i, zone.start, zone.capacity,
+                write_speed, read_speed);
+        }
+    }
+    close();
+    if (success && discard_device) discard();
+    live_stats.finish(success, error_type);
+
+    if (success)
+    {
+        emit succeeded();
+    }
+    else
+    {
+        emit failed(error_type);
+    }
+    emit finished(success, error_type);
+
+}
+
+/*!
+ * Requests the currently running test to be aborted gracefully.
+ */
+void
+DeviceTester::cancel()
+{
+    error_type |= VolumeTester::Error::Aborted;
+    _canceled = true;
+}
+
+bool
+DeviceTester::open()
+{
+    close();
+
+    #if defined(_WIN32)
+    error = tr("raw device tests not supported");
+    return false;
+    #else
+    if (_backend == Scsi)
+    {
+        //Hold the block device exclusively while SG_IO bypasses it,
+        //fails if mounted or claimed by dm, md, swap etc.
+        int flags = O_RDONLY;
+        #if defined(__linux__)
+        flags |= O_EXCL;
+        #endif
+        QString path = blockDevice(_device);
+        lock_fd = ::open(QFile::encodeName(path).constData(), flags);
+        if (lock_fd == -1)
+        {
+            error = QString::fromLocal8Bit(strerror(errno));
+            return false;
+        }
+
+        //Capacity reported by device, independent of block layer
+        scsi.setPath(_device);
+        qint64 blocks = 0;
+        if (!scsi.open(true) || !scsi.readCapacity(&blocks, &block_size))
+        {
+            error = scsi.errorString();
+            close();
+            return false;
+        }
+        bytes_total = blocks * block_size;
+    }
+    else
+    {
+        //Direct I/O, exclusive (fails if in use)
+        int flags = O_RDWR;
+        #if defined(__linux__)
+        flags |= O_EXCL;
+        #endif
+        #if defined(O_DIRECT)
+        flags |= O_DIRECT;
+        #endif
+        QString path = blockDevice(_device);
+        fd = ::open(QFile::encodeName(path).constData(), flags);
+        if (fd == -1)
+        {
+            error = QString::fromLocal8Bit(strerror(errno));
+            return false;
+        }
+        bytes_total = bytesTotal();
+        block_size = 512;
+        #if defined(__linux__) && defined(BLKSSZGET)
+        int logical_block_size = 0;
+        if (ioctl(fd, BLKSSZGET, &logical_block_size) == 0 &&
+            logical_block_size > 0)
+            block_size = logical_block_size;
+        #endif
+    }
+
+    if (bytes_total <= 0)
+    {
+        error = tr("invalid device size");
+        close();
+        return false;
+    }
+
+    //Transfer buffer, aligned for direct I/O
+    int length = qMax(block_size, transferLength() / block_size * block_size);
+    transfer_length = length;
+    buffer = (char*)qMallocAligned(length, 4096);
+    if (!buffer)
+    {
+        close();
+        return false;
+    }
+
+    return true;
+    #endif
+}
+
+void
+DeviceTester::close()
+{
+    if (fd != -1) ::close(fd);
+    fd = -1;
+    scsi.close();
+    if (lock_fd != -1) ::close(lock_fd);
+    lock_fd = -1;
+    if (buffer) qFreeAligned(buffer);
+    buffer = 0;
+}
+
+bool
+DeviceTester::writeAt(qint64 offset, const char *data, int size)
+{
+    if (_backend == Scsi)
+    {
+        if (scsi.write(offset / block_size, size / block_size, data))
+            return true;
+        error = scsi.errorString();
+        return false;
+    }
+
+    #if !defined(_WIN32)
+    if (pwrite(fd, data, size, offset) == size) return true;
+    error = QString::fromLocal8Bit(strerror(errno));
+    #endif
+    return false;
+}
+
+bool
+DeviceTester::readAt(qint64 offset, char *data, int size)
+{
+    if (_backend == Scsi)
+    {
+        if (scsi.read(offset / block_size, size / block_size, data))
+            return true;
+        error = scsi.errorString();
+        return false;
+    }
+
+    #if !defined(_WIN32)
+    if (pread(fd, data, size, offset) == size) return true;
+    error = QString::fromLocal8Bit(strerror(errno));
+    #endif
+    return false;
+}
+
+bool
+DeviceTester::flush()
+{
+    if (_backend == Scsi)
+    {
+        //Not supported by all USB bridges, the data is verified anyway
+        scsi.synchronizeCache();
+        return true;
+    }
+
+    #if !defined(_WIN32)
+    if (fsync(fd) == 0) return true;
+    error = QString::fromLocal8Bit(strerror(errno));
+    #endif
+    return false;
+}
+
+/*!
+ * Fills the buffer with the test data and stamps the absolute offset
+ * into it every 4 KB, except in pattern mode (solid patterns).
+ */
+void
+DeviceTester::fillBuffer(char *data, int size, qint64 offset) const
+{
+    data_provider->fill(data, size, offset);
+    if (!pattern_sequence.isEmpty()) return;
+
+    //Stamp absolute offset
+    qint64 end = offset + size;
+    qint64 pos = (offset + STAMP_INTERVAL - 1) / STAMP_INTERVAL *
+        STAMP_INTERVAL;
+    for (; pos + 8 <= end; pos += STAMP_INTERVAL)
+        qToLittleEndian<quint64>(pos, (uchar*)data + (pos - offset));
+}
+
+int
+DeviceTester::verifyBuffer(char *data, int size, qint64 offset) const
+{
+    if (!pattern_sequence.isEmpty())
+        return data_provider->verify(data, size, offset);
+
+    //Check stamps, then restore pattern bytes for comparison
+    qint64 end = offset + size;
+    qint64 pos = (offset + STAMP_INTERVAL - 1) / STAMP_INTERVAL *
+        STAMP_INTERVAL;
+    for (; pos + 8 <= end; pos += STAMP_INTERVAL)
+    {
+        char *stamp = data + (pos - offset);
+        if (qFromLittleEndian<quint64>((const uchar*)stamp) != (quint64)pos)
+            return pos - offset;
+        data_provider->fill(stamp, 8, pos);
+    }
+
+    return data_provider->verify(data, size, offset);
+}
+
+bool
+DeviceTester::writeFull()
+{
+    {
+        AllocationCounter::Suspend suspend;
+        emit started(bytes_total);
+        emit writeStarted();
+    }
+
+    QElapsedTimer timer_writing;
+    double written_mb = 0;
+    double written_sec = 0;
+    qint64 next_progress = 0;
+    for (qint64 pos = 0; pos < bytes_total; pos += transfer_length)
+    {
+        int size = qMin((qint64)transfer_length, bytes_total - pos);
+        fillBuffer(buffer, size, pos);
+
+        timer_writing.start();
+        if (!writeAt(pos, buffer, size))
+        {
+            error_type |= VolumeTester::Error::Write;
+            emit writeFailed(pos, size);
+            return false;
+        }
+        qint64 latency = timer_writing.nsecsElapsed();
+        written_sec += (double)latency / 1000000000;
+        phase_latency.add(latency);
+        phase_bytes += size;
+        live_stats.addBytes(size);
+        written_mb += (double)size / MB;
+
+        //Progress every 16 MB
+        if (pos + size >= next_progress || pos + size == bytes_total)
+        {
+            double avg_speed = written_sec ? written_mb / written_sec : 0;
+            AllocationCounter::Suspend suspend; //not part of I/O path
+            emit written(pos + size, avg_speed);
+            next_progress = pos + size + 16 * MB;
+        }
+
+        //Cancel gracefully
+        if (abortRequested()) return false;
+    }
+
+    //Flush device cache
+    if (!flush())
+    {
+        error_type |= VolumeTester::Error::Write;
+        emit writeFailed(0, 0);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+DeviceTester::verifyFull()
+{
+    {
+        AllocationCounter::Suspend suspend;
+        emit verifyStarted();
+    }
+
+    QElapsedTimer timer_verifying;
+    double verified_mb = 0;
+    double verified_sec = 0;
+    qint64 next_progress = 0;
+    for (qint64 pos = 0; pos < bytes_total; pos += transfer_length)
+    {
+        int size = qMin((qint64)transfer_length, bytes_total - pos);
+
+        //Sample only (wipe)
+        if (!VolumeTester::isSampled(pos / transfer_length, verify_sampling))
+            continue;
+
+        timer_verifying.start();
+        if (!readAt(pos, buffer, size))
+        {
+            error_type |= VolumeTester::Error::Verify;
+            emit verifyFailed(pos, size);
+            return false;
+        }
+        qint64 latency = timer_verifying.nsecsElapsed();
+        verified_sec += (double)latency / 1000000000;
+        phase_latency.add(latency);
+        phase_bytes += size;
+        live_stats.addBytes(size);
+        verified_mb += (double)size / MB;
+
+        int index = verifyBuffer(buffer, size, pos);
+        if (index != -1)
+        {
+            error = tr("data mismatch at offset %1").arg(pos + index);
+            error_type |= VolumeTester::Error::Verify;
+            emit verifyFailed(pos, size);
+            return false;
+        }
+
+        //Progress every 16 MB
+        if (pos + size >= next_progress || pos + size == bytes_total)
+        {
+            double avg_speed = verified_sec ? verified_mb / verified_sec : 0;
+            AllocationCounter::Suspend suspend; //not part of I/O path
+            emit verified(pos + size, avg_speed);
+            next_progress = pos + size + 16 * MB;
+        }
+
+        //Cancel gracefully
+        if (abortRequested()) return false;
+    }
+
+    return true;
+}
+
+bool
+DeviceTester::abortRequested()
+const
+{
+    return _canceled;
+}
+
+/*!
+ * Runs a test phase and reports the number of heap allocations made,
+ * excluding progress signals (see VolumeTester::runPhase()).
+ * The transfer buffer is allocated before, so it should be zero,
+ * except for the threads started in zoned mode.
+ * Then reports the throughput and the transfer latencies.
+ */
+bool
+DeviceTester::runPhase(int phase, bool (DeviceTester::*function)())
+{
+    phase_latency.clear();
+    phase_bytes = 0;
+    live_stats.setPhase(phase);
+    AllocationCounter::Counts before = AllocationCounter::current();
+    perf_counters.start();
+    QElapsedTimer timer;
+    timer.start();
+
+    bool ok = (this->*function)();
+
+    perf_counters.stop();
+    if (!ok && !abortRequested()) live_stats.addError();
+
+    qint64 runtime = timer.elapsed();
+    AllocationCounter::Counts after = AllocationCounter::current();
+    emit allocations(phase,
+        after.count - before.count, after.bytes - before.bytes);
+
+    QVariantMap statistics = phase_latency.toVariantMap();
+    statistics["bytes"] = phase_bytes;
+    statistics["runtime"] = runtime;
+    if (perf_enabled) statistics["counters"] = perf_counters.toVariantMap();
+    statistics["block_size"] = transfer_length;
+    statistics["jobs"] = zoned_mode ? zone_stream_count : 1;
+    emit phaseStatistics(phase, statistics);
+
+    return ok;
+}
+
+/*!
+ * Discards all blocks of the device through the block layer,
+ * also after a test with the SCSI backend.
+ */
+void
+DeviceTester::discard()
+{
+    bool ok = false;
+    quint64 bytes = 0;
+    #if defined(__linux__) && defined(BLKDISCARD)
+    QString path = blockDevice(_device);
+    int dev_fd = ::open(QFile::encodeName(path).constData(),
+        O_RDWR | O_EXCL);
+    if (dev_fd != -1)
+    {
+        ok = ioctl(dev_fd, BLKGETSIZE64, &bytes) == 0;
+        quint64 range[2] = {0, bytes};
+        ok = ok && ioctl(dev_fd, BLKDISCARD, &range) == 0;
+        if (!ok) error = tr("discard failed: %1").arg(strerror(errno));
+        ::close(dev_fd);
+    }
+    #endif
+    emit discarded(ok, ok ? (qint64)bytes : 0);
+}
+
+/*!
+ * Gets the zones of the device (BLKREPORTZONE) and the number of zones
+ * that may be written at the same time (sysfs), see setOpenZones().
+ * Sets bytes_total to the capacity of all zones to be tested.
+ */
+bool
+DeviceTester::reportZones()
+{
+    zones.clear();
+
+    #if defined(USE_ZONED)
+    if (_backend != BlockLayer)
+    {
+        error = tr("zoned devices can only be tested through the block layer");
+        return false;
+    }
+
+    //Zone descriptors, in batches
+    const int batch = 256;
+    QByteArray report_buffer(sizeof(blk_zone_report) +
+        batch * sizeof(blk_zone), (char)0);
+    blk_zone_report *report = (blk_zone_report*)report_buffer.data();
+    quint64 sector = 0;
+    quint64 sectors = bytes_total / 512; //zones always in 512 B sectors
+    qint64 capacity_total = 0;
+    while (sector < sectors)
+    {
+        memset(report_buffer.data(), 0, report_buffer.size());
+        report->sector = sector;
+        report->nr_zones = batch;
+        if (ioctl(fd, BLKREPORTZONE, report) == -1)
+        {
+            error = tr("zone report failed: %1").arg(strerror(errno));
+            return false;
+        }
+        if (!report->nr_zones) break;
+
+        for (quint32 i = 0; i < report->nr_zones; i++)
+        {
+            const blk_zone &info = report->zones[i];
+            sector = info.start + info.len;
+
+            //Offline and read-only zones cannot be written
+            if (info.cond == BLK_ZONE_COND_OFFLINE ||
+                info.cond == BLK_ZONE_COND_READONLY)
+                continue;
+
+            //Capacity may be smaller than the zone (ZNS)
+            Zone zone;
+            zone.start = info.start * 512;
+            zone.size = info.len * 512;
+            zone.capacity = zone.size;
+            #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+            if (report->flags & BLK_ZONE_REP_CAPACITY)
+                zone.capacity = info.capacity * 512;
+            #endif
+            zone.sequential = info.type != BLK_ZONE_TYPE_CONVENTIONAL;
+            zone.write_bytes = 0;
+            zone.write_time = 0;
+            zone.read_bytes = 0;
+            zone.read_time = 0;
+            zones << zone;
+            capacity_total += zone.capacity;
+        }
+    }
+    if (zones.isEmpty() || !capacity_total)
+    {
+        error = tr("no writable zones found");
+        return false;
+    }
+
+    //Open zones limited by device (0 if unlimited)
+    zone_stream_count = qMin(open_zones, zones.size());
+    QString sys_path =
+        "/sys/block/" + QFileInfo(blockDevice(_device)).fileName() + "/queue/";
+    foreach (QString limit_name,
+        QStringList() << "max_open_zones" << "max_active_zones")
+    {
+        QFile file(sys_path + limit_name);
+        if (!file.open(QIODevice::ReadOnly)) continue;
+        int limit = file.readAll().trimmed().toInt();
+        if (limit > 0) zone_stream_count = qMin(zone_stream_count, limit);
+    }
+
+    bytes_total = capacity_total;
+    return true;
+    #else
+    error = tr("zoned devices not supported");
+    return false;
+    #endif
+}
+
+/*!
+ * Moves the write pointer of all sequential zones back to their start,
+ * which discards their data. Other zones (segments) are left alone.
+ */
+bool
+DeviceTester::resetZones()
+{
+    for (int i = 0; i < zones.size(); i++)
+    {
+        const Zone &zone = zones.at(i);
+        if (!zone.sequential) continue;
+
+        #if defined(USE_ZONED)
+        blk_zone_range range;
+        range.sector = zone.start / 512;
+        range.nr_sectors = zone.size / 512;
+        if (ioctl(fd, BLKRESETZONE, &range) == -1)
+        {
+            error = tr("zone reset failed: %1").arg(strerror(errno));
+            return false;
+        }
+        #else
+        error = tr("zoned devices not supported");
+        return false;
+        #endif
+    }
+    return true;
+}
+
+bool
+DeviceTester::writeZones()
+{
+    {
+        AllocationCounter::Suspend suspend;
+        emit started(bytes_total);
+        emit writeStarted();
+    }
+
+    //Write pointers at the start of each zone
+    if (!resetZones())
+    {
+        error_type |= VolumeTester::Error::Write;
+        emit writeFailed(0, 0);
+        return false;
+    }
+
+    //Write zones
+    if (!runZones(false)) return false;
+
+    //Flush device cache
+    if (!flush())
+    {
+        error_type |= VolumeTester::Error::Write;
+        emit writeFailed(0, 0);
+        return false;
+    }
+
+    return true;
+}
+
+bool
+DeviceTester::verifyZones()
+{
+    {
+        AllocationCounter::Suspend suspend;
+        emit verifyStarted();
+    }
+
+    return runZones(true);
+}
+
+/*!
+ * Starts the zone streams, each one takes the next zone
+ * that hasn't been written (or verified) yet,
+ * and reports the progress until all of them are done.
+ */
+bool
+DeviceTester::runZones(bool verify)
+{
+    //Reset shared state
+    next_zone.store(0);
+    zone_error.store(0);
+    zone_bytes.store(0);
+    zone_failed_start = 0;
+    zone_failed_size = 0;
+
+    //Start streams
+    QList<ZoneStream*> streams;
+    for (int i = 0; i < zone_stream_count; i++)
+    {
+        ZoneStream *stream = new ZoneStream(this, verify);
+        streams << stream;
+        stream->start();
+    }
+
+    //Report progress until all streams are done
+    QElapsedTimer timer;
+    timer.start();
+    bool running = true;
+    while (running)
+    {
+        running = false;
+        foreach (ZoneStream *stream, streams)
+        {
+            if (!stream->wait(200)) running = true;
+        }
+
+        double sec = (double)timer.elapsed() / 1000;
+        qint64 bytes = zone_bytes.load();
+        double avg_speed = sec ? ((double)bytes / MB) / sec : 0;
+        AllocationCounter::Suspend suspend; //not part of I/O path
+        if (verify)
+            emit verified(bytes, avg_speed);
+        else
+            emit written(bytes, avg_speed);
+    }
+
+    //Collect results
+    bool ok = true;
+    foreach (ZoneStream *stream, streams)
+    {
+        if (!stream->succeeded()) ok = false;
+        delete stream;
+    }
+    if (!ok && zone_error.load())
+    {
+        error_type |= zone_error.load();
+        if (verify)
+            emit verifyFailed(zone_failed_start, zone_failed_size);
+        else
+            emit writeFailed(zone_failed_start, zone_failed_size);
+    }
+
+    return ok;
+}
+
+/*!
+ * Writes or verifies zones until there are none left (zone stream).
+ * Each zone is transferred sequentially from its start,
+ * as required by the write pointer.
+ * In pattern mode, a failed transfer doesn't stop the stream,
+ * the bad blocks within it are collected (see findBadBlocks()).
+ */
+bool
+DeviceTester::zoneStream(bool verify)
+{
+    int type = verify ? VolumeTester::Error::Verify :
+        VolumeTester::Error::Write;
+    bool collect = !pattern_sequence.isEmpty();
+
+    //Transfer buffer of this stream, aligned for direct I/O
+    char *data = (char*)qMallocAligned(transfer_length, 4096);
+    if (!data)
+    {
+        zoneFailed(type, 0, 0, tr("out of memory"));
+        return false;
+    }
+
+    bool ok = true;
+    int index;
+    while (ok && (index = next_zone.fetchAndAddRelaxed(1)) < zones.size())
+    {
+        Zone &zone = zones[index];
+        qint64 zone_time = 0;
+        qint64 bytes = 0;
+        qint64 end = zone.start + zone.capacity;
+        for (qint64 pos = zone.start; pos < end; pos += transfer_length)
+        {
+            //Stop if another stream has failed
+            if (zone_error.load() || abortRequested())
+            {
+                ok = false;
+                break;
+            }
+
+            //Sample only (wipe)
+            if (verify && !VolumeTester::isSampled(pos / transfer_length,
+                verify_sampling))
+                continue;
+
+            int size = qMin((qint64)transfer_length, end - pos);
+            #if !defined(_WIN32)
+            QElapsedTimer timer_transfer;
+            bool transferred;
+            int mismatch = -1;
+            if (verify)
+            {
+                timer_transfer.start();
+                transferred = pread(fd, data, size, pos) == size;
+            }
+            else
+            {
+                fillBuffer(data, size, pos);
+                timer_transfer.start();
+                transferred = pwrite(fd, data, size, pos) == size;
+            }
+            qint64 latency = timer_transfer.nsecsElapsed();
+            QString message = transferred ? QString() :
+                QString::fromLocal8Bit(strerror(errno));
+            if (verify && transferred)
+            {
+                mismatch = verifyBuffer(data, size, pos);
+                if (mismatch != -1)
+                    message = tr("data mismatch at offset %1").
+                        arg(pos + mismatch);
+            }
+            if (!transferred || mismatch != -1)
+            {
+                if (!collect)
+                {
+                    zoneFailed(type, pos, size, message);
+                    ok = false;
+                    break;
+                }
+                findBadBlocks(verify, data, pos, size);
+            }
+            recordTransfer(latency, size);
+            zone_time += latency;
+            #else
+            zoneFailed(type, pos, size, tr("raw device tests not supported"));
+            ok = false;
+            break;
+            #endif
+            bytes += size;
+        }
+
+        //Zone done (or partially, if failed)
+        if (verify)
+        {
+            zone.read_bytes = bytes;
+            zone.read_time = zone_time;
+        }
+        else
+        {
+            zone.write_bytes = bytes;
+            zone.write_time = zone_time;
+        }
+    }
+
+    qFreeAligned(data);
+    return ok;
+}
+
+void
+DeviceTester::zoneFailed(int type, qint64 start, int size,
+    const QString &message)
+{
+    //Remember first failure only
+    QMutexLocker locker(&zone_mutex);
+    if (zone_error.load()) return;
+    zone_failed_start = start;
+    zone_failed_size = size;
+    error = message;
+    zone_error.store(type);
+}
+
+/*!
+ * Adds a transfer to the statistics of the current phase,
+ * called by the zone streams.
+ */
+void
+DeviceTester::recordTransfer(qint64 latency, int size)
+{
+    QMutexLocker locker(&zone_mutex);
+    phase_latency.add(latency);
+    phase_bytes += size;
+    live_stats.addBytes(size);
+    zone_bytes.fetchAndAddRelaxed(size);
+}
+
+/*!
+ * Writes and verifies all patterns (pattern mode).
+ * The device is split into segments
+ * which are handled like zones by the zone streams.
+ */
+bool
+DeviceTester::runPatterns()
+{
+    //Segments, no write pointer
+    zones.clear();
+    qint64 segment_size = 64 * (qint64)transfer_length;
+    for (qint64 pos = 0; pos < bytes_total; pos += segment_size)
+    {
+        Zone segment;
+        segment.start = pos;
+        segment.size = qMin(segment_size, bytes_total - pos);
+        segment.capacity = segment.size;
+        segment.sequential = false;
+        segment.write_bytes = 0;
+        segment.write_time = 0;
+        segment.read_bytes = 0;
+        segment.read_time = 0;
+        zones << segment;
+    }
+    zone_stream_count = qMin(queue_depth, zones.size());
+
+    //Patterns, one after another
+    bad_blocks.clear();
+    bad_block_errors = 0;
+    for (int i = 0; i < pattern_sequence.size(); i++)
+    {
+        QString spec = pattern_sequence.at(i);
+        data_provider.reset(DataProvider::create(spec));
+        if (!data_provider)
+        {
+            error = tr("invalid pattern: %1").arg(spec);
+            return false;
+        }
+        {
+            AllocationCounter::Suspend suspend;
+            emit patternStarted(i, spec);
+        }
+
+        if (!runPhase(VolumeTester::Phase::Write,
+            &DeviceTester::writeZones))
+            return false;
+        if (verify_sampling && !runPhase(VolumeTester::Phase::Verify,
+            &DeviceTester::verifyZones))
+            return false;
+    }
+
+    //Failed if any bad blocks have been found
+    error_type |= bad_block_errors;
+    if (!bad_blocks.isEmpty())
+        error = tr("%1 bad blocks").arg(bad_blocks.size());
+    return bad_blocks.isEmpty();
+}
+
+/*!
+ * Finds the bad blocks within a failed transfer (pattern mode):
+ * every block of the transfer is written, or read and verified,
+ * on its own and added to the list if it fails.
+ */
+void
+DeviceTester::findBadBlocks(bool verify, char *data, qint64 pos, int size)
+{
+    int type = verify ? VolumeTester::Error::Verify :
+        VolumeTester::Error::Write;
+    for (int offset = 0; offset < size; offset += bad_block_size)
+    {
+        int length = qMin(bad_block_size, size - offset);
+        char *block = data + offset;
+        bool ok = false;
+        #if !defined(_WIN32)
+        if (verify)
+        {
+            ok = pread(fd, block, length, pos + offset) == length &&
+                verifyBuffer(block, length, pos + offset) == -1;
+        }
+        else
+        {
+            ok = pwrite(fd, block, length, pos + offset) == length;
+        }
+        #endif
+        if (!ok) addBadBlock((pos + offset) / bad_block_size, type);
+    }
+}
+
+void
+DeviceTester::addBadBlock(qint64 block, int type)
+{
+    QMutexLocker locker(&zone_mutex);
+    bad_block_errors |= type;
+    if (bad_blocks.contains(block)) return;
+    bad_blocks.insert(block);
+    AllocationCounter::Suspend suspend; //not part of I/O path
+    emit badBlock(block);
+}
+
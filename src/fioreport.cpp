@@ -0,0 +1,158 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "fioreport.hpp"
+
+/*! \class FioReport
+ *
+ * \brief The FioReport class formats throughput and latency results
+ * like fio --output-format=json.
+ *
+ * Each test phase is added as a job, the statistics of a phase
+ * (bytes, runtime in milliseconds, latencies in nanoseconds)
+ * are placed in the read or write section of the job.
+ * As all I/O is synchronous, there is no submission latency,
+ * so the total latency is the completion latency.
+ *
+ * The result can be processed by tools written for fio,
+ * which only look at the fields filled in here.
+ *
+ */
+
+FioReport::FioReport(const QString &version)
+         : _version(version),
+           timestamp(QDateTime::currentDateTime())
+{
+}
+
+/*!
+ * Adds a job, rw is either "read" or "write".
+ * For a mixed workload, rw is "randrw" and the statistics contain
+ * a "read" and a "write" section, sharing the runtime of the phase.
+ * The error code is an errno value (0 if the phase was successful).
+ */
+void
+FioReport::addJob(const QString &name, const QString &rw,
+    const QString &filename, const QVariantMap &statistics, int error)
+{
+    qint64 runtime = statistics.value("runtime").toLongLong();
+
+    QJsonObject options;
+    options["name"] = name;
+    options["rw"] = rw;
+    options["filename"] = filename;
+    options["bs"] = statistics.value("block_size").toString();
+    options["numjobs"] = statistics.value("jobs", 1).toString();
+
+    //Statistics per direction
+    QVariantMap read = rw == "read" ? statistics : QVariantMap();
+    QVariantMap write = rw == "write" ? statistics : QVariantMap();
+    if (rw == "randrw")
+    {
+        read = statistics.value("read").toMap();
+        read["runtime"] = runtime;
+        write = statistics.value("write").toMap();
+        write["runtime"] = runtime;
+    }
+
+    QJsonObject sync;
+    sync["total_ios"] = 0;
+    sync["lat_ns"] = latency(QVariantMap(), false);
+
+    QJsonObject job;
+    job["jobname"] = name;
+    job["groupid"] = 0;
+    job["error"] = error;
+    job["eta"] = 0;
+    job["elapsed"] = (runtime + 999) / 1000;
+    job["job options"] = options;
+    job["read"] = ioStatistics(read);
+    job["write"] = ioStatistics(write);
+    job["trim"] = ioStatistics(QVariantMap());
+    job["sync"] = sync;
+    job["job_runtime"] = runtime;
+    jobs.append(job);
+}
+
+QByteArray
+FioReport::toJson()
+const
+{
+    QJsonObject root;
+    root["fio version"] = _version;
+    root["timestamp"] = timestamp.toMSecsSinceEpoch() / 1000;
+    root["timestamp_ms"] = timestamp.toMSecsSinceEpoch();
+    root["time"] = QLocale::c().toString(timestamp,
+        "ddd MMM d HH:mm:ss yyyy"); //ctime()
+    root["jobs"] = jobs;
+    root["disk_util"] = QJsonArray();
+    return QJsonDocument(root).toJson();
+}
+
+QJsonObject
+FioReport::ioStatistics(const QVariantMap &statistics)
+{
+    qint64 bytes = statistics.value("bytes").toLongLong();
+    qint64 runtime = statistics.value("runtime").toLongLong();
+    qint64 ios = statistics.value("count").toLongLong();
+    double bw_bytes = runtime ? (double)bytes * 1000 / runtime : 0;
+    double iops = runtime ? (double)ios * 1000 / runtime : 0;
+
+    QJsonObject io;
+    io["io_bytes"] = bytes;
+    io["io_kbytes"] = bytes / 1024;
+    io["bw_bytes"] = (qint64)bw_bytes;
+    io["bw"] = (qint64)(bw_bytes / 1024); //KiB/s
+    io["iops"] = iops;
+    io["runtime"] = runtime;
+    io["total_ios"] = ios;
+    io["short_ios"] = 0;
+    io["drop_ios"] = 0;
+    io["slat_ns"] = latency(QVariantMap(), false);
+    io["clat_ns"] = latency(statistics, true);
+    io["lat_ns"] = latency(statistics, false);
+    return io;
+}
+
+QJsonObject
+FioReport::latency(const QVariantMap &statistics, bool percentiles)
+{
+    qint64 count = statistics.value("count").toLongLong();
+
+    QJsonObject lat;
+    lat["min"] = statistics.value("min").toLongLong();
+    lat["max"] = statistics.value("max").toLongLong();
+    lat["mean"] = statistics.value("mean").toDouble();
+    lat["stddev"] = statistics.value("stddev").toDouble();
+    lat["N"] = count;
+
+    //Like fio, no percentiles without samples
+    if (percentiles && count)
+    {
+        QVariantMap values = statistics.value("percentiles").toMap();
+        QJsonObject percentile;
+        foreach (QString key, values.keys())
+            percentile[key] = values.value(key).toLongLong();
+        lat["percentile"] = percentile;
+    }
+
+    return lat;
+}
+
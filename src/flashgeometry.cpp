@@ -0,0 +1,522 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "flashgeometry.hpp"
+
+/*! \class FlashGeometry
+ *
+ * \brief The FlashGeometry class estimates the erase block size,
+ * the page size and the number of open allocation units
+ * of a flash drive by timing reads and writes (like flashbench).
+ *
+ * Alignment scan (reads only): for each power of two, reads crossing
+ * a multiple of it are compared with reads ending or starting there.
+ * Crossing a page or an erase block boundary is slower,
+ * crossing any other boundary is not. The erase block size is
+ * the largest alignment with a significant difference,
+ * the page size is the smallest one below it.
+ *
+ * Open allocation units (writes): small chunks are written round-robin
+ * to 1, 2, 4, ... erase blocks. Once the controller cannot keep
+ * all of them open, the write speed collapses.
+ *
+ * On a mounted volume, a test file is created and the scan is done
+ * within its largest contiguous extent, whose location on the device
+ * is determined with FIEMAP. On a raw device, the write test
+ * overwrites data at the beginning of the device.
+ *
+ * Linux only.
+ *
+ */
+
+namespace
+{
+
+QString
+sysfsValue(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QString();
+    return QString::fromLatin1(file.readAll()).trimmed();
+}
+
+}
+
+FlashGeometry::FlashGeometry(const QString &path)
+             : _path(path),
+               is_device(DeviceTester::isDevice(path)),
+               write_test(true),
+               _canceled(false),
+               fd(-1),
+               sector_size(512),
+               dev_base(0),
+               file_base(0),
+               region_size(0),
+               buffer(0),
+               erase_block(0),
+               page(0),
+               open_units(0)
+{
+}
+
+FlashGeometry::~FlashGeometry()
+{
+    close();
+    if (buffer) qFreeAligned(buffer);
+}
+
+bool
+FlashGeometry::isValid()
+const
+{
+    return is_device || VolumeTester::isValid(_path);
+}
+
+/*!
+ * Returns true if the path is a device, false if it's a mountpoint.
+ */
+bool
+FlashGeometry::isDevice()
+const
+{
+    return is_device;
+}
+
+/*!
+ * Enables the open allocation unit test, which writes to the device
+ * (enabled by default). On a raw device, this destroys data.
+ */
+void
+FlashGeometry::setWriteTest(bool enabled)
+{
+    write_test = enabled;
+}
+
+/*!
+ * Returns the detected erase block size or 0 if there was no clear result.
+ */
+qint64
+FlashGeometry::eraseBlockSize()
+const
+{
+    return erase_block;
+}
+
+/*!
+ * Returns the detected page size or 0 if there was no clear result.
+ */
+qint64
+FlashGeometry::pageSize()
+const
+{
+    return page;
+}
+
+/*!
+ * Returns the number of erase blocks that can be written alternately
+ * without losing speed or 0 if it was not measured.
+ */
+int
+FlashGeometry::openUnits()
+const
+{
+    return open_units;
+}
+
+void
+FlashGeometry::start()
+{
+    if (!isValid())
+    {
+        emit failed(tr("not a device or mountpoint"));
+        emit finished(false);
+        return;
+    }
+
+    //Buffer for direct I/O, random data (not compressible)
+    data_provider.reset(new RandomDataProvider(MB));
+    if (!buffer) buffer = (char*)qMallocAligned(MB, 4096);
+    data_provider->fill(buffer, MB, 0);
+
+    bool success = open() && measureAlignment() &&
+        (!write_test || measureOpenUnits());
+    close();
+    if (_canceled) error = tr("aborted");
+
+    if (success)
+        emit detected(erase_block, page, open_units);
+    else
+        emit failed(error);
+    emit finished(success);
+
+}
+
+/*!
+ * Requests the analysis to be aborted.
+ */
+void
+FlashGeometry::cancel()
+{
+    _canceled = true;
+}
+
+bool
+FlashGeometry::open()
+{
+    close();
+
+    #if defined(__linux__)
+    if (!is_device) return createFile() && locateFile();
+
+    //Never write to mounted filesystems
+    if (write_test && !DeviceTester(_path).filesystems().isEmpty())
+    {
+        error = tr("device is mounted");
+        return false;
+    }
+
+    //Direct I/O, exclusive if writing
+    QString path = DeviceTester::blockDevice(_path);
+    int flags = O_DIRECT | (write_test ? O_RDWR | O_EXCL : O_RDONLY);
+    fd = ::open(QFile::encodeName(path).constData(), flags);
+    if (fd == -1)
+    {
+        error = tr("cannot open %1: %2").arg(path).arg(strerror(errno));
+        return false;
+    }
+
+    quint64 bytes = 0;
+    if (ioctl(fd, BLKGETSIZE64, &bytes) != 0 ||
+        ioctl(fd, BLKSSZGET, &sector_size) != 0)
+    {
+        error = tr("cannot get size of %1").arg(path);
+        return false;
+    }
+    region_size = bytes;
+    dev_base = 0;
+    file_base = 0;
+    return true;
+    #else
+    error = tr("not supported on this platform");
+    return false;
+    #endif
+}
+
+void
+FlashGeometry::close()
+{
+    if (fd != -1) ::close(fd);
+    fd = -1;
+    if (!file_path.isEmpty()) QFile::remove(file_path);
+    file_path.clear();
+}
+
+/*!
+ * Creates the test file on the volume and fills it,
+ * so its blocks are allocated.
+ */
+bool
+FlashGeometry::createFile()
+{
+    #if defined(__linux__)
+    //Up to 256 MB, enough for 32 erase blocks of 8 MB
+    qint64 available = QStorageInfo(_path).bytesAvailable() - MB;
+    qint64 size = qMin(available, (qint64)256 * MB) / MB * MB;
+    if (size < 32 * MB)
+    {
+        error = tr("not enough space on volume");
+        return false;
+    }
+
+    file_path = QDir(_path).filePath("CAPACITYTESTER_GEOMETRY");
+    fd = ::open(QFile::encodeName(file_path).constData(),
+        O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd == -1)
+    {
+        error = tr("cannot create %1: %2").
+            arg(file_path).arg(strerror(errno));
+        file_path.clear();
+        return false;
+    }
+
+    //File offsets, location is not known yet
+    region_size = size;
+    dev_base = 0;
+    file_base = 0;
+    for (qint64 pos = 0; pos < size; pos += MB)
+    {
+        if (!transfer(true, pos, MB)) return false;
+        if (_canceled) return false;
+    }
+    if (fdatasync(fd) != 0)
+    {
+        error = tr("cannot flush %1: %2").arg(file_path).arg(strerror(errno));
+        return false;
+    }
+
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+/*!
+ * Selects the largest contiguous extent of the test file
+ * and determines its offset on the device (not the partition).
+ */
+bool
+FlashGeometry::locateFile()
+{
+    #if defined(__linux__)
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        error = tr("cannot stat %1").arg(file_path);
+        return false;
+    }
+
+    //Partition offset (512 byte sectors), logical block size
+    QString sys = QString("/sys/dev/block/%1:%2").
+        arg(major(st.st_dev)).arg(minor(st.st_dev));
+    qint64 start = sysfsValue(sys + "/start").toLongLong() * 512;
+    QString logical = sysfsValue(sys + "/queue/logical_block_size");
+    if (logical.isEmpty())
+        logical = sysfsValue(sys + "/../queue/logical_block_size");
+    sector_size = logical.isEmpty() ? 4096 : logical.toInt();
+
+    //Extents
+    const int max_extents = 256;
+    QByteArray request(sizeof(struct fiemap) +
+        max_extents * sizeof(struct fiemap_extent), (char)0);
+    struct fiemap *map = (struct fiemap*)request.data();
+    map->fm_start = 0;
+    map->fm_length = ~0ULL;
+    map->fm_flags = FIEMAP_FLAG_SYNC;
+    map->fm_extent_count = max_extents;
+    if (ioctl(fd, FS_IOC_FIEMAP, map) != 0)
+    {
+        error = tr("cannot locate test file on device (FIEMAP): %1").
+            arg(strerror(errno));
+        return false;
+    }
+
+    //Largest contiguous range, adjacent extents merged
+    const quint32 unusable = FIEMAP_EXTENT_UNKNOWN |
+        FIEMAP_EXTENT_ENCODED | FIEMAP_EXTENT_DATA_ENCRYPTED |
+        FIEMAP_EXTENT_NOT_ALIGNED | FIEMAP_EXTENT_DATA_INLINE |
+        FIEMAP_EXTENT_DATA_TAIL | FIEMAP_EXTENT_UNWRITTEN;
+    qint64 logical_begin = 0, physical_begin = 0, length = 0;
+    qint64 best_logical = 0, best_physical = 0, best_length = 0;
+    for (quint32 i = 0; i < map->fm_mapped_extents; i++)
+    {
+        const struct fiemap_extent &extent = map->fm_extents[i];
+        if (extent.fe_flags & unusable)
+        {
+            length = 0;
+            continue;
+        }
+        if (length && extent.fe_logical == (quint64)(logical_begin + length) &&
+            extent.fe_physical == (quint64)(physical_begin + length))
+        {
+            length += extent.fe_length;
+        }
+        else
+        {
+            logical_begin = extent.fe_logical;
+            physical_begin = extent.fe_physical;
+            length = extent.fe_length;
+        }
+        if (length > best_length)
+        {
+            best_logical = logical_begin;
+            best_physical = physical_begin;
+            best_length = length;
+        }
+    }
+    if (best_length < 16 * MB)
+    {
+        error = tr("test file too fragmented");
+        return false;
+    }
+
+    file_base = best_logical;
+    dev_base = start + best_physical;
+    region_size = qMin(best_length, region_size - best_logical);
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+/*!
+ * Reads or writes size bytes at the specified device offset,
+ * which must be within the region. Returns the time in nanoseconds.
+ */
+bool
+FlashGeometry::transfer(bool write, qint64 offset, int size, qint64 *nsec)
+{
+    assert(offset >= dev_base && offset + size <= dev_base + region_size);
+    assert(size <= MB);
+    qint64 pos = file_base + offset - dev_base;
+
+    QElapsedTimer timer;
+    timer.start();
+    int done = 0;
+    while (done < size)
+    {
+        ssize_t count = write ?
+            pwrite(fd, buffer + done, size - done, pos + done) :
+            pread(fd, buffer + done, size - done, pos + done);
+        if (count == -1 && errno == EINTR) continue;
+        if (count <= 0)
+        {
+            error = tr("%1 failed at offset %2: %3").
+                arg(write ? "write" : "read").
+                arg(offset).
+                arg(count ? strerror(errno) : "end of device");
+            return false;
+        }
+        done += count;
+    }
+    if (nsec) *nsec = timer.nsecsElapsed();
+
+    return true;
+}
+
+bool
+FlashGeometry::measureAlignment()
+{
+    //Reads of two sectors: ending at, crossing or starting at a boundary
+    int block = sector_size;
+    int read_size = 2 * block;
+    qint64 top = 64 * MB;
+    while (top > region_size / 4) top /= 2;
+
+    QList<qint64> aligns;
+    QList<double> diffs;
+    QList<double> bases;
+    for (qint64 align = top; align >= 2 * read_size; align /= 2)
+    {
+        //Up to 16 boundaries spread across the region
+        qint64 first = (dev_base + read_size + align - 1) / align * align;
+        qint64 step = qMax(align, region_size / 16 / align * align);
+        double pre = 0, on = 0, post = 0;
+        int count = 0;
+        for (qint64 boundary = first;
+            boundary + read_size <= dev_base + region_size && count < 16;
+            boundary += step, count++)
+        {
+            qint64 nsec = 0;
+            if (!transfer(false, boundary - read_size, read_size, &nsec))
+                return false;
+            pre += nsec;
+            if (!transfer(false, boundary - block, read_size, &nsec))
+                return false;
+            on += nsec;
+            if (!transfer(false, boundary, read_size, &nsec))
+                return false;
+            post += nsec;
+        }
+        if (_canceled) return false;
+        if (count < 2) continue;
+
+        //Average (microseconds)
+        pre /= count * 1000.0;
+        on /= count * 1000.0;
+        post /= count * 1000.0;
+        emit alignmentMeasured(align, pre, on, post);
+
+        aligns << align;
+        bases << (pre + post) / 2;
+        diffs << on - (pre + post) / 2;
+    }
+
+    //Significant: at least half the largest difference and 5% of a read
+    double max_diff = 0;
+    foreach (double diff, diffs)
+        max_diff = qMax(max_diff, diff);
+    QList<bool> significant;
+    for (int i = 0; i < diffs.size(); i++)
+        significant << (max_diff > 0 && diffs.at(i) >= max_diff / 2 &&
+            diffs.at(i) >= bases.at(i) * 0.05);
+
+    //Largest significant alignment and the run of smaller ones below it
+    erase_block = 0;
+    page = 0;
+    for (int i = 0; i < aligns.size(); i++)
+    {
+        if (!significant.at(i)) continue;
+        erase_block = aligns.at(i);
+        page = aligns.at(i);
+        for (int j = i + 1; j < aligns.size() && significant.at(j); j++)
+            page = aligns.at(j);
+        break;
+    }
+    if (page == erase_block) page = 0; //no page boundary found
+
+    return true;
+}
+
+bool
+FlashGeometry::measureOpenUnits()
+{
+    //Erase blocks within the region (4 MB if unknown)
+    qint64 unit = erase_block ? erase_block : 4 * MB;
+    qint64 first = (dev_base + unit - 1) / unit * unit;
+    int available = (dev_base + region_size - first) / unit;
+    if (available < 2) return true; //too small, not measured
+
+    //Chunks of at least 16 KB (or a page), 16 per erase block
+    int chunk = qMax((qint64)16 * KB, page);
+    chunk = qMin((qint64)chunk, qMin(unit / 16, (qint64)MB));
+    chunk = qMax(chunk / sector_size * sector_size, sector_size);
+
+    open_units = 0;
+    double single_speed = 0;
+    for (int units = 1; units <= qMin(32, available); units *= 2)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        for (qint64 pos = 0; pos < unit; pos += chunk)
+        {
+            for (int i = 0; i < units; i++)
+                if (!transfer(true, first + i * unit + pos, chunk))
+                    return false;
+            if (_canceled) return false;
+        }
+        if (fdatasync(fd) != 0)
+        {
+            error = tr("flush failed: %1").arg(strerror(errno));
+            return false;
+        }
+
+        double sec = (double)timer.nsecsElapsed() / 1000000000;
+        double speed = sec ? ((double)units * unit / MB) / sec : 0;
+        emit openUnitsMeasured(units, speed);
+
+        //Stop once the speed has dropped to less than half
+        if (units == 1) single_speed = speed;
+        if (speed < single_speed / 2) break;
+        open_units = units;
+    }
+
+    return true;
+}
+
@@ -0,0 +1,309 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "flightrecorder.hpp"
+
+/*! \class FlightRecorder
+ *
+ * \brief The FlightRecorder class keeps the last few operations,
+ * the slowest operations and the first failing block of a test.
+ *
+ * It's always enabled, so its memory is fixed (allocated once)
+ * and recording an operation does not take a lock.
+ * Each slot is protected by a sequence number, which is odd
+ * while the slot is being written. A writer that finds a slot busy
+ * drops its record rather than waiting, a reader retries or skips it.
+ * Several threads may record operations at the same time.
+ *
+ * Times are in milliseconds, relative to the start of the test.
+ * The type of an operation is an index into the list of type names.
+ *
+ */
+
+namespace
+{
+
+bool
+byTime(const FlightRecorder::Operation &a, const FlightRecorder::Operation &b)
+{
+    return a.time < b.time;
+}
+
+bool
+byLatency(const FlightRecorder::Operation &a,
+    const FlightRecorder::Operation &b)
+{
+    return a.latency > b.latency;
+}
+
+QString
+formatTime(qint64 time)
+{
+    qint64 total_seconds = time / 1000;
+    return QString("%1:%2.%3").
+        arg(total_seconds / 60, 2, 10, QChar('0')).
+        arg(total_seconds % 60, 2, 10, QChar('0')).
+        arg(time % 1000, 3, 10, QChar('0'));
+}
+
+}
+
+FlightRecorder::FlightRecorder(const QStringList &type_names,
+    int last_count, int slowest_count)
+              : _type_names(type_names),
+                last_count(qMax(1, last_count)),
+                slowest_count(qMax(1, slowest_count)),
+                last(0),
+                slowest(0),
+                slowest_latency(0),
+                slowest_threshold(-1),
+                counter(0),
+                last_activity(0),
+                failure_state(0),
+                failure_offset(0)
+{
+    last = new Slot[this->last_count];
+    slowest = new Slot[this->slowest_count];
+    slowest_latency = new QAtomicInteger<qint64>[this->slowest_count];
+    clear();
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    delete[] last;
+    delete[] slowest;
+    delete[] slowest_latency;
+}
+
+/*!
+ * Removes all records. Must not be called during a test.
+ */
+void
+FlightRecorder::clear()
+{
+    for (int i = 0; i < last_count; i++)
+        last[i].sequence.store(0);
+    for (int i = 0; i < slowest_count; i++)
+    {
+        slowest[i].sequence.store(0);
+        slowest_latency[i].store(-1);
+    }
+    slowest_threshold.store(-1);
+    counter.store(0);
+    last_activity.store(0);
+    failure_state.store(0);
+}
+
+/*!
+ * Records an operation that started and ended at the specified times.
+ */
+void
+FlightRecorder::record(int type, qint64 offset, int size,
+    qint64 begin, qint64 end)
+{
+    Operation operation;
+    operation.type = type;
+    operation.offset = offset;
+    operation.size = size;
+    operation.time = begin;
+    operation.latency = end - begin;
+    last_activity.store(end);
+
+    //Last operations (ring)
+    uint index = (uint)counter.fetchAndAddRelaxed(1) % (uint)last_count;
+    write(last[index], operation);
+
+    //Slowest operations, replace the fastest one
+    if (operation.latency <= slowest_threshold.load()) return;
+    int fastest = 0;
+    qint64 fastest_latency = slowest_latency[0].load();
+    for (int i = 1; i < slowest_count; i++)
+    {
+        qint64 latency = slowest_latency[i].load();
+        if (latency < fastest_latency)
+        {
+            fastest = i;
+            fastest_latency = latency;
+        }
+    }
+    if (operation.latency > fastest_latency &&
+        slowest_latency[fastest].testAndSetOrdered(fastest_latency,
+            operation.latency))
+    {
+        write(slowest[fastest], operation);
+
+        //New threshold, may be slightly off with several writers
+        qint64 threshold = slowest_latency[0].load();
+        for (int i = 1; i < slowest_count; i++)
+            threshold = qMin(threshold, slowest_latency[i].load());
+        slowest_threshold.store(threshold);
+    }
+}
+
+/*!
+ * Keeps the expected and the actual bytes of the first failing block.
+ * The offset is the absolute offset of the first byte.
+ * Subsequent failures are ignored.
+ */
+void
+FlightRecorder::setFailure(qint64 offset, const char *expected,
+    const char *actual, int size)
+{
+    if (!failure_state.testAndSetOrdered(0, 1)) return;
+    failure_offset = offset;
+    failure_expected = QByteArray(expected, size);
+    failure_actual = QByteArray(actual, size);
+    failure_state.storeRelease(2);
+}
+
+/*!
+ * Returns the time the last operation has ended.
+ */
+qint64
+FlightRecorder::lastActivity()
+const
+{
+    return last_activity.load();
+}
+
+/*!
+ * Returns the last operations, oldest first.
+ */
+QList<FlightRecorder::Operation>
+FlightRecorder::lastOperations()
+const
+{
+    QList<Operation> operations;
+    for (int i = 0; i < last_count; i++)
+    {
+        Operation operation;
+        if (read(last[i], &operation)) operations << operation;
+    }
+    std::sort(operations.begin(), operations.end(), byTime);
+    return operations;
+}
+
+/*!
+ * Returns the slowest operations, slowest first.
+ */
+QList<FlightRecorder::Operation>
+FlightRecorder::slowestOperations()
+const
+{
+    QList<Operation> operations;
+    for (int i = 0; i < slowest_count; i++)
+    {
+        Operation operation;
+        if (read(slowest[i], &operation)) operations << operation;
+    }
+    std::sort(operations.begin(), operations.end(), byLatency);
+    return operations;
+}
+
+/*!
+ * Returns a readable report of all records.
+ */
+QString
+FlightRecorder::dump(const QString &reason)
+const
+{
+    QStringList lines;
+    lines << QString("Flight recorder (%1):").arg(reason);
+
+    QString header = QString("%1\t%2\t%3\t%4\t%5").
+        arg("Time", -9).
+        arg("Op", -8).
+        arg("Offset", -20).
+        arg("Size", -10).
+        arg("Latency");
+
+    lines << "Last operations:";
+    lines << header;
+    foreach (Operation operation, lastOperations())
+        lines << format(operation);
+
+    lines << "Slowest operations:";
+    lines << header;
+    foreach (Operation operation, slowestOperations())
+        lines << format(operation);
+
+    if (failure_state.loadAcquire() == 2)
+    {
+        lines << QString("First failing block, %1 bytes at offset %2:").
+            arg(failure_expected.size()).
+            arg(failure_offset);
+        for (int i = 0, ii = failure_expected.size(); i < ii; i += 16)
+        {
+            QByteArray expected = failure_expected.mid(i, 16);
+            QByteArray actual = failure_actual.mid(i, 16);
+            lines << QString("%1 %2\texpected %3").
+                arg(expected == actual ? " " : "*").
+                arg(failure_offset + i, 12).
+                arg(QString::fromLatin1(expected.toHex()));
+            lines << QString("%1 %2\tactual   %3").
+                arg(" ").
+                arg("", 12).
+                arg(QString::fromLatin1(actual.toHex()));
+        }
+    }
+
+    return lines.join("\n");
+}
+
+bool
+FlightRecorder::write(Slot &slot, const Operation &operation)
+{
+    int sequence = slot.sequence.loadAcquire();
+    if (sequence & 1) return false; //busy, dropped
+    if (!slot.sequence.testAndSetAcquire(sequence, sequence + 1))
+        return false;
+    slot.operation = operation;
+    slot.sequence.storeRelease(sequence + 2);
+    return true;
+}
+
+bool
+FlightRecorder::read(const Slot &slot, Operation *operation)
+{
+    for (int retry = 0; retry < 3; retry++)
+    {
+        int before = slot.sequence.loadAcquire();
+        if (!before) return false; //empty
+        if (before & 1) continue;
+        *operation = slot.operation;
+        if (slot.sequence.loadAcquire() == before) return true;
+    }
+    return false;
+}
+
+QString
+FlightRecorder::format(const Operation &operation)
+const
+{
+    QString type = operation.type >= 0 && operation.type < _type_names.size() ?
+        _type_names.at(operation.type) : QString::number(operation.type);
+    return QString("%1\t%2\t%3\t%4\t%5 ms").
+        arg(formatTime(operation.time), -9).
+        arg(type, -8).
+        arg(operation.offset, -20).
+        arg(Size(operation.size).formatted(), -10).
+        arg(operation.latency);
+}
+
@@ -0,0 +1,253 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "forensiccapture.hpp"
+
+/*! \class ForensicCapture
+ *
+ * \brief The ForensicCapture class saves the contents of failing regions
+ * to a file on the host, so they can be analyzed after the device
+ * has been disconnected (or has died).
+ *
+ * The file starts with a header (JSON) describing the test,
+ * including the data provider that generates the expected data
+ * (see DataProvider::reproducibleSpec()).
+ * Each region is a record with its metadata (JSON)
+ * and its contents (qCompress()), written and flushed as it is added.
+ * close() appends an index of all records with their file positions.
+ * If the index is missing (the test has crashed),
+ * the records are found by reading the file from the beginning.
+ *
+ * The total number of bytes captured is limited (default 256 MB),
+ * further regions are not saved.
+ *
+ * Thread-safe.
+ *
+ */
+
+/*!
+ * Reads the header and all regions of a capture file.
+ * Returns false if it's not a capture file.
+ */
+bool
+ForensicCapture::read(const QString &path, QVariantMap *header,
+    QList<Region> *regions)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    QDataStream in(&file);
+
+    //Header
+    quint32 magic = 0;
+    qint32 version = 0;
+    QByteArray json;
+    in >> magic >> version >> json;
+    if (magic != FILE_MAGIC || version != VERSION) return false;
+    if (header)
+        *header = QJsonDocument::fromJson(json).object().toVariantMap();
+    if (!regions) return true;
+    regions->clear();
+    qint64 first = file.pos();
+
+    //Index, written when the capture was closed
+    QVariantList positions;
+    if (file.size() > first + 12 && file.seek(file.size() - 12))
+    {
+        qint64 position = 0;
+        in >> position >> magic;
+        if (magic == INDEX_MAGIC && position >= first && file.seek(position))
+        {
+            in >> magic >> json;
+            if (magic == INDEX_MAGIC)
+                positions =
+                    QJsonDocument::fromJson(json).array().toVariantList();
+        }
+    }
+
+    //Records at indexed positions
+    if (!positions.isEmpty())
+    {
+        foreach (QVariant entry, positions)
+        {
+            Region region;
+            if (!file.seek(entry.toMap().value("position").toLongLong()) ||
+                !readRecord(in, &region))
+                return false;
+            *regions << region;
+        }
+        return true;
+    }
+
+    //No index, records from the beginning
+    file.seek(first);
+    while (!in.atEnd())
+    {
+        Region region;
+        if (!readRecord(in, &region)) break; //truncated or index
+        *regions << region;
+    }
+    return true;
+}
+
+ForensicCapture::ForensicCapture()
+               : limit(256 * 1024 * 1024),
+                 bytes_captured(0)
+{
+}
+
+ForensicCapture::~ForensicCapture()
+{
+    close();
+}
+
+/*!
+ * Creates the capture file (replaced if it exists) and writes the header.
+ */
+bool
+ForensicCapture::open(const QString &path, const QVariantMap &header)
+{
+    QMutexLocker locker(&mutex);
+    if (file.isOpen()) return false;
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+    index.clear();
+    bytes_captured = 0;
+
+    QDataStream out(&file);
+    out << FILE_MAGIC << (qint32)VERSION <<
+        QJsonDocument(QJsonObject::fromVariantMap(header)).
+            toJson(QJsonDocument::Compact);
+    return file.flush();
+}
+
+bool
+ForensicCapture::isOpen()
+const
+{
+    QMutexLocker locker(&mutex);
+    return file.isOpen();
+}
+
+/*!
+ * Changes the maximum number of bytes captured (uncompressed).
+ */
+void
+ForensicCapture::setLimit(qint64 bytes)
+{
+    QMutexLocker locker(&mutex);
+    limit = bytes;
+}
+
+/*!
+ * Saves size bytes found at the absolute offset on the volume.
+ * The kind tells why the region has been captured ("failure", "neighbor"),
+ * info may contain anything else needed to analyze it.
+ * data may be 0 if the region could not be read (size 0 saved).
+ * Returns false if the limit has been reached or writing has failed.
+ */
+bool
+ForensicCapture::add(qint64 offset, const char *data, int size,
+    const QString &kind, const QVariantMap &info)
+{
+    QMutexLocker locker(&mutex);
+    if (!file.isOpen()) return false;
+    if (data && bytes_captured + size > limit) return false;
+
+    QVariantMap meta = info;
+    meta["offset"] = offset;
+    meta["size"] = data ? size : 0;
+    meta["kind"] = kind;
+
+    QVariantMap entry;
+    entry["position"] = file.pos();
+    entry["offset"] = offset;
+    entry["size"] = data ? size : 0;
+    entry["kind"] = kind;
+
+    QDataStream out(&file);
+    out << RECORD_MAGIC <<
+        QJsonDocument(QJsonObject::fromVariantMap(meta)).
+            toJson(QJsonDocument::Compact) <<
+        (data ? qCompress((const uchar*)data, size) : QByteArray());
+    if (!file.flush()) return false;
+
+    index << entry;
+    if (data) bytes_captured += size;
+    return true;
+}
+
+int
+ForensicCapture::regionCount()
+const
+{
+    QMutexLocker locker(&mutex);
+    return index.size();
+}
+
+/*!
+ * Returns the number of bytes captured (uncompressed).
+ */
+qint64
+ForensicCapture::bytesCaptured()
+const
+{
+    QMutexLocker locker(&mutex);
+    return bytes_captured;
+}
+
+/*!
+ * Writes the index and closes the capture file.
+ */
+void
+ForensicCapture::close()
+{
+    QMutexLocker locker(&mutex);
+    if (!file.isOpen()) return;
+
+    qint64 position = file.pos();
+    QDataStream out(&file);
+    out << INDEX_MAGIC <<
+        QJsonDocument(QJsonArray::fromVariantList(index)).
+            toJson(QJsonDocument::Compact);
+    out << position << INDEX_MAGIC;
+    file.close();
+}
+
+bool
+ForensicCapture::readRecord(QDataStream &in, Region *region)
+{
+    quint32 magic = 0;
+    QByteArray json;
+    QByteArray data;
+    in >> magic;
+    if (magic != RECORD_MAGIC) return false;
+    in >> json >> data;
+    if (in.status() != QDataStream::Ok) return false;
+
+    QVariantMap meta = QJsonDocument::fromJson(json).object().toVariantMap();
+    region->offset = meta.take("offset").toLongLong();
+    region->size = meta.take("size").toInt();
+    region->kind = meta.take("kind").toString();
+    region->info = meta;
+    region->data = qUncompress(data);
+    return region->data.size() == region->size;
+}
+
@@ -0,0 +1,729 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "imagewriter.hpp"
+
+/*! \class ImageWriter
+ *
+ * \brief The ImageWriter class writes a master image to several targets
+ * at once and verifies every target.
+ *
+ * A target is a block device, a file or a mountpoint,
+ * in which case the image is written as a file to that volume.
+ *
+ * The image is read only once. It's mapped into memory in chunks,
+ * a checksum is calculated for every chunk and the chunk is then written
+ * by all targets in parallel, each in its own thread.
+ * The number of mapped chunks is limited (see setBufferSize()),
+ * so a fast target can be ahead of the slowest one by that many chunks,
+ * but no more.
+ * Once a target has written the whole image, it's read back and compared
+ * with the checksums of the master, independent of the other targets.
+ *
+ * A failing target is dropped and doesn't hold up the others.
+ *
+ * In sparse mode (see setSparse()), holes and all-zero regions of the image
+ * are not written, only the data extents are written and verified.
+ *
+ */
+
+/*! \class ImageWriter::Target
+ *
+ * \brief Thread writing and verifying one target.
+ */
+class ImageWriter::Target : public QThread
+{
+public:
+
+    Target(ImageWriter *writer, int index)
+         : writer(writer),
+           index(index)
+    {
+    }
+
+protected:
+
+    void
+    run()
+    {
+        if (writer->writeTarget(index))
+            writer->verifyTarget(index);
+    }
+
+private:
+
+    ImageWriter
+    *writer;
+
+    int
+    index;
+
+};
+
+/*!
+ * Returns the path the image is written to for the specified target.
+ * That's the target itself unless it's a directory (mountpoint),
+ * in which case it's a file in that directory named like the image.
+ */
+QString
+ImageWriter::targetPath(const QString &target, const QString &image)
+{
+    QString path = target;
+    QFileInfo info(target);
+    if (info.isDir())
+        path = QDir(target).absoluteFilePath(QFileInfo(image).fileName());
+    return path;
+}
+
+/*!
+ * Returns the number of bytes that can be written to the specified path,
+ * which is the size of a block device or the available space
+ * of the volume a file is on.
+ */
+qint64
+ImageWriter::targetCapacity(const QString &path)
+{
+    qint64 bytes = 0;
+
+    QFileInfo info(path);
+    if (info.exists() && !info.isFile() && !info.isDir())
+    {
+        //Block device, size is only known when seeking to the end
+        int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+        if (fd != -1)
+        {
+            off_t size = lseek(fd, 0, SEEK_END);
+            if (size > 0) bytes = size;
+            ::close(fd);
+        }
+    }
+    else
+    {
+        //File, may be overwritten
+        QStorageInfo storage(info.absolutePath());
+        if (storage.isValid() && storage.isReady())
+            bytes = storage.bytesAvailable();
+        if (info.isFile())
+            bytes += info.size();
+    }
+
+    return bytes;
+}
+
+/*!
+ * Checks if the specified data contains only zero bytes.
+ */
+bool
+ImageWriter::isZero(const char *data, int size)
+{
+    int i = 0;
+
+    //Whole words in chunks, only one branch per chunk
+    const int chunk = 256;
+    for (; i + chunk <= size; i += chunk)
+    {
+        quint64 bits = 0;
+        for (int j = 0; j < chunk; j += 8)
+        {
+            quint64 word;
+            memcpy(&word, data + i + j, 8);
+            bits |= word;
+        }
+        if (bits) return false;
+    }
+
+    //Tail
+    for (; i < size; i++)
+    {
+        if (data[i]) return false;
+    }
+
+    return true;
+}
+
+/*!
+ * Constructs an ImageWriter for the specified image and targets.
+ */
+ImageWriter::ImageWriter(const QString &image, const QStringList &targets)
+           : chunk_size(16 * MB),
+             buffer_chunks(8),
+             sparse(false),
+             zero_block_size(64 * 1024),
+             image_path(image),
+             total(0),
+             first_chunk(0),
+             produced(0),
+             source_done(false),
+             source_failed(false),
+             active_targets(0),
+             _canceled(false)
+{
+    foreach (QString target, targets)
+        target_paths << targetPath(target, image);
+}
+
+/*!
+ * Changes the number of chunks that are kept in memory.
+ * This is how far the fastest target can be ahead of the slowest one.
+ * The default value is 8 (128 MB).
+ */
+bool
+ImageWriter::setBufferSize(int chunks)
+{
+    if (chunks < 1) return false;
+    buffer_chunks = chunks;
+    return true;
+}
+
+/*!
+ * Enables or disables sparse mode.
+ *
+ * Holes in the image (SEEK_HOLE) and regions of 64 KB containing only zeros
+ * are skipped. On a block device, such regions are unmapped by punching
+ * a hole (fallocate()), which only succeeds if the device guarantees
+ * that they read back as zeros (WRITE ZEROES with unmap).
+ * Otherwise they are zeroed with BLKZEROOUT, i.e., zeros are written.
+ * A file target is truncated first, so skipped regions are holes.
+ * Only the data extents are verified.
+ */
+void
+ImageWriter::setSparse(bool enabled)
+{
+    sparse = enabled;
+}
+
+/*!
+ * Checks if the image is readable and the targets are valid,
+ * i.e., there is at least one and none of them is the image itself.
+ */
+bool
+ImageWriter::isValid()
+const
+{
+    QFileInfo image_info(image_path);
+    if (!image_info.isFile() || !image_info.isReadable()) return false;
+    if (target_paths.isEmpty()) return false;
+
+    QStringList paths;
+    foreach (QString path, target_paths)
+    {
+        QString canonical = QFileInfo(path).absoluteFilePath();
+        if (canonical == image_info.absoluteFilePath()) return false;
+        if (paths.contains(canonical)) return false;
+        paths << canonical;
+    }
+
+    return true;
+}
+
+/*!
+ * Returns the path of the image.
+ */
+QString
+ImageWriter::image()
+const
+{
+    return image_path;
+}
+
+/*!
+ * Returns the size of the image in bytes.
+ */
+qint64
+ImageWriter::imageSize()
+const
+{
+    return QFileInfo(image_path).size();
+}
+
+/*!
+ * Returns the paths the image is written to.
+ */
+QStringList
+ImageWriter::targets()
+const
+{
+    return target_paths;
+}
+
+/*!
+ * Writes the image to all targets and verifies them.
+ */
+void
+ImageWriter::start()
+{
+    //Open master image
+    QFile source(image_path);
+    if (!isValid() || !source.open(QIODevice::ReadOnly))
+    {
+        emit failed(VolumeTester::Error::Create);
+        emit finished();
+        return;
+    }
+    total = source.size();
+    #if _XOPEN_SOURCE >= 600 || _POSIX_C_SOURCE >= 200112L
+    posix_fadvise(source.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+    #endif
+
+    //Reset
+    int count = target_paths.size();
+    chunks.clear();
+    checksums.clear();
+    extents.clear();
+    target_errors.clear();
+    for (int i = 0; i < count; i++)
+        target_errors << 0;
+    first_chunk = 0;
+    produced = 0;
+    source_done = false;
+    source_failed = false;
+    active_targets = 0;
+    emit started(total, count);
+
+    //Start targets which are large enough
+    QList<Target*> threads;
+    for (int i = 0; i < count; i++)
+    {
+        if (targetCapacity(target_paths.at(i)) < total)
+        {
+            setTargetError(i, 0, VolumeTester::Error::Full);
+            continue;
+        }
+        threads << new Target(this, i);
+    }
+    active_targets = threads.size();
+    foreach (Target *thread, threads)
+        thread->start();
+
+    //Read image once, chunk by chunk
+    qint64 data_bytes = 0;
+    int chunk_count = (total + chunk_size - 1) / chunk_size;
+    for (int n = 0; n < chunk_count; n++)
+    {
+        //Wait for a free slot (slowest target)
+        {
+            QMutexLocker locker(&mutex);
+            releaseChunks(source);
+            while (chunks.size() >= buffer_chunks &&
+                active_targets && !abortRequested())
+            {
+                chunk_consumed.wait(&mutex);
+                releaseChunks(source);
+            }
+            if (!active_targets || abortRequested()) break;
+        }
+
+        //Map chunk and calculate checksum
+        Chunk chunk;
+        chunk.offset = (qint64)n * chunk_size;
+        chunk.size = qMin((qint64)chunk_size, total - chunk.offset);
+        chunk.data = source.map(chunk.offset, chunk.size);
+        if (!chunk.data)
+        {
+            //Reading image failed
+            source_failed = true;
+            break;
+        }
+
+        //Data extents (entire chunk unless sparse)
+        chunk.extents = dataExtents(source, chunk);
+        QCryptographicHash hash(QCryptographicHash::Md5);
+        foreach (const Extent &extent, chunk.extents)
+        {
+            hash.addData((const char*)chunk.data +
+                (extent.offset - chunk.offset), extent.size);
+            data_bytes += extent.size;
+        }
+        QByteArray checksum = hash.result();
+
+        //Hand chunk over to targets
+        QMutexLocker locker(&mutex);
+        chunk.pending = active_targets;
+        chunks << chunk;
+        checksums << checksum;
+        extents.append(chunk.extents);
+        produced++;
+        chunk_produced.wakeAll();
+    }
+
+    //Done reading
+    {
+        QMutexLocker locker(&mutex);
+        source_done = true;
+        chunk_produced.wakeAll();
+    }
+    if (!source_failed && !abortRequested())
+        emit sourceRead(data_bytes, total - data_bytes);
+
+    //Wait for targets to finish writing and verifying
+    foreach (Target *thread, threads)
+    {
+        thread->wait();
+        delete thread;
+    }
+    foreach (const Chunk &chunk, chunks)
+        source.unmap(chunk.data);
+    chunks.clear();
+
+    //Result
+    bool success = !source_failed && !abortRequested();
+    foreach (int error_type, target_errors)
+    {
+        if (error_type) success = false;
+    }
+    if (source_failed)
+        emit failed(VolumeTester::Error::Unknown);
+    else if (abortRequested())
+        emit failed(VolumeTester::Error::Aborted);
+    emit finished(success);
+
+}
+
+/*!
+ * Requests the running job to be aborted.
+ */
+void
+ImageWriter::cancel()
+{
+    _canceled = true;
+
+    //Wake up waiting threads
+    QMutexLocker locker(&mutex);
+    chunk_produced.wakeAll();
+    chunk_consumed.wakeAll();
+}
+
+bool
+ImageWriter::writeTarget(int index)
+{
+    QString path = target_paths.at(index);
+
+    //Open target (files are truncated)
+    QFile file(path);
+    QFileInfo info(path);
+    bool is_device = info.exists() && !info.isFile();
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Unbuffered))
+    {
+        int error_type = VolumeTester::Error::Create;
+        if (file.error() & QFileDevice::PermissionsError)
+            error_type |= VolumeTester::Error::Permissions;
+        abandonTarget(index, 0, 0, error_type);
+        return false;
+    }
+
+    //Write chunks as they become available
+    QElapsedTimer timer;
+    timer.start();
+    qint64 bytes = 0;
+    int n = 0;
+    for (;; n++)
+    {
+        //Wait for chunk
+        Chunk chunk;
+        {
+            QMutexLocker locker(&mutex);
+            while (produced <= n && !source_done && !abortRequested())
+                chunk_produced.wait(&mutex);
+            if (produced <= n || abortRequested())
+            {
+                //No more chunks
+                break;
+            }
+            chunk = chunks.at(n - first_chunk);
+        }
+
+        //Write data extents, zero the gaps in between
+        qint64 pos = chunk.offset;
+        qint64 end = chunk.offset + chunk.size;
+        bool ok = true;
+        foreach (const Extent &extent, chunk.extents)
+        {
+            const char *data =
+                (const char*)chunk.data + (extent.offset - chunk.offset);
+            if ((extent.offset > pos &&
+                !zeroTarget(file, is_device, pos, extent.offset - pos)) ||
+                !file.seek(extent.offset) ||
+                file.write(data, extent.size) != extent.size)
+            {
+                ok = false;
+                break;
+            }
+            pos = extent.offset + extent.size;
+        }
+        if (ok && end > pos)
+            ok = zeroTarget(file, is_device, pos, end - pos);
+        if (!ok)
+        {
+            abandonTarget(index, n, chunk.offset, VolumeTester::Error::Write);
+            return false;
+        }
+
+        //Chunk done
+        {
+            QMutexLocker locker(&mutex);
+            chunks[n - first_chunk].pending--;
+            chunk_consumed.wakeAll();
+        }
+
+        bytes += chunk.size;
+        double sec = (double)timer.elapsed() / 1000;
+        double avg_speed = sec ? ((double)bytes / MB) / sec : 0;
+        emit written(index, bytes, avg_speed);
+    }
+
+    //Incomplete (aborted or image not readable)
+    if (bytes != total)
+    {
+        abandonTarget(index, n, bytes, VolumeTester::Error::Aborted);
+        return false;
+    }
+
+    //Trailing hole
+    if (!is_device && file.size() != total && !file.resize(total))
+    {
+        setTargetError(index, file.size(), VolumeTester::Error::Write);
+        return false;
+    }
+
+    //Flush cache
+    #ifdef USE_FSYNC
+    if (fsync(file.handle()) != 0)
+    {
+        setTargetError(index, 0, VolumeTester::Error::Write);
+        return false;
+    }
+    #endif
+
+    return true;
+}
+
+bool
+ImageWriter::verifyTarget(int index)
+{
+    emit verifyStarted(index);
+
+    //Open target again
+    QFile file(target_paths.at(index));
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered))
+    {
+        setTargetError(index, 0, VolumeTester::Error::Verify);
+        return false;
+    }
+
+    //Tell kernel to discard cache
+    #if _XOPEN_SOURCE >= 600 || _POSIX_C_SOURCE >= 200112L
+    posix_fadvise(file.handle(), 0, 0, POSIX_FADV_DONTNEED);
+    #endif
+
+    //Compare data extents with checksums of master
+    //All checksums are known once the target has been written completely
+    QByteArray buffer(chunk_size, (char)0);
+    QElapsedTimer timer;
+    timer.start();
+    for (int n = 0, nn = checksums.size(); n < nn; n++)
+    {
+        qint64 offset = (qint64)n * chunk_size;
+        int size = qMin((qint64)chunk_size, total - offset);
+        QCryptographicHash hash(QCryptographicHash::Md5);
+        qint64 failed_offset = -1;
+        foreach (const Extent &extent, extents.at(n))
+        {
+            if (!file.seek(extent.offset) ||
+                file.read(buffer.data(), extent.size) != extent.size)
+            {
+                failed_offset = extent.offset;
+                break;
+            }
+            hash.addData(buffer.constData(), extent.size);
+        }
+        if (failed_offset == -1 && hash.result() != checksums.at(n))
+            failed_offset = offset;
+        if (failed_offset != -1)
+        {
+            setTargetError(index, failed_offset, VolumeTester::Error::Verify);
+            return false;
+        }
+
+        double sec = (double)timer.elapsed() / 1000;
+        qint64 bytes = offset + size;
+        double avg_speed = sec ? ((double)bytes / MB) / sec : 0;
+        emit verified(index, bytes, avg_speed);
+
+        //Cancel gracefully
+        if (abortRequested())
+        {
+            setTargetError(index, bytes, VolumeTester::Error::Aborted);
+            return false;
+        }
+    }
+
+    emit targetSucceeded(index);
+    return true;
+}
+
+void
+ImageWriter::abandonTarget(int index, int next_chunk, qint64 start,
+    int error_type)
+{
+    //Release chunks this target won't write anymore
+    {
+        QMutexLocker locker(&mutex);
+        for (int n = qMax(next_chunk, first_chunk); n < produced; n++)
+            chunks[n - first_chunk].pending--;
+        active_targets--;
+        chunk_consumed.wakeAll();
+    }
+
+    setTargetError(index, start, error_type);
+}
+
+void
+ImageWriter::setTargetError(int index, qint64 start, int error_type)
+{
+    {
+        QMutexLocker locker(&mutex);
+        target_errors[index] |= error_type;
+    }
+
+    emit targetFailed(index, start, error_type);
+}
+
+void
+ImageWriter::releaseChunks(QFile &source)
+{
+    //Unmap chunks written by all targets (mutex locked)
+    while (!chunks.isEmpty() && chunks.first().pending <= 0)
+    {
+        source.unmap(chunks.first().data);
+        chunks.removeFirst();
+        first_chunk++;
+    }
+}
+
+QList<ImageWriter::Extent>
+ImageWriter::dataExtents(QFile &source, const Chunk &chunk)
+const
+{
+    QList<Extent> list;
+    qint64 end = chunk.offset + chunk.size;
+
+    //Entire chunk
+    if (!sparse)
+    {
+        Extent extent;
+        extent.offset = chunk.offset;
+        extent.size = chunk.size;
+        list << extent;
+        return list;
+    }
+
+    qint64 pos = chunk.offset;
+    while (pos < end)
+    {
+        //Next data region, skipping holes
+        qint64 data_start = pos;
+        qint64 data_end = end;
+        #if defined(SEEK_DATA) && defined(SEEK_HOLE)
+        int fd = source.handle();
+        off_t next_data = lseek(fd, pos, SEEK_DATA);
+        if (next_data == -1 && errno == ENXIO)
+            break; //only a hole left
+        if (next_data != -1)
+        {
+            data_start = next_data;
+            if (data_start >= end) break;
+            off_t next_hole = lseek(fd, data_start, SEEK_HOLE);
+            if (next_hole != -1) data_end = qMin((qint64)next_hole, end);
+        }
+        #else
+        Q_UNUSED(source);
+        #endif
+
+        //Skip blocks containing only zeros
+        for (qint64 block = data_start; block < data_end;
+            block += zero_block_size)
+        {
+            int size = qMin((qint64)zero_block_size, data_end - block);
+            const char *data =
+                (const char*)chunk.data + (block - chunk.offset);
+            if (isZero(data, size)) continue;
+
+            //Add to previous extent if adjacent
+            if (!list.isEmpty() &&
+                list.last().offset + list.last().size == block)
+            {
+                list.last().size += size;
+            }
+            else
+            {
+                Extent extent;
+                extent.offset = block;
+                extent.size = size;
+                list << extent;
+            }
+        }
+
+        pos = data_end;
+    }
+
+    return list;
+}
+
+bool
+ImageWriter::zeroTarget(QFile &file, bool is_device, qint64 start,
+    qint64 length)
+{
+    //Truncated file, gap is a hole already
+    if (!is_device) return true;
+
+    //Unmap the range, fails unless it reads back as zeros (no fallback)
+    #if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+    if (fallocate(file.handle(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+        start, length) == 0) return true;
+    #endif
+
+    //Let the kernel write zeros (or offload it to the device)
+    #if defined(__linux__) && defined(BLKZEROOUT)
+    quint64 range[2];
+    range[0] = start;
+    range[1] = length;
+    if (ioctl(file.handle(), BLKZEROOUT, range) == 0) return true;
+    #endif
+
+    //Write zeros
+    QByteArray zeros((int)qMin(length, (qint64)MB), (char)0);
+    if (!file.seek(start)) return false;
+    while (length > 0)
+    {
+        int size = qMin(length, (qint64)zeros.size());
+        if (file.write(zeros.constData(), size) != size) return false;
+        length -= size;
+    }
+
+    return true;
+}
+
+bool
+ImageWriter::abortRequested()
+const
+{
+    return _canceled;
+}
+
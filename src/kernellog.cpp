@@ -0,0 +1,217 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "kernellog.hpp"
+
+/*! \class KernelLog
+ *
+ * \brief The KernelLog class follows the kernel log (/dev/kmsg, Linux)
+ * and returns new messages concerning a device.
+ *
+ * Only messages logged after open() are returned.
+ * The time of a message is the number of milliseconds since open(),
+ * taken from the kernel timestamp (monotonic clock),
+ * so it doesn't matter how late the message is read.
+ *
+ * Reading /dev/kmsg may require root privileges (dmesg_restrict),
+ * open() fails if it's not readable.
+ *
+ */
+
+namespace
+{
+
+inline bool
+isNameChar(QChar c)
+{
+    return c.isLetterOrNumber() || c == '.' || c == '_';
+}
+
+inline bool
+isNumber(const QString &str)
+{
+    bool ok = false;
+    str.toInt(&ok);
+    return ok;
+}
+
+}
+
+/*!
+ * Returns the names a device is referred to in kernel messages:
+ * the block device and its disk (sdb1, sdb), the SCSI address (6:0:0:0),
+ * the SCSI host (scsi host6) and the USB port (usb 2-1).
+ */
+QStringList
+KernelLog::deviceFilters(const QString &device)
+{
+    QStringList filters;
+    QString canonical = QFileInfo(device).canonicalFilePath();
+    if (canonical.isEmpty() || !canonical.startsWith("/dev/"))
+        return filters;
+    QString name = QFileInfo(canonical).fileName();
+    filters << name;
+
+    //Device path in sysfs, e.g.:
+    //.../usb2/2-1/2-1:1.0/host6/target6:0:0/6:0:0:0/block/sdb/sdb1
+    QString sys_path =
+        QFileInfo("/sys/class/block/" + name).canonicalFilePath();
+    QStringList parts = sys_path.split('/');
+    for (int i = 0, ii = parts.size(); i < ii; i++)
+    {
+        QString part = parts.at(i);
+        if (part == "block" && i + 1 < ii && parts.at(i + 1) != name)
+        {
+            //Disk of partition
+            filters << parts.at(i + 1);
+        }
+        else if (part.startsWith("host") && isNumber(part.mid(4)))
+        {
+            filters << "scsi " + part;
+        }
+        else if (part.count(':') == 3 && !part.contains('.'))
+        {
+            //SCSI address (host:channel:target:lun)
+            filters << part;
+        }
+        else if (part.contains('-') && !part.contains(':') &&
+            part.at(0).isDigit())
+        {
+            //USB port (bus-port.port)
+            filters << "usb " + part;
+        }
+    }
+
+    filters.removeDuplicates();
+    return filters;
+}
+
+KernelLog::KernelLog()
+         : fd(-1),
+           start_usec(0)
+{
+}
+
+KernelLog::~KernelLog()
+{
+    close();
+}
+
+/*!
+ * Starts following the kernel log, returning only messages
+ * that contain one of the specified filters as a separate word.
+ */
+bool
+KernelLog::open(const QStringList &filters)
+{
+    close();
+    if (filters.isEmpty()) return false;
+    _filters = filters;
+
+    #if defined(__linux__)
+    fd = ::open("/dev/kmsg", O_RDONLY | O_NONBLOCK);
+    if (fd == -1) return false;
+
+    //Skip old messages
+    lseek(fd, 0, SEEK_END);
+
+    //Reference time, same clock as kernel timestamps
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    start_usec = (qint64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+void
+KernelLog::close()
+{
+    if (fd != -1) ::close(fd);
+    fd = -1;
+}
+
+bool
+KernelLog::isOpen()
+const
+{
+    return fd != -1;
+}
+
+/*!
+ * Returns all new messages concerning the device, does not block.
+ */
+QList<KernelLog::Message>
+KernelLog::read()
+{
+    QList<Message> messages;
+    if (fd == -1) return messages;
+
+    //One record per read():
+    //level,sequence,timestamp,flags;text
+    // KEY=value (optional dictionary lines)
+    char record[8192];
+    while (true)
+    {
+        ssize_t size = ::read(fd, record, sizeof(record) - 1);
+        if (size < 0 && errno == EPIPE) continue; //overwritten, skipped
+        if (size < 0 && errno == EINTR) continue;
+        if (size <= 0) break;
+        record[size] = 0;
+
+        QString str = QString::fromUtf8(record, size);
+        int separator = str.indexOf(';');
+        if (separator == -1) continue;
+        QStringList fields = str.left(separator).split(',');
+        if (fields.size() < 3) continue;
+        QString text = str.mid(separator + 1).section('\n', 0, 0);
+        if (!matches(text)) continue;
+
+        Message message;
+        message.level = fields.at(0).toInt() & 7;
+        message.time = (fields.at(2).toLongLong() - start_usec) / 1000;
+        message.text = text;
+        messages << message;
+    }
+
+    return messages;
+}
+
+bool
+KernelLog::matches(const QString &text)
+const
+{
+    foreach (QString filter, _filters)
+    {
+        int pos = 0;
+        while ((pos = text.indexOf(filter, pos)) != -1)
+        {
+            int end = pos + filter.size();
+            bool starts = pos == 0 || !isNameChar(text.at(pos - 1));
+            bool ends = end == text.size() || !isNameChar(text.at(end));
+            if (starts && ends) return true;
+            pos = end;
+        }
+    }
+    return false;
+}
+
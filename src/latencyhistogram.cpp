@@ -0,0 +1,183 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "latencyhistogram.hpp"
+
+/*! \class LatencyHistogram
+ *
+ * \brief The LatencyHistogram class collects latencies (nanoseconds)
+ * in a fixed number of buckets.
+ *
+ * Values below 32 have their own bucket, larger values are grouped
+ * by their highest bit, each power of two is split into 32 buckets.
+ * So a percentile is accurate to about 3%, like the latency
+ * percentiles reported by fio. Adding a value does not allocate memory.
+ *
+ * Not thread-safe.
+ *
+ */
+
+/*!
+ * Returns the percentiles fio reports by default.
+ */
+QList<double>
+LatencyHistogram::defaultPercentiles()
+{
+    return QList<double>()
+        << 1 << 5 << 10 << 20 << 30 << 40 << 50 << 60 << 70 << 80 << 90
+        << 95 << 99 << 99.5 << 99.9 << 99.95 << 99.99;
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+void
+LatencyHistogram::clear()
+{
+    memset(buckets, 0, sizeof(buckets));
+    _count = 0;
+    _min = 0;
+    _max = 0;
+    sum = 0;
+    sum_squares = 0;
+}
+
+void
+LatencyHistogram::add(qint64 value)
+{
+    if (value < 0) value = 0;
+    buckets[bucketIndex(value)]++;
+    if (!_count || value < _min) _min = value;
+    if (!_count || value > _max) _max = value;
+    _count++;
+    sum += value;
+    sum_squares += (double)value * value;
+}
+
+qint64
+LatencyHistogram::count()
+const
+{
+    return _count;
+}
+
+qint64
+LatencyHistogram::min()
+const
+{
+    return _min;
+}
+
+qint64
+LatencyHistogram::max()
+const
+{
+    return _max;
+}
+
+double
+LatencyHistogram::mean()
+const
+{
+    return _count ? sum / _count : 0;
+}
+
+double
+LatencyHistogram::stddev()
+const
+{
+    if (_count < 2) return 0;
+    double m = mean();
+    double variance = (sum_squares - _count * m * m) / (_count - 1);
+    return variance > 0 ? std::sqrt(variance) : 0;
+}
+
+/*!
+ * Returns the value below which p percent of all values are (0 < p <= 100).
+ */
+qint64
+LatencyHistogram::percentile(double p)
+const
+{
+    if (!_count) return 0;
+
+    qint64 rank = (qint64)std::ceil(p / 100 * _count);
+    if (rank < 1) rank = 1;
+    qint64 seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+            return qBound(_min, bucketValue(i), _max);
+    }
+    return _max;
+}
+
+/*!
+ * Returns count, min, max, mean, stddev and the specified percentiles.
+ * The percentile keys are formatted like fio's ("99.500000").
+ */
+QVariantMap
+LatencyHistogram::toVariantMap(const QList<double> &percentiles)
+const
+{
+    QVariantMap map;
+    map["count"] = _count;
+    map["min"] = _min;
+    map["max"] = _max;
+    map["mean"] = mean();
+    map["stddev"] = stddev();
+
+    QVariantMap values;
+    foreach (double p, percentiles)
+        values[QString::number(p, 'f', 6)] = percentile(p);
+    map["percentiles"] = values;
+
+    return map;
+}
+
+int
+LatencyHistogram::bucketIndex(qint64 value)
+{
+    if (value < SUB_COUNT) return (int)value;
+
+    //Highest bit
+    int msb = 0;
+    for (quint64 v = value; v > 1; v >>= 1) msb++;
+
+    int shift = msb - SUB_BITS;
+    int sub = (int)((value >> shift) & (SUB_COUNT - 1));
+    return SUB_COUNT + shift * SUB_COUNT + sub;
+}
+
+qint64
+LatencyHistogram::bucketValue(int index)
+{
+    if (index < SUB_COUNT) return index;
+
+    //Middle of bucket
+    int shift = (index - SUB_COUNT) / SUB_COUNT;
+    int sub = (index - SUB_COUNT) % SUB_COUNT;
+    qint64 lower = (qint64)(SUB_COUNT + sub) << shift;
+    return lower + ((qint64)1 << shift) / 2;
+}
+
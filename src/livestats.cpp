@@ -0,0 +1,279 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "livestats.hpp"
+
+/*! \class LiveStats
+ *
+ * \brief The LiveStats class publishes the progress of a test
+ * in a shared memory segment, so local monitors can follow it
+ * without parsing the output.
+ *
+ * Each tester creates its own segment /dev/shm/capacitytester.PID.N,
+ * which is removed when the test object is destroyed.
+ * The segment starts with a header (magic, version, size)
+ * followed by a sequence number and the data (see Segment).
+ * The sequence number is odd while the data is being updated.
+ * A reader maps the segment once, then copies the data
+ * and retries if the sequence number was odd or has changed
+ * (seqlock). Reading does not involve any syscalls or locks
+ * and never blocks the tester.
+ *
+ * Updates must not be made by several threads at the same time.
+ *
+ */
+
+namespace
+{
+
+QAtomicInt
+segment_counter(0);
+
+}
+
+/*!
+ * Returns the directory containing the segments (tmpfs).
+ */
+QString
+LiveStats::directory()
+{
+    return "/dev/shm";
+}
+
+/*!
+ * Returns the names of all segments, stale ones included
+ * (the process is gone, see Data::pid).
+ */
+QStringList
+LiveStats::segments()
+{
+    return QDir(directory()).entryList(
+        QStringList() << "capacitytester.*", QDir::Files, QDir::Name);
+}
+
+/*!
+ * Maps the specified segment and returns a consistent copy of its data.
+ * Returns false if it's not a valid segment or if the data
+ * keeps changing (retried a few times).
+ */
+bool
+LiveStats::read(const QString &name, Data *data)
+{
+    bool ok = false;
+    #ifdef USE_LIVESTATS
+    int fd = shm_open(QFile::encodeName("/" + name).constData(), O_RDONLY, 0);
+    if (fd == -1) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Segment))
+    {
+        ::close(fd);
+        return false;
+    }
+    void *map = mmap(0, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+
+    const Segment *shared = (const Segment*)map;
+    if (shared->magic == MAGIC && shared->version == VERSION &&
+        shared->size == sizeof(Segment))
+    {
+        for (int retry = 0; !ok && retry < 1000; retry++)
+        {
+            quint32 before = shared->sequence.loadAcquire();
+            if (before & 1) continue;
+            memcpy(data, &shared->data, sizeof(Data));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            ok = shared->sequence.load() == before;
+        }
+    }
+
+    munmap(map, sizeof(Segment));
+    #else
+    Q_UNUSED(name);
+    Q_UNUSED(data);
+    #endif
+    return ok;
+}
+
+LiveStats::LiveStats()
+         : segment(0)
+{
+}
+
+LiveStats::~LiveStats()
+{
+    close();
+}
+
+/*!
+ * Creates a new segment for a test of the specified target.
+ */
+bool
+LiveStats::open(const QString &target, qint64 bytes_total)
+{
+    close();
+
+    #ifdef USE_LIVESTATS
+    QString new_name = QString("capacitytester.%1.%2").
+        arg(getpid()).
+        arg(segment_counter.fetchAndAddRelaxed(1));
+    QByteArray path = QFile::encodeName("/" + new_name);
+    int fd = shm_open(path.constData(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd == -1) return false;
+    if (ftruncate(fd, sizeof(Segment)) != 0)
+    {
+        ::close(fd);
+        shm_unlink(path.constData());
+        return false;
+    }
+    void *map = mmap(0, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED,
+        fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        shm_unlink(path.constData());
+        return false;
+    }
+
+    //Zero-filled by ftruncate()
+    segment = (Segment*)map;
+    name = new_name;
+    Data &data = segment->data;
+    data.pid = getpid();
+    data.started = QDateTime::currentMSecsSinceEpoch();
+    data.updated = data.started;
+    data.state = Running;
+    data.bytes_total = bytes_total;
+    QByteArray utf8 = target.toUtf8().left(sizeof(data.target) - 1);
+    memcpy(data.target, utf8.constData(), utf8.size());
+
+    //Header last, the segment is valid from now on
+    segment->version = VERSION;
+    segment->size = sizeof(Segment);
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = MAGIC;
+
+    phase_timer.start();
+    return true;
+    #else
+    Q_UNUSED(target);
+    Q_UNUSED(bytes_total);
+    return false;
+    #endif
+}
+
+/*!
+ * Removes the segment.
+ */
+void
+LiveStats::close()
+{
+    #ifdef USE_LIVESTATS
+    if (!segment) return;
+    munmap(segment, sizeof(Segment));
+    shm_unlink(QFile::encodeName("/" + name).constData());
+    #endif
+    segment = 0;
+    name.clear();
+}
+
+bool
+LiveStats::isOpen()
+const
+{
+    return segment;
+}
+
+/*!
+ * Starts a new phase, the progress and speed are reset.
+ */
+void
+LiveStats::setPhase(int phase)
+{
+    if (!segment) return;
+    beginWrite();
+    Data &data = segment->data;
+    data.phase = phase;
+    data.bytes_done = 0;
+    data.phase_time = 0;
+    data.avg_speed = 0;
+    data.updated = QDateTime::currentMSecsSinceEpoch();
+    endWrite();
+    phase_timer.start();
+}
+
+/*!
+ * Adds bytes written or verified in the current phase.
+ */
+void
+LiveStats::addBytes(qint64 bytes)
+{
+    if (!segment) return;
+    beginWrite();
+    Data &data = segment->data;
+    data.bytes_done += bytes;
+    data.phase_time = phase_timer.elapsed();
+    data.avg_speed = data.phase_time ?
+        ((double)data.bytes_done / (1024 * 1024)) /
+        ((double)data.phase_time / 1000) : 0;
+    data.updated = QDateTime::currentMSecsSinceEpoch();
+    endWrite();
+}
+
+/*!
+ * Counts a failed operation.
+ */
+void
+LiveStats::addError()
+{
+    if (!segment) return;
+    beginWrite();
+    segment->data.errors++;
+    segment->data.updated = QDateTime::currentMSecsSinceEpoch();
+    endWrite();
+}
+
+/*!
+ * Sets the final state, the segment remains until close().
+ */
+void
+LiveStats::finish(bool success, int error_type)
+{
+    if (!segment) return;
+    beginWrite();
+    Data &data = segment->data;
+    data.state = success ? Succeeded : Failed;
+    data.error_type = error_type;
+    data.updated = QDateTime::currentMSecsSinceEpoch();
+    endWrite();
+}
+
+void
+LiveStats::beginWrite()
+{
+    segment->sequence.fetchAndAddAcquire(1); //odd
+}
+
+void
+LiveStats::endWrite()
+{
+    segment->sequence.fetchAndAddRelease(1); //even
+}
+
@@ -0,0 +1,427 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "partitiontester.hpp"
+
+/*! \class PartitionTester
+ *
+ * \brief The PartitionTester class tests all mounted partitions
+ * of a device, so a drive with several partitions is tested as a whole.
+ *
+ * Every partition is tested by a VolumeTester in its own thread.
+ * By default, one partition is tested after the other,
+ * as parallel tests would compete for the same device.
+ * The partitions are located on the device (sysfs),
+ * so the result can be reported with physical ranges.
+ * Unlike the testers, this object runs in the thread of the caller
+ * and is driven by the signals of the testers (event loop required).
+ *
+ */
+
+namespace
+{
+
+bool
+byStart(const PartitionTester::Partition &a,
+    const PartitionTester::Partition &b)
+{
+    return a.start < b.start;
+}
+
+}
+
+/*!
+ * Returns the whole device a partition or a mounted volume belongs to,
+ * e.g., /dev/sdb for a volume on /dev/sdb1 (Linux).
+ * Returns the device itself if it's not a partition
+ * or an empty string if there is no device.
+ */
+QString
+PartitionTester::parentDevice(const QString &path)
+{
+    QString device = path;
+    if (!DeviceTester::isDevice(path))
+        device = QString::fromLocal8Bit(QStorageInfo(path).device());
+    QString canonical = QFileInfo(device).canonicalFilePath();
+    if (canonical.isEmpty() || !DeviceTester::isDevice(canonical))
+        return QString();
+
+    //Partition, located in the sysfs directory of the disk
+    QString name = QFileInfo(canonical).fileName();
+    if (!QFileInfo("/sys/class/block/" + name + "/partition").exists())
+        return canonical;
+    QString sys_path =
+        QFileInfo("/sys/class/block/" + name).canonicalFilePath();
+    return "/dev/" + QFileInfo(QFileInfo(sys_path).path()).fileName();
+}
+
+/*!
+ * Constructs a PartitionTester for the device the specified volume
+ * is located on, or for the specified device.
+ * Mounted partitions that cannot be written are left out.
+ */
+PartitionTester::PartitionTester(const QString &path)
+               : device_size(0),
+                 parallel(1),
+                 safety_buffer(-1),
+                 single_pass(false),
+                 next_partition(0),
+                 running(0),
+                 success(true),
+                 _canceled(false)
+{
+    _device = parentDevice(path);
+    if (_device.isEmpty()) return;
+    device_size = sysfsBytes(QFileInfo(_device).fileName(), "size");
+
+    //Mounted partitions (each one once)
+    QStringList devices;
+    foreach (QStorageInfo storage, QStorageInfo::mountedVolumes())
+    {
+        QString device = QString::fromLocal8Bit(storage.device());
+        if (!device.startsWith("/dev/")) continue;
+        QString canonical = QFileInfo(device).canonicalFilePath();
+        if (devices.contains(canonical)) continue;
+        if (parentDevice(canonical) != _device) continue;
+        if (storage.isReadOnly() || !VolumeTester::isValid(storage.rootPath()))
+            continue;
+        devices << canonical;
+
+        //Location on device
+        QString name = QFileInfo(canonical).fileName();
+        Partition partition;
+        partition.device = canonical;
+        partition.mountpoint = storage.rootPath();
+        partition.start = sysfsBytes(name, "start");
+        partition.size = sysfsBytes(name, "size");
+        partition.tested = 0;
+        partition.written = 0;
+        partition.verified = 0;
+        partition.write_speed = 0;
+        partition.verify_speed = 0;
+        partition.failed_start = -1;
+        partition.failed_size = 0;
+        partition.error_type = 0;
+        partition.done = false;
+        _partitions << partition;
+    }
+    std::sort(_partitions.begin(), _partitions.end(), byStart);
+
+}
+
+/*!
+ * Returns true if at least one partition can be tested.
+ */
+bool
+PartitionTester::isValid()
+const
+{
+    return !_partitions.isEmpty();
+}
+
+QString
+PartitionTester::device()
+const
+{
+    return _device;
+}
+
+/*!
+ * Returns the size of the whole device (sysfs), 0 if unknown.
+ */
+qint64
+PartitionTester::deviceSize()
+const
+{
+    return device_size;
+}
+
+/*!
+ * Returns the partitions, ordered by their location on the device,
+ * with the current state of their tests.
+ */
+QList<PartitionTester::Partition>
+PartitionTester::partitions()
+const
+{
+    return _partitions;
+}
+
+/*!
+ * Changes the number of partitions tested at the same time.
+ * The default is 1 (one after the other).
+ */
+bool
+PartitionTester::setParallel(int count)
+{
+    if (count < 1) return false;
+    parallel = count;
+    return true;
+}
+
+/*!
+ * Changes the safety buffer of every partition,
+ * see VolumeTester::setSafetyBuffer().
+ */
+bool
+PartitionTester::setSafetyBuffer(int bytes)
+{
+    if (bytes < 0) return false;
+    safety_buffer = bytes;
+    return true;
+}
+
+/*!
+ * Selects the test data of every partition,
+ * see VolumeTester::setDataProvider().
+ */
+bool
+PartitionTester::setDataProvider(const QString &spec)
+{
+    DataProvider *provider = DataProvider::create(spec);
+    if (!provider) return false;
+    delete provider;
+    data_provider = spec;
+    return true;
+}
+
+/*!
+ * See VolumeTester::setSinglePass().
+ */
+void
+PartitionTester::setSinglePass(bool enabled)
+{
+    single_pass = enabled;
+}
+
+/*!
+ * Starts the tests, returns immediately.
+ * finished() is emitted after the last partition has been tested.
+ */
+void
+PartitionTester::start()
+{
+    next_partition = 0;
+    running = 0;
+    success = true;
+    _canceled = false;
+    if (_partitions.isEmpty())
+    {
+        emit finished(false);
+        return;
+    }
+    startNext();
+}
+
+/*!
+ * Aborts the running tests, the remaining partitions are not tested.
+ */
+void
+PartitionTester::cancel()
+{
+    _canceled = true;
+    foreach (QPointer<VolumeTester> tester, testers)
+    {
+        if (tester) tester->cancel();
+    }
+}
+
+void
+PartitionTester::testerStarted(qint64 total)
+{
+    int index = partitionIndex(sender());
+    if (index == -1) return;
+    _partitions[index].tested = total;
+}
+
+void
+PartitionTester::testerWritten(qint64 bytes, double avg_speed)
+{
+    int index = partitionIndex(sender());
+    if (index == -1) return;
+    _partitions[index].written = bytes;
+    _partitions[index].write_speed = avg_speed;
+    emit written(index, bytes, avg_speed);
+}
+
+void
+PartitionTester::testerVerified(qint64 bytes, double avg_speed)
+{
+    int index = partitionIndex(sender());
+    if (index == -1) return;
+    _partitions[index].verified = bytes;
+    _partitions[index].verify_speed = avg_speed;
+    emit verified(index, bytes, avg_speed);
+}
+
+void
+PartitionTester::testerCreateFailed(int index, qint64 start)
+{
+    Q_UNUSED(index);
+    testerFailed(start, 0);
+}
+
+void
+PartitionTester::testerFailed(qint64 start, int size)
+{
+    int index = partitionIndex(sender());
+    if (index == -1 || _partitions.at(index).failed_start != -1) return;
+    _partitions[index].failed_start = start;
+    _partitions[index].failed_size = size;
+}
+
+void
+PartitionTester::testerFinished(bool tester_success, int error_type)
+{
+    int index = partitionIndex(sender());
+    if (index == -1) return;
+    tester_index.remove(sender()); //address may be reused
+
+    Partition &partition = _partitions[index];
+    partition.done = true;
+    partition.error_type = tester_success ? 0 : error_type;
+    if (!tester_success) success = false;
+    running--;
+    emit partitionFinished(index, tester_success, partition.error_type);
+
+    startNext();
+}
+
+qint64
+PartitionTester::sysfsBytes(const QString &name, const QString &attribute)
+{
+    //Sizes and offsets in 512 B sectors
+    QFile file("/sys/class/block/" + name + "/" + attribute);
+    if (!file.open(QIODevice::ReadOnly)) return 0;
+    return file.readAll().trimmed().toLongLong() * 512;
+}
+
+/*!
+ * Starts the next tests, up to the number of parallel tests,
+ * or reports the result after the last one.
+ */
+void
+PartitionTester::startNext()
+{
+    while (running < parallel && next_partition < _partitions.size() &&
+        !_canceled)
+    {
+        int index = next_partition++;
+
+        //Worker, same settings for all partitions
+        VolumeTester *tester =
+            new VolumeTester(_partitions.at(index).mountpoint);
+        tester->setSafetyBuffer(safety_buffer);
+        tester->setSinglePass(single_pass);
+        if (!data_provider.isEmpty())
+            tester->setDataProvider(data_provider);
+        tester_index.insert(tester, index);
+        testers << tester;
+
+        //Thread for worker
+        QThread *thread = new QThread;
+        tester->moveToThread(thread);
+
+        //Start worker when thread starts
+        connect(thread,
+                SIGNAL(started()),
+                tester,
+                SLOT(start()));
+
+        //Size of test area
+        connect(tester,
+                SIGNAL(initializationStarted(qint64)),
+                this,
+                SLOT(testerStarted(qint64)));
+
+        //Written
+        connect(tester,
+                SIGNAL(written(qint64, double)),
+                this,
+                SLOT(testerWritten(qint64, double)));
+
+        //Verified
+        connect(tester,
+                SIGNAL(verified(qint64, double)),
+                this,
+                SLOT(testerVerified(qint64, double)));
+
+        //First error (offset within test area)
+        connect(tester,
+                SIGNAL(createFailed(int, qint64)),
+                this,
+                SLOT(testerCreateFailed(int, qint64)));
+        connect(tester,
+                SIGNAL(writeFailed(qint64, int)),
+                this,
+                SLOT(testerFailed(qint64, int)));
+        connect(tester,
+                SIGNAL(verifyFailed(qint64, int)),
+                this,
+                SLOT(testerFailed(qint64, int)));
+
+        //Test completed (successful or not)
+        connect(tester,
+                SIGNAL(finished(bool, int)),
+                this,
+                SLOT(testerFinished(bool, int)));
+
+        //Stop thread when worker done
+        connect(tester,
+                SIGNAL(finished()),
+                thread,
+                SLOT(quit()));
+
+        //Delete worker when done
+        connect(tester,
+                SIGNAL(finished()),
+                tester,
+                SLOT(deleteLater()));
+
+        //Delete thread when thread done
+        connect(thread,
+                SIGNAL(finished()),
+                thread,
+                SLOT(deleteLater()));
+
+        running++;
+        emit partitionStarted(index);
+        thread->start();
+    }
+
+    //Last test done
+    if (!running)
+    {
+        if (_canceled) success = false;
+        emit finished(success);
+    }
+}
+
+/*!
+ * Returns the partition tested by the specified tester
+ * (sender of a signal), -1 if unknown.
+ */
+int
+PartitionTester::partitionIndex(QObject *tester)
+const
+{
+    return tester_index.value(tester, -1);
+}
+
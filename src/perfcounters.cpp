@@ -0,0 +1,227 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "perfcounters.hpp"
+
+/*! \class PerfCounters
+ *
+ * \brief The PerfCounters class counts CPU cycles, instructions,
+ * cache misses and branch misses (perf_event_open, Linux).
+ *
+ * The counters are opened for the calling thread and inherited
+ * by threads it starts afterwards (e.g., parallel streams),
+ * whose counts are added when they exit.
+ * If the kernel does not allow counting kernel code
+ * (perf_event_paranoid), only user code is counted.
+ *
+ * Counters that cannot be opened (no PMU in a VM or container,
+ * seccomp, perf_event_paranoid 3) are unavailable, value() returns -1.
+ *
+ */
+
+namespace
+{
+
+#ifdef USE_PERF_COUNTERS
+int
+openCounter(quint64 config, bool exclude_kernel)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = exclude_kernel;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+}
+
+/*!
+ * Returns the names of the counters (keys of toVariantMap()).
+ */
+QStringList
+PerfCounters::names()
+{
+    return QStringList()
+        << "cycles"
+        << "instructions"
+        << "cache_misses"
+        << "branch_misses";
+}
+
+PerfCounters::PerfCounters()
+            : user_only(false)
+{
+    for (int i = 0; i < CounterCount; i++)
+    {
+        fds[i] = -1;
+        values[i] = -1;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    close();
+}
+
+/*!
+ * Opens the counters for the calling thread.
+ * Returns false if none of them is available.
+ */
+bool
+PerfCounters::open()
+{
+    close();
+
+    #ifdef USE_PERF_COUNTERS
+    const quint64 configs[CounterCount] =
+    {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    user_only = false;
+    for (int i = 0; i < CounterCount; i++)
+    {
+        fds[i] = openCounter(configs[i], user_only);
+        if (fds[i] == -1 && errno == EACCES && !user_only)
+        {
+            //Kernel not allowed, user code only (all counters)
+            user_only = true;
+            for (int j = 0; j < i; j++)
+            {
+                ::close(fds[j]);
+                fds[j] = openCounter(configs[j], true);
+            }
+            fds[i] = openCounter(configs[i], true);
+        }
+    }
+    #endif
+
+    return isAvailable();
+}
+
+void
+PerfCounters::close()
+{
+    for (int i = 0; i < CounterCount; i++)
+    {
+        #ifdef USE_PERF_COUNTERS
+        if (fds[i] != -1) ::close(fds[i]);
+        #endif
+        fds[i] = -1;
+        values[i] = -1;
+    }
+}
+
+bool
+PerfCounters::isAvailable()
+const
+{
+    for (int i = 0; i < CounterCount; i++)
+        if (fds[i] != -1) return true;
+    return false;
+}
+
+/*!
+ * Returns true if kernel code is not counted (perf_event_paranoid).
+ */
+bool
+PerfCounters::isUserOnly()
+const
+{
+    return user_only;
+}
+
+/*!
+ * Resets and enables the counters.
+ */
+void
+PerfCounters::start()
+{
+    #ifdef USE_PERF_COUNTERS
+    for (int i = 0; i < CounterCount; i++)
+    {
+        values[i] = -1;
+        if (fds[i] == -1) continue;
+        ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+    #endif
+}
+
+/*!
+ * Disables the counters and reads them. If the counters had to share
+ * the hardware (multiplexing), the values are extrapolated.
+ */
+void
+PerfCounters::stop()
+{
+    #ifdef USE_PERF_COUNTERS
+    for (int i = 0; i < CounterCount; i++)
+    {
+        if (fds[i] == -1) continue;
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        //Value, time enabled, time running
+        quint64 data[3];
+        if (read(fds[i], data, sizeof(data)) != (ssize_t)sizeof(data))
+            continue;
+        if (!data[2]) continue; //never scheduled
+        values[i] = data[2] < data[1] ?
+            (qint64)((double)data[0] * data[1] / data[2]) : (qint64)data[0];
+    }
+    #endif
+}
+
+/*!
+ * Returns the value of the specified counter since the last start()
+ * or -1 if it's not available.
+ */
+qint64
+PerfCounters::value(Counter counter)
+const
+{
+    return values[counter];
+}
+
+/*!
+ * Returns the available values by name (see names()).
+ */
+QVariantMap
+PerfCounters::toVariantMap()
+const
+{
+    QVariantMap map;
+    QStringList keys = names();
+    for (int i = 0; i < CounterCount; i++)
+        if (values[i] >= 0) map[keys.at(i)] = values[i];
+    if (!map.isEmpty()) map["user_only"] = user_only;
+    return map;
+}
+
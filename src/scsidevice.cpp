@@ -0,0 +1,415 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "scsidevice.hpp"
+
+/*! \class ScsiDevice
+ *
+ * \brief The ScsiDevice class sends SCSI commands to a device
+ * using the SG_IO pass-through interface (Linux only).
+ *
+ * USB mass storage devices are SCSI devices, so this bypasses
+ * the block layer and talks to the device (or the USB bridge) directly.
+ * The path can be a SCSI generic device (/dev/sg1) or a disk (/dev/sdb).
+ *
+ * Requests are sent exactly as specified, they are not split or merged.
+ * The kernel limits the size of a single request (max_sectors_kb),
+ * larger requests fail.
+ *
+ */
+
+namespace
+{
+
+inline void
+putBigEndian(uchar *p, quint64 value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        p[i] = value & 0xFF;
+        value >>= 8;
+    }
+}
+
+inline quint64
+getBigEndian(const uchar *p, int bytes)
+{
+    quint64 value = 0;
+    for (int i = 0; i < bytes; i++)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+}
+
+/*!
+ * Returns true if SG_IO is supported on this platform.
+ */
+bool
+ScsiDevice::isSupported()
+{
+    #if defined(__linux__) && defined(SG_IO)
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+ScsiDevice::ScsiDevice(const QString &path)
+          : _path(path),
+            fd(-1),
+            timeout(60000),
+            block_length(0)
+{
+}
+
+ScsiDevice::~ScsiDevice()
+{
+    close();
+}
+
+void
+ScsiDevice::setPath(const QString &path)
+{
+    close();
+    _path = path;
+}
+
+QString
+ScsiDevice::path()
+const
+{
+    return _path;
+}
+
+/*!
+ * Opens the device, read-only unless writable is set.
+ */
+bool
+ScsiDevice::open(bool writable)
+{
+    close();
+    if (!isSupported())
+    {
+        error = "SG_IO not supported";
+        return false;
+    }
+
+    int flags = writable ? O_RDWR : O_RDONLY;
+    #if defined(O_NONBLOCK)
+    flags |= O_NONBLOCK; //don't wait for exclusive access
+    #endif
+    fd = ::open(QFile::encodeName(_path).constData(), flags);
+    if (fd == -1)
+    {
+        error = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+
+    #if defined(__linux__) && defined(SG_GET_VERSION_NUM)
+    int version = 0;
+    if (ioctl(fd, SG_GET_VERSION_NUM, &version) < 0 || version < 30000)
+    {
+        error = "not an SG_IO capable device";
+        close();
+        return false;
+    }
+    #endif
+
+    return true;
+}
+
+void
+ScsiDevice::close()
+{
+    if (fd != -1) ::close(fd);
+    fd = -1;
+    block_length = 0;
+}
+
+bool
+ScsiDevice::isOpen()
+const
+{
+    return fd != -1;
+}
+
+/*!
+ * Sends INQUIRY and returns the vendor, product and revision strings.
+ */
+bool
+ScsiDevice::inquiry(QString *vendor, QString *product, QString *revision)
+{
+    uchar response[96];
+    memset(response, 0, sizeof(response));
+    uchar cdb[6] = { 0x12, 0, 0, 0, sizeof(response), 0 };
+    //Standard response is 36 bytes, longer allocation length is allowed
+    if (!command(cdb, sizeof(cdb), FromDevice, response, sizeof(response), 36))
+        return false;
+
+    if (vendor)
+        *vendor = QString::fromLatin1((char*)response + 8, 8).trimmed();
+    if (product)
+        *product = QString::fromLatin1((char*)response + 16, 16).trimmed();
+    if (revision)
+        *revision = QString::fromLatin1((char*)response + 32, 4).trimmed();
+
+    return true;
+}
+
+/*!
+ * Returns the capacity the device claims to have,
+ * using READ CAPACITY(16) or READ CAPACITY(10) if that's not supported.
+ * The block length is remembered for subsequent read and write requests.
+ */
+bool
+ScsiDevice::readCapacity(qint64 *blocks, int *block_size)
+{
+    quint64 last_lba = 0;
+    quint32 length = 0;
+
+    //READ CAPACITY(16), SERVICE ACTION IN(16)
+    uchar response[32];
+    memset(response, 0, sizeof(response));
+    uchar cdb16[16];
+    memset(cdb16, 0, sizeof(cdb16));
+    cdb16[0] = 0x9E;
+    cdb16[1] = 0x10;
+    putBigEndian(cdb16 + 10, sizeof(response), 4);
+    if (command(cdb16, sizeof(cdb16), FromDevice,
+        response, sizeof(response), 12))
+    {
+        last_lba = getBigEndian(response, 8);
+        length = getBigEndian(response + 8, 4);
+    }
+    else
+    {
+        //READ CAPACITY(10), not all USB bridges support 16-byte commands
+        uchar cdb10[10];
+        memset(cdb10, 0, sizeof(cdb10));
+        cdb10[0] = 0x25;
+        memset(response, 0, sizeof(response));
+        if (!command(cdb10, sizeof(cdb10), FromDevice, response, 8))
+            return false;
+        last_lba = getBigEndian(response, 4);
+        length = getBigEndian(response + 4, 4);
+    }
+
+    if (!length)
+    {
+        error = "invalid block length";
+        return false;
+    }
+
+    block_length = length;
+    if (blocks) *blocks = last_lba + 1;
+    if (block_size) *block_size = length;
+    return true;
+}
+
+/*!
+ * Reads the specified number of blocks with a single READ command.
+ * READ(10) is used if possible, READ(16) for large devices.
+ */
+bool
+ScsiDevice::read(qint64 lba, int blocks, char *data)
+{
+    //Size is a multiple of the block length
+    if (!block_length && !readCapacity(0, 0)) return false;
+
+    uchar cdb[16];
+    memset(cdb, 0, sizeof(cdb));
+    int cdb_size = 10;
+    if (lba + blocks <= 0xFFFFFFFFLL && blocks <= 0xFFFF)
+    {
+        cdb[0] = 0x28;
+        putBigEndian(cdb + 2, lba, 4);
+        putBigEndian(cdb + 7, blocks, 2);
+    }
+    else
+    {
+        cdb_size = 16;
+        cdb[0] = 0x88;
+        putBigEndian(cdb + 2, lba, 8);
+        putBigEndian(cdb + 10, blocks, 4);
+    }
+
+    return command(cdb, cdb_size, FromDevice, data, blocks * block_length);
+}
+
+/*!
+ * Writes the specified number of blocks with a single WRITE command.
+ * WRITE(10) is used if possible, WRITE(16) for large devices.
+ */
+bool
+ScsiDevice::write(qint64 lba, int blocks, const char *data)
+{
+    if (!block_length && !readCapacity(0, 0)) return false;
+
+    uchar cdb[16];
+    memset(cdb, 0, sizeof(cdb));
+    int cdb_size = 10;
+    if (lba + blocks <= 0xFFFFFFFFLL && blocks <= 0xFFFF)
+    {
+        cdb[0] = 0x2A;
+        putBigEndian(cdb + 2, lba, 4);
+        putBigEndian(cdb + 7, blocks, 2);
+    }
+    else
+    {
+        cdb_size = 16;
+        cdb[0] = 0x8A;
+        putBigEndian(cdb + 2, lba, 8);
+        putBigEndian(cdb + 10, blocks, 4);
+    }
+
+    return command(cdb, cdb_size, ToDevice, (void*)data, blocks * block_length);
+}
+
+/*!
+ * Asks the device to write its cache to the medium (SYNCHRONIZE CACHE).
+ */
+bool
+ScsiDevice::synchronizeCache()
+{
+    //SYNCHRONIZE CACHE(10), entire device
+    uchar cdb[10];
+    memset(cdb, 0, sizeof(cdb));
+    cdb[0] = 0x35;
+    return command(cdb, sizeof(cdb), None, 0, 0);
+}
+
+/*!
+ * Changes the command timeout. The default value is 60 seconds.
+ */
+bool
+ScsiDevice::setTimeout(int msec)
+{
+    if (msec <= 0) return false;
+    timeout = msec;
+    return true;
+}
+
+/*!
+ * Returns a description of the last error, including sense data.
+ */
+QString
+ScsiDevice::errorString()
+const
+{
+    return error;
+}
+
+/*!
+ * Sends a single command through SG_IO.
+ * The whole buffer must be transferred unless required is given,
+ * in which case a short response of at least that many bytes is accepted
+ * (INQUIRY and READ CAPACITY allocation lengths may exceed the response).
+ */
+bool
+ScsiDevice::command(const uchar *cdb, int cdb_size, Direction direction,
+    void *data, int size, int required)
+{
+    error.clear();
+    if (fd == -1)
+    {
+        error = "device not open";
+        return false;
+    }
+
+    #if defined(__linux__) && defined(SG_IO)
+    uchar sense[32];
+    memset(sense, 0, sizeof(sense));
+
+    sg_io_hdr_t io;
+    memset(&io, 0, sizeof(io));
+    io.interface_id = 'S';
+    io.cmdp = (uchar*)cdb;
+    io.cmd_len = cdb_size;
+    io.sbp = sense;
+    io.mx_sb_len = sizeof(sense);
+    io.dxferp = data;
+    io.dxfer_len = size;
+    io.timeout = timeout;
+    if (direction == FromDevice)
+        io.dxfer_direction = SG_DXFER_FROM_DEV;
+    else if (direction == ToDevice)
+        io.dxfer_direction = SG_DXFER_TO_DEV;
+    else
+        io.dxfer_direction = SG_DXFER_NONE;
+
+    //Send command
+    if (ioctl(fd, SG_IO, &io) < 0)
+    {
+        //Request rejected by the kernel, e.g., too large (EINVAL, ENOMEM)
+        error = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+
+    //Check status, residual (bytes not transferred)
+    if (required < 0) required = size;
+    if ((io.info & SG_INFO_OK_MASK) != SG_INFO_OK ||
+        io.resid < 0 || size - io.resid < required)
+    {
+        int key = 0, asc = 0, ascq = 0;
+        if (io.sb_len_wr > 0)
+        {
+            if ((sense[0] & 0x7F) >= 0x72)
+            {
+                //Descriptor format
+                key = sense[1] & 0x0F;
+                asc = sense[2];
+                ascq = sense[3];
+            }
+            else
+            {
+                //Fixed format
+                key = sense[2] & 0x0F;
+                asc = sense[12];
+                ascq = sense[13];
+            }
+        }
+        error = QString(
+            "command %1 failed: status 0x%2, host 0x%3, driver 0x%4, "
+            "sense %5/%6/%7, residual %8").
+            arg(cdb[0], 2, 16, QChar('0')).
+            arg(io.status, 2, 16, QChar('0')).
+            arg(io.host_status, 2, 16, QChar('0')).
+            arg(io.driver_status, 2, 16, QChar('0')).
+            arg(key, 1, 16).
+            arg(asc, 2, 16, QChar('0')).
+            arg(ascq, 2, 16, QChar('0')).
+            arg(io.resid);
+        return false;
+    }
+
+    return true;
+    #else
+    Q_UNUSED(cdb);
+    Q_UNUSED(cdb_size);
+    Q_UNUSED(direction);
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    Q_UNUSED(required);
+    error = "SG_IO not supported";
+    return false;
+    #endif
+}
+
@@ -0,0 +1,154 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "throughputhistory.hpp"
+
+/*! \class ThroughputHistory
+ *
+ * \brief The ThroughputHistory class remembers the throughput
+ * measured in previous tests, per drive model and filesystem.
+ *
+ * The speeds of the last 10 tests of each phase are stored
+ * in the user's settings (CapacityTester/history.ini) with their average.
+ * It's used to estimate how long a test will take (see VolumeTester::plan()).
+ * The key consists of vendor, model and size of the disk
+ * and the filesystem type, as the initialization on FAT/exFAT writes
+ * the whole drive while other filesystems only allocate the files.
+ *
+ */
+
+/*!
+ * Returns the key for the drive the specified volume is located on,
+ * an empty string if the volume is not valid.
+ */
+QString
+ThroughputHistory::key(const QString &mountpoint)
+{
+    QStorageInfo storage(mountpoint);
+    if (!storage.isValid()) return QString();
+    QString device = QString::fromLocal8Bit(storage.device());
+    QString type = QString::fromLatin1(storage.fileSystemType());
+
+    //Disk of partition (sysfs), the partition has no device directory
+    QString drive = device;
+    QString canonical = QFileInfo(device).canonicalFilePath();
+    if (!canonical.isEmpty())
+    {
+        QString sys_path = QFileInfo("/sys/class/block/" +
+            QFileInfo(canonical).fileName()).canonicalFilePath();
+        if (!QFileInfo(sys_path + "/device").exists())
+            sys_path = QFileInfo(sys_path).path();
+        QString model = (sysfsValue(sys_path + "/device/vendor") + " " +
+            sysfsValue(sys_path + "/device/model")).trimmed();
+        qint64 size = sysfsValue(sys_path + "/size").toLongLong() * 512;
+        if (!model.isEmpty() && size)
+            drive = QString("%1 %2").arg(model).arg(size);
+    }
+
+    //Settings key, no separators
+    QString key = drive + " " + type;
+    for (int i = 0; i < key.size(); i++)
+    {
+        if (!key.at(i).isLetterOrNumber()) key[i] = '_';
+    }
+    return key;
+}
+
+ThroughputHistory::ThroughputHistory(const QString &key)
+                 : group(key)
+{
+}
+
+bool
+ThroughputHistory::isValid()
+const
+{
+    return !group.isEmpty();
+}
+
+/*!
+ * Returns the average speed (MB/s) of the specified test phase,
+ * 0 if it has not been measured yet.
+ */
+double
+ThroughputHistory::speed(int phase)
+const
+{
+    if (!isValid()) return 0;
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope,
+        "CapacityTester", "history");
+    return settings.value(QString("%1/speed%2").arg(group).arg(phase)).
+        toDouble();
+}
+
+/*!
+ * Returns the number of tests the average of the specified phase
+ * is based on (up to 10).
+ */
+int
+ThroughputHistory::count(int phase)
+const
+{
+    if (!isValid()) return 0;
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope,
+        "CapacityTester", "history");
+    return settings.value(QString("%1/count%2").arg(group).arg(phase)).
+        toInt();
+}
+
+/*!
+ * Adds the throughput of a completed test phase
+ * (bytes, runtime in milliseconds).
+ */
+void
+ThroughputHistory::add(int phase, qint64 bytes, qint64 runtime)
+{
+    if (!isValid() || bytes <= 0 || runtime <= 0) return;
+    double mb_per_s = ((double)bytes / (1024 * 1024)) /
+        ((double)runtime / 1000);
+
+    //Average of the last tests (oldest one dropped)
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope,
+        "CapacityTester", "history");
+    settings.beginGroup(group);
+    QString speed_key = QString("speed%1").arg(phase);
+    QString count_key = QString("count%1").arg(phase);
+    QString speeds_key = QString("speeds%1").arg(phase);
+    QStringList speeds = settings.value(speeds_key).toStringList();
+    speeds << QString::number(mb_per_s);
+    while (speeds.size() > MAX_COUNT)
+        speeds.removeFirst();
+    double sum = 0;
+    foreach (QString value, speeds)
+        sum += value.toDouble();
+    settings.setValue(speeds_key, speeds);
+    settings.setValue(speed_key, sum / speeds.size());
+    settings.setValue(count_key, speeds.size());
+    settings.endGroup();
+}
+
+QString
+ThroughputHistory::sysfsValue(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QString();
+    return QString::fromLocal8Bit(file.readAll()).trimmed();
+}
+
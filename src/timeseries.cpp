@@ -0,0 +1,231 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "timeseries.hpp"
+
+/*! \class TimeSeries
+ *
+ * \brief The TimeSeries class keeps a series of samples
+ * (e.g., the throughput of each block) in constant memory.
+ *
+ * Recent samples are kept at full resolution (level 0).
+ * When a level is full, its older half is merged into buckets
+ * of factor samples each (count, min, max, sum), which are moved
+ * to the next level. The last level halves its own resolution instead.
+ * So each level covers a time range factor times longer
+ * than the previous one. With the defaults (512 buckets, factor 4,
+ * 12 levels), less than 300 KB cover about two billion samples.
+ *
+ * All levels are allocated up front, add() does not allocate memory.
+ * Times are in milliseconds, samples must be added in order.
+ *
+ * Thread-safe, it can be queried while samples are added.
+ *
+ */
+
+/*!
+ * Returns the average value of the samples in the bucket.
+ */
+double
+TimeSeries::mean(const Bucket &bucket)
+{
+    return bucket.count ? bucket.sum / bucket.count : 0;
+}
+
+/*!
+ * Returns the buckets as list of maps (begin, end, count, min, mean, max),
+ * e.g., to be saved as JSON.
+ */
+QVariantList
+TimeSeries::toVariantList(const QVector<Bucket> &buckets)
+{
+    QVariantList list;
+    foreach (const Bucket &bucket, buckets)
+    {
+        QVariantMap map;
+        map["begin"] = bucket.begin;
+        map["end"] = bucket.end;
+        map["count"] = bucket.count;
+        map["min"] = bucket.min;
+        map["mean"] = mean(bucket);
+        map["max"] = bucket.max;
+        list << map;
+    }
+    return list;
+}
+
+TimeSeries::TimeSeries(int capacity, int factor, int levels)
+          : capacity(qMax(capacity, 2 * factor)),
+            factor(qMax(factor, 2)),
+            levels(qMax(levels, 1))
+{
+    for (int i = 0; i < this->levels.size(); i++)
+        this->levels[i].reserve(this->capacity);
+    clear();
+}
+
+void
+TimeSeries::clear()
+{
+    QMutexLocker locker(&mutex);
+    for (int i = 0; i < levels.size(); i++)
+        levels[i].resize(0); //keeps capacity
+    memset(&total, 0, sizeof(total));
+}
+
+/*!
+ * Adds a sample taken from begin to end (ms).
+ */
+void
+TimeSeries::add(qint64 begin, qint64 end, double value)
+{
+    Bucket bucket;
+    bucket.begin = begin;
+    bucket.end = end;
+    bucket.count = 1;
+    bucket.min = value;
+    bucket.max = value;
+    bucket.sum = value;
+
+    QMutexLocker locker(&mutex);
+    merge(total, bucket);
+    if (levels[0].size() == capacity) compact(0);
+    levels[0] << bucket;
+}
+
+/*!
+ * Returns a single bucket with all samples.
+ */
+TimeSeries::Bucket
+TimeSeries::summary()
+const
+{
+    QMutexLocker locker(&mutex);
+    return total;
+}
+
+/*!
+ * Returns the buckets overlapping the time range from - to (ms),
+ * oldest first. Older buckets contain more samples.
+ * If max_count is set, adjacent buckets are merged to return
+ * no more than max_count buckets (e.g., one per pixel).
+ */
+QVector<TimeSeries::Bucket>
+TimeSeries::buckets(int max_count, qint64 from, qint64 to)
+const
+{
+    QVector<Bucket> result;
+    {
+        QMutexLocker locker(&mutex);
+
+        //Oldest (coarsest) level first, levels don't overlap
+        for (int i = levels.size() - 1; i >= 0; i--)
+        {
+            const QVector<Bucket> &level = levels.at(i);
+            for (int j = 0, jj = level.size(); j < jj; j++)
+            {
+                const Bucket &bucket = level.at(j);
+                if (bucket.end < from) continue;
+                if (to >= 0 && bucket.begin > to) continue;
+                result << bucket; //copied, levels not shared
+            }
+        }
+    }
+    if (max_count <= 0 || result.size() <= max_count) return result;
+
+    //Merge groups of adjacent buckets
+    int group = (result.size() + max_count - 1) / max_count;
+    QVector<Bucket> merged;
+    merged.reserve(max_count);
+    for (int i = 0, ii = result.size(); i < ii; i += group)
+    {
+        Bucket bucket = result.at(i);
+        for (int j = i + 1; j < qMin(i + group, ii); j++)
+            merge(bucket, result.at(j));
+        merged << bucket;
+    }
+    return merged;
+}
+
+/*!
+ * Returns the number of bytes allocated for the buckets,
+ * which does not grow with the number of samples.
+ */
+qint64
+TimeSeries::memoryUsage()
+const
+{
+    return (qint64)levels.size() * capacity * sizeof(Bucket);
+}
+
+void
+TimeSeries::merge(Bucket &into, const Bucket &bucket)
+{
+    if (!into.count)
+    {
+        into = bucket;
+        return;
+    }
+    into.begin = qMin(into.begin, bucket.begin);
+    into.end = qMax(into.end, bucket.end);
+    into.count += bucket.count;
+    into.min = qMin(into.min, bucket.min);
+    into.max = qMax(into.max, bucket.max);
+    into.sum += bucket.sum;
+}
+
+/*!
+ * Makes room in a full level by moving its older half
+ * to the next level, merged (factor buckets into one).
+ * The last level halves its resolution instead.
+ */
+void
+TimeSeries::compact(int level)
+{
+    QVector<Bucket> &buckets = levels[level];
+
+    //Last level, merge pairs in place
+    if (level == levels.size() - 1)
+    {
+        int count = 0;
+        for (int i = 0, ii = buckets.size(); i < ii; i += 2)
+        {
+            Bucket bucket = buckets.at(i);
+            if (i + 1 < ii) merge(bucket, buckets.at(i + 1));
+            buckets[count++] = bucket;
+        }
+        buckets.resize(count);
+        return;
+    }
+
+    //Older half, in groups of factor buckets
+    int half = capacity / 2 / factor * factor;
+    QVector<Bucket> &next = levels[level + 1];
+    for (int i = 0; i < half; i += factor)
+    {
+        Bucket bucket = buckets.at(i);
+        for (int j = i + 1; j < i + factor; j++)
+            merge(bucket, buckets.at(j));
+        if (next.size() == capacity) compact(level + 1);
+        next << bucket;
+    }
+    buckets.remove(0, half);
+}
+
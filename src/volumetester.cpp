@@ -49,6 +49,9 @@
  * As a courtesy to the user, this tester will clean up after itself
  * and remove all test files afterwards.
  *
+ * Network filesystems (NFS, SMB) are tested with the network profile,
+ * see setNetworkProfile().
+ *
  */
 
 #if defined(_WIN32) && !defined(NO_FSYNC)
@@ -98,6 +101,128 @@ fsync(int fd)
 }
 #endif
 
+/*! \class VolumeTester::Stream
+ *
+ * \brief One of several threads writing or verifying test files
+ * in parallel, see runStreams(), or sending workload requests,
+ * see runWorkload().
+ */
+class VolumeTester::Stream : public QThread
+{
+public:
+
+    Stream(VolumeTester *tester, int index, int phase)
+         : tester(tester),
+           index(index),
+           phase(phase),
+           ok(false)
+    {
+    }
+
+    bool
+    succeeded() const
+    {
+        return ok;
+    }
+
+protected:
+
+    void
+    run()
+    {
+        AllocationCounter::Counts before = AllocationCounter::current();
+        if (phase == Phase::Verify)
+            ok = tester->verifyStream(index);
+        else if (phase == Phase::Workload)
+            ok = tester->workloadStream(index);
+        else
+            ok = tester->writeStream(index);
+        AllocationCounter::Counts after = AllocationCounter::current();
+        tester->stream_allocations.fetchAndAddRelaxed(
+            after.count - before.count);
+        tester->stream_allocated_bytes.fetchAndAddRelaxed(
+            after.bytes - before.bytes);
+    }
+
+private:
+
+    VolumeTester
+    *tester;
+
+    int
+    index;
+
+    int
+    phase;
+
+    bool
+    ok;
+
+};
+
+/*! \class VolumeTester::Watchdog
+ *
+ * \brief Thread watching the progress of a test,
+ * which dumps the flight recorder if no block has been completed
+ * for a while (stall).
+ */
+class VolumeTester::Watchdog : public QThread
+{
+public:
+
+    Watchdog(VolumeTester *tester, int timeout)
+           : tester(tester),
+             timeout(timeout),
+             stopped(0)
+    {
+    }
+
+    void
+    stop()
+    {
+        stopped.store(1);
+    }
+
+protected:
+
+    void
+    run()
+    {
+        qint64 started = tester->test_timer.elapsed();
+        bool reported = false;
+        while (!stopped.load())
+        {
+            msleep(250);
+            qint64 now = tester->test_timer.elapsed();
+            qint64 activity =
+                qMax(started, tester->flight_recorder.lastActivity());
+            qint64 idle = now - activity;
+            if (idle < timeout)
+            {
+                reported = false; //progress again
+            }
+            else if (!reported)
+            {
+                reported = true;
+                emit tester->flightRecord(tester->flight_recorder.dump(
+                    QString("no progress for %1 s").arg(idle / 1000)));
+            }
+        }
+    }
+
+private:
+
+    VolumeTester
+    *tester;
+
+    int
+    timeout;
+
+    QAtomicInt
+    stopped;
+
+};
+
 /*!
  * Checks if the provided string is a valid mountpoint.
  */
@@ -156,8 +281,39 @@ VolumeTester::VolumeTester(const QString &mountpoint)
               bytes_remaining(0),
               _canceled(false),
               success(true),
-              error_type(Error::Unknown)
+              error_type(Error::Unknown),
+              network_profile(false),
+              stream_count(1),
+              stream_error(0),
+              stream_bytes(0),
+              stream_allocations(0),
+              stream_allocated_bytes(0),
+              stream_failed_start(0),
+              stream_failed_size(0),
+              remount_volume(false),
+              single_pass(false),
+              sentinel_check(false),
+              sentinel_reads(0),
+              sentinel_bytes(0),
+              sentinel_time(0),
+              verify_sampling(100),
+              discard_free_space(false),
+              flight_recorder(QStringList() << "" << "init" << "write" <<
+                  "verify" << "workload"),
+              throughput_series(new TimeSeries),
+              latency_series(new TimeSeries),
+              phase_bytes(0),
+              phase_begin(0),
+              warmup(0),
+              aging_percent(0),
+              aging_seed(1),
+              workload_end(0),
+              capture_neighborhood(0),
+              perf_enabled(false)
 {
+    workload_bytes[0] = 0;
+    workload_bytes[1] = 0;
+
     //Default safety buffer
     #if defined(SAFETY_BUFFER)
     safety_buffer = SAFETY_BUFFER;
@@ -190,6 +346,287 @@ VolumeTester::setSafetyBuffer(int new_buffer)
     return true;
 }
 
+/*!
+ * Selects the test data, see DataProvider::create().
+ * Returns false if the specified provider is unknown or invalid,
+ * in which case the previously selected provider is kept.
+ *
+ * By default, a random pattern is used.
+ */
+bool
+VolumeTester::setDataProvider(const QString &spec)
+{
+    DataProvider *provider = DataProvider::create(spec);
+    if (!provider) return false;
+    data_provider.reset(provider);
+    return true;
+}
+
+/*!
+ * Returns the name (and argument) of the selected test data provider.
+ */
+QString
+VolumeTester::dataProvider()
+const
+{
+    QString spec = "random";
+    if (data_provider) spec = data_provider->spec();
+    return spec;
+}
+
+/*!
+ * Enables or disables the network profile for NFS or SMB shares.
+ *
+ * Per-block fsync() calls and a single stream of 16 MB writes
+ * only use a fraction of the link speed of a network filesystem.
+ * With this profile, larger blocks are written by several streams
+ * (see setStreamCount()) in parallel, each file is flushed once
+ * when it's complete and then closed (close-to-open consistency).
+ * For verification, every file is reopened, so the client revalidates it,
+ * and read without using the client's cache (O_DIRECT where available).
+ */
+void
+VolumeTester::setNetworkProfile(bool enabled)
+{
+    network_profile = enabled;
+    if (enabled)
+    {
+        block_size_max = 64 * MB;
+        file_size_max = 1024 * MB;
+        stream_count = 8;
+    }
+    else
+    {
+        block_size_max = 16 * MB;
+        file_size_max = 512 * MB;
+        stream_count = 1;
+    }
+}
+
+/*!
+ * Returns true if the volume can be unmounted and mounted again
+ * during a test, which requires root privileges.
+ */
+bool
+VolumeTester::canRemount()
+{
+    #if defined(__linux__)
+    return geteuid() == 0;
+    #else
+    return false;
+    #endif
+}
+
+/*!
+ * Returns true if the block with the specified index is part
+ * of a sample of the specified percentage.
+ * The selection is spread evenly but not regularly across the volume
+ * (multiplicative hash), the same blocks are selected every time.
+ */
+bool
+VolumeTester::isSampled(qint64 index, int percent)
+{
+    if (percent >= 100) return true;
+    if (percent <= 0) return false;
+    quint32 hash = (quint32)index * 2654435761U;
+    return (hash >> 16) % 100 < (quint32)percent;
+}
+
+/*!
+ * Unmounts and mounts the volume again (same options)
+ * between the write and the verify phase, so nothing is left in any cache
+ * (including userspace caches of FUSE filesystems)
+ * and all data has to be read from the device.
+ * The test files are reopened by path after mounting the volume.
+ *
+ * This requires root privileges (see canRemount()). Disabled by default.
+ */
+void
+VolumeTester::setRemount(bool enabled)
+{
+    remount_volume = enabled;
+}
+
+/*!
+ * Creates the test files by writing the test data,
+ * without a separate initialization phase.
+ *
+ * Growing a file with resize() makes some filesystems (FAT, exFAT)
+ * write zeros to the whole file, which is then overwritten
+ * by the write phase, so the volume would be written twice.
+ * In this mode, the files grow as the blocks are written.
+ * Each file is checked right after it has been written
+ * (id of the first block, end of the last block) and all files
+ * are checked again at the end of the write phase,
+ * like after the initialization. Disabled by default.
+ */
+void
+VolumeTester::setSinglePass(bool enabled)
+{
+    single_pass = enabled;
+}
+
+/*!
+ * Writes every block synchronously (O_DSYNC) and reads back
+ * three sentinels of 4 KB right after it, bypassing the cache:
+ * the start, the end and a pseudo-random position in the middle.
+ * A write the drive has acknowledged but dropped is detected
+ * at the block that caused it, not only in the verify phase,
+ * at a small fraction of the cost of reading the whole block.
+ * The reads and their time are reported with the statistics
+ * of the write phase. Not used with the network profile.
+ * Returns false if not supported (Windows).
+ */
+bool
+VolumeTester::setSentinelCheck(bool enabled)
+{
+    #if defined(_WIN32) || !defined(O_DSYNC)
+    if (enabled) return false;
+    #endif
+    sentinel_check = enabled;
+    return true;
+}
+
+/*!
+ * Verifies only the specified percentage of the blocks,
+ * selected by isSampled(). 0 skips the verification, 100 (default)
+ * verifies all blocks. Used to wipe free space faster.
+ */
+bool
+VolumeTester::setVerifySampling(int percent)
+{
+    if (percent < 0 || percent > 100) return false;
+    verify_sampling = percent;
+    return true;
+}
+
+/*!
+ * Discards the free space (FITRIM) after the test files have been removed,
+ * which requires root privileges (Linux). See discarded().
+ * Disabled by default.
+ */
+void
+VolumeTester::setDiscard(bool enabled)
+{
+    discard_free_space = enabled;
+}
+
+/*!
+ * Counts CPU cycles, instructions, cache misses and branch misses
+ * per phase (see PerfCounters), reported by phaseStatistics()
+ * as "counters". Disabled by default.
+ */
+void
+VolumeTester::setPerfCounters(bool enabled)
+{
+    perf_enabled = enabled;
+}
+
+/*!
+ * Excludes the blocks started in the first seconds of each phase
+ * from the benchmark statistics (warm-up, like fio's ramp_time).
+ * The statistics are reported by phaseStatistics() as "benchmark"
+ * (see BenchmarkStatistics), the default is no warm-up.
+ */
+bool
+VolumeTester::setWarmup(int seconds)
+{
+    if (seconds < 0) return false;
+    warmup = (qint64)seconds * 1000000000;
+    return true;
+}
+
+/*!
+ * Ages the filesystem before the test: the specified percentage
+ * of the available space is filled with files of mixed sizes
+ * (4 KB to 32 MB), then about half of them are deleted,
+ * so the test files are written into fragmented free space.
+ * The same seed creates the same files in the same order.
+ * The remaining files are deleted after the test.
+ * Throughput of an aged test is not added to the ThroughputHistory.
+ * 0 (default) disables aging, more than 90 percent is not accepted.
+ */
+bool
+VolumeTester::setAging(int percent, quint64 seed)
+{
+    if (percent < 0 || percent > 90) return false;
+    aging_percent = percent;
+    aging_seed = seed;
+    return true;
+}
+
+/*!
+ * Runs a mixed read/write workload (see Workload) over the test files
+ * after they have been written, before they are verified.
+ * Writes put the same test data at the same place again,
+ * reads are verified, so the verification is still valid afterwards.
+ * The queue depth is the number of streams sending requests.
+ * Throughput and latencies per request type are reported
+ * by phaseStatistics() as "read" and "write".
+ * An empty spec disables the workload (default).
+ */
+bool
+VolumeTester::setWorkload(const QString &spec)
+{
+    Workload new_workload(spec);
+    if (!spec.isEmpty() && !new_workload.isValid()) return false;
+    workload = new_workload;
+    return true;
+}
+
+/*!
+ * Saves the contents of failing regions to the specified file
+ * on the host (see ForensicCapture) as soon as they are found:
+ * the data that has been read (or read again after a dropped write)
+ * and up to neighborhood bytes before and after it.
+ * The header contains the seed of the test data
+ * (DataProvider::reproducibleSpec()), the block ids are saved
+ * with each region, so the expected data can be generated offline.
+ * The file is removed if nothing has been captured.
+ * Returns false if the file cannot be created.
+ */
+bool
+VolumeTester::setCapture(const QString &path, qint64 neighborhood)
+{
+    if (neighborhood < 0) return false;
+    if (!path.isEmpty())
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+    }
+    capture_path = path;
+    capture_neighborhood = neighborhood;
+    return true;
+}
+
+/*!
+ * Changes the number of parallel streams used with the network profile.
+ * The default value is 8.
+ */
+bool
+VolumeTester::setStreamCount(int count)
+{
+    if (count < 1) return false;
+    stream_count = count;
+    return true;
+}
+
+/*!
+ * Checks if the volume is a network filesystem like NFS or SMB,
+ * which should be tested with the network profile.
+ */
+bool
+VolumeTester::isNetworkFileSystem()
+const
+{
+    QStorageInfo storage(mountpoint());
+    QByteArray type = storage.fileSystemType().toLower();
+    return type.startsWith("nfs") ||
+        type == "cifs" || type.startsWith("smb") ||
+        type == "9p" || type == "fuse.sshfs";
+}
+
 /*!
  * Checks if this VolumeTester is still valid, i.e.,
  * if it still points to a valid mountpoint.
@@ -201,6 +638,107 @@ const
     return isValid(mountpoint());
 }
 
+/*!
+ * Computes the layout of the test files without touching the volume,
+ * with the settings of this VolumeTester and the currently available space.
+ * The memory needed for test data, block buffers and the layout
+ * (file and block lists, timeline, time series) is estimated
+ * as well as the duration of each phase, based on the throughput
+ * of previous tests of the same drive model (see ThroughputHistory).
+ * Durations are -1 if there is no previous test.
+ */
+VolumeTester::Plan
+VolumeTester::plan()
+const
+{
+    Plan plan;
+    plan.bytes_available = bytesAvailable();
+    plan.safety_buffer = safety_buffer;
+    plan.bytes_total = qMax(plan.bytes_available - safety_buffer, (qint64)0);
+
+    //Same files and blocks as the test would use
+    QList<FileInfo> infos = layout(plan.bytes_total);
+    plan.file_count = infos.size();
+    plan.file_size = file_size_max;
+    plan.last_file_size = infos.isEmpty() ? 0 : infos.last().size;
+    plan.block_count = 0;
+    plan.block_size = block_size_max;
+    plan.last_block_size = 0;
+    plan.verify_bytes = 0;
+    plan.memory_layout = 0;
+    for (int i = 0, ii = infos.size(); i < ii; i++)
+    {
+        const FileInfo &file_info = infos.at(i);
+        plan.memory_layout += sizeof(FileInfo) +
+            file_info.path.size() * sizeof(QChar) + file_info.id.size();
+        for (int j = 0, jj = file_info.blocks.size(); j < jj; j++)
+        {
+            const BlockInfo &block_info = file_info.blocks.at(j);
+            plan.memory_layout += sizeof(BlockInfo) + block_info.id.size();
+            if (isSampled(block_info.abs_offset / block_size_max,
+                verify_sampling))
+                plan.verify_bytes += block_info.size;
+            plan.last_block_size = block_info.size;
+        }
+        plan.block_count += file_info.blocks.size();
+    }
+    plan.memory_layout += 3 * plan.block_count * sizeof(TimelineEntry);
+    plan.memory_layout += throughput_series->memoryUsage() +
+        latency_series->memoryUsage(); //constant
+
+    //Random pattern buffer (other test data generated or mapped)
+    //One block buffer per stream
+    plan.streams = network_profile ?
+        qMax(1, qMin(stream_count, plan.file_count)) : 1;
+    plan.memory_data = !data_provider || data_provider->name() == "random" ?
+        block_size_max : 0;
+    plan.memory_buffers = plan.streams * block_size_max;
+    if (network_profile) plan.memory_buffers += plan.streams * 4096;
+
+    //Duration, throughput of previous tests
+    ThroughputHistory history(ThroughputHistory::key(mountpoint()));
+    plan.initialize_speed = history.speed(Phase::Initialize);
+    plan.write_speed = history.speed(Phase::Write);
+    plan.verify_speed = history.speed(Phase::Verify);
+    plan.history_count = history.count(Phase::Write);
+    double total_mb = (double)plan.bytes_total / MB;
+    plan.initialize_seconds = plan.initialize_speed ?
+        (qint64)(total_mb / plan.initialize_speed) : -1;
+    if (single_pass) plan.initialize_seconds = 0;
+    plan.write_seconds = plan.write_speed ?
+        (qint64)(total_mb / plan.write_speed) : -1;
+    plan.verify_seconds = plan.verify_speed ?
+        (qint64)((double)plan.verify_bytes / MB / plan.verify_speed) : -1;
+    if (!plan.verify_bytes) plan.verify_seconds = 0;
+
+    return plan;
+}
+
+/*!
+ * Returns the throughput (MB/s) of each block or workload request
+ * since the start of the test (ms, see TimeSeries),
+ * recent blocks at full resolution, older ones in coarser buckets.
+ * It can be queried from another thread while the test is running
+ * and kept after this VolumeTester has been deleted.
+ */
+QSharedPointer<TimeSeries>
+VolumeTester::throughputSeries()
+const
+{
+    return throughput_series;
+}
+
+/*!
+ * Returns the latency (ms) of each block or workload request,
+ * like throughputSeries().
+ */
+QSharedPointer<TimeSeries>
+VolumeTester::latencySeries()
+const
+{
+    return latency_series;
+}
+
 /*!
  * Returns the mountpoint used by this VolumeTester.
  */
@@ -378,6 +916,8 @@ const
  * a quick test is performed.
  * 2. Write: A test pattern is written to the files.
  * 3. Verify: The files are read and compared with the pattern.
+ * In single pass mode (see setSinglePass()), the files are created
+ * by the write phase and there is no initialization.
  */
 void
 VolumeTester::start()
@@ -393,7 +933,8 @@ VolumeTester::start()
     //Test phases:
     //1 Initialization (write first and last block bytes)
     //2 Full write
-    //3 Full read
+    //3 Full read (or a sample, or none)
+    //Single pass: files created by the full write (no initialization)
 
     //Test files and blocks:
     //The available space is filled with test files.
@@ -412,6 +953,15 @@ VolumeTester::start()
     assert(file_size_max > 0 && file_size_max % MB == 0);
     assert(file_size_max > block_size_max);
 
+    //Aged filesystem, files kept during the test
+    if (aging_percent && !age())
+    {
+        removeAgingFiles();
+        emit failed(error_type);
+        emit finished();
+        return;
+    }
+
     //Size of volume
     //Safety buffer used by default (e.g., 1M)
     //Some filesystems need this, otherwise write error at 100% (ENOSPC)
@@ -422,90 +972,59 @@ VolumeTester::start()
     if (bytes_total <= 0)
     {
         //Volume full or error getting size
+        if (aging_percent) removeAgingFiles();
         emit failed(Error::Full);
         emit finished();
         return;
     }
 
-    //Test pattern
-    generateTestPattern();
-    assert(pattern.size() == block_size_max);
+    //Test data
+    if (!data_provider)
+        data_provider.reset(new RandomDataProvider(block_size_max));
+
+    //Follow kernel log (USB resets, I/O errors) for the device under test
+    //Messages are matched with the block timeline by time
+    kernel_log.open(KernelLog::deviceFilters(
+        QString::fromLocal8Bit(QStorageInfo(mountpoint()).device())));
+    timeline.clear();
+    flight_recorder.clear();
+    throughput_series->clear();
+    latency_series->clear();
+    test_timer.start();
+
+    //Progress for local monitors (shared memory)
+    live_stats.open(mountpoint(), bytes_total);
+
+    //CPU counters for this thread (and streams started by it)
+    if (perf_enabled) perf_counters.open();
 
     //Calculate file and block sizes
-    {
-        int file_count = bytes_total / file_size_max;
-        int last_file_size = bytes_total % file_size_max;
-        if (last_file_size) file_count++;
-        QDir dir(mountpoint());
-        file_infos.clear();
-        for (int i = 0; i < file_count; i++)
-        {
-            //File size
-            int size = file_size_max; //e.g., 512 MB
-            if (i == file_count - 1 && last_file_size)
-                size = last_file_size;
-            assert(size > 0);
-
-            //File area
-            //long long (not just int) to prevent overflows
-            qint64 pos = i * file_size_max; //NOT times current size!
-            assert(pos >= 0); //int overflow may lead to negative pos
-            qint64 end = pos + size;
-
-            //File path
-            QString name = file_prefix + QString::number(i);
-            QString path = dir.absoluteFilePath(name);
-
-            //File ID
-            QByteArray id_bytes = QString::number(i).toUtf8();
-            id_bytes.append((char)'\1');
+    file_infos = layout(bytes_total);
 
-            //File information
-            FileInfo file_info;
-            file_info.path = path;
-            file_info.offset = pos;
-            file_info.size = size;
-            file_info.end = end;
-            file_info.id = id_bytes;
-
-            //Blocks
-            int block_count = size / block_size_max;
-            int last_block_size = size % block_size_max;
-            if (last_block_size) block_count++;
-            for (int j = 0; j < block_count; j++)
-            {
-                //Block size
-                int block_size = block_size_max; //e.g., 16 MB
-                if (j == block_count - 1 && last_block_size)
-                    block_size = last_block_size;
-                assert(block_size > 0);
-
-                //Block position
-                qint64 pos = j * block_size_max; //NOT times current size!
-                assert(pos >= 0);
-                qint64 end = pos + block_size;
-
-                //Block ID
-                QByteArray id_bytes = QString("%1:%2").arg(i).arg(j).toUtf8();
-                id_bytes.append((char)'\1');
-
-                //Block information
-                BlockInfo block_info;
-                block_info.rel_offset = pos; //relative offset within file
-                block_info.abs_offset = file_info.offset + pos; //absolute
-                block_info.size = block_size;
-                block_info.rel_end = end;
-                block_info.abs_end = file_info.offset + end;
-                block_info.id = id_bytes;
-
-                //Add to list
-                file_info.blocks << block_info;
-            }
-            assert(file_info.blocks.size() == block_count);
+    //Failing regions saved on the host, with what's needed to analyze them
+    if (!capture_path.isEmpty())
+    {
+        QStorageInfo storage(mountpoint());
+        QVariantMap header;
+        header["mountpoint"] = mountpoint();
+        header["device"] = QString::fromLocal8Bit(storage.device());
+        header["filesystem"] = QString::fromLocal8Bit(storage.fileSystemType());
+        header["provider"] = data_provider->reproducibleSpec();
+        header["bytes_total"] = bytes_total;
+        header["file_size"] = file_size_max;
+        header["block_size"] = block_size_max;
+        header["neighborhood"] = capture_neighborhood;
+        header["started"] =
+            QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+        capture.open(capture_path, header);
+    }
 
-            //Add to list
-            file_infos << file_info;
-        }
+    //Timeline allocated once (initialization, write, verify)
+    {
+        int block_count = 0;
+        for (int i = 0, ii = file_infos.size(); i < ii; i++)
+            block_count += file_infos.at(i).blocks.size();
+        timeline.reserve(3 * block_count);
     }
 
     //File objects (on heap, auto-deleted)
@@ -524,16 +1043,52 @@ VolumeTester::start()
     }
 
     //Run tests
-    if (initialize() && writeFull() && verifyFull())
+    //Flight recorder dumped if stalled (30 s) or failed
+    Watchdog watchdog(this, 30000);
+    watchdog.start();
+    if (single_pass)
+        success = runPhase(Phase::Write, &VolumeTester::fill);
+    else
+        success = runPhase(Phase::Initialize, &VolumeTester::initialize) &&
+            runPhase(Phase::Write, &VolumeTester::writeFull);
+    success = success &&
+        (!workload.isValid() ||
+            runPhase(Phase::Workload, &VolumeTester::runWorkload)) &&
+        (!remount_volume || remount()) &&
+        (!verify_sampling ||
+            runPhase(Phase::Verify, &VolumeTester::verifyFull));
+    watchdog.stop();
+    watchdog.wait();
+    if (!success && !(error_type & Error::Aborted))
+        emit flightRecord(flight_recorder.dump("test failed"));
+    if (aging_percent) removeAgingFiles();
+    if (capture.isOpen())
+    {
+        int regions = capture.regionCount();
+        qint64 bytes = capture.bytesCaptured();
+        capture.close();
+        if (regions)
+            emit captured(regions, bytes);
+        else
+            QFile::remove(capture_path);
+    }
+
+    //Remaining kernel messages, errors are often logged a moment later
+    if (kernel_log.isOpen())
+    {
+        if (!success) QThread::msleep(1000);
+        readKernelLog();
+        kernel_log.close();
+    }
+
+    if (success)
     {
         //Test succeeded
-        success = true;
         emit succeeded();
     }
     else
     {
         //Test failed
-        success = false;
         emit failed(error_type);
     }
 
@@ -567,7 +1122,7 @@ VolumeTester::initialize()
     double initialized_sec = 0;
     for (int i = 0, ii = file_infos.size(); i < ii; i++)
     {
-        FileInfo file_info = file_infos[i];
+        const FileInfo &file_info = file_infos.at(i);
         QFile *file = file_info.file;
         assert(file);
 
@@ -605,15 +1160,18 @@ VolumeTester::initialize()
         //Grow file incrementally
         for (int j = 0, jj = file_info.blocks.size(); j < jj; j++)
         {
-            BlockInfo block_info = file_info.blocks[j];
+            const BlockInfo &block_info = file_info.blocks.at(j);
 
             //Start timer
             timer_initializing.start();
+            qint64 begin = test_timer.nsecsElapsed();
 
             //Grow file
             if (!file->resize(block_info.rel_end))
             {
                 //Growing file failed
+                recordBlock(Phase::Initialize,
+                    block_info.abs_offset, block_info.size, begin);
                 error_type |= Error::Write;
                 error_type |= Error::Resize;
                 emit writeFailed(block_info.abs_offset, block_info.size);
@@ -642,11 +1200,17 @@ VolumeTester::initialize()
             }
 
             //Block initialized, get time
+            recordBlock(Phase::Initialize,
+                block_info.abs_offset, block_info.size, begin);
             initialized_sec += (double)timer_initializing.elapsed() / 1000;
             initialized_mb += block_info.size / MB;
             double avg_speed =
                 initialized_sec ? initialized_mb / initialized_sec : 0;
-            emit initialized(block_info.abs_end, avg_speed);
+            {
+                AllocationCounter::Suspend suspend; //not part of I/O path
+                emit initialized(block_info.abs_end, avg_speed);
+            }
+            readKernelLog();
 
             //Cancel gracefully
             if (abortRequested()) return false;
@@ -683,7 +1247,7 @@ VolumeTester::initialize()
     //Verify all files (quick test, just first and last few bytes)
     for (int i = 0, ii = file_infos.size(); i < ii; i++)
     {
-        FileInfo file_info = file_infos[i];
+        const FileInfo &file_info = file_infos.at(i);
         QFile *file = file_info.file;
 
         //Verify last byte
@@ -720,13 +1284,28 @@ VolumeTester::writeFull()
     //Start
     emit writeStarted();
 
+    //Network profile, several streams
+    if (network_profile) return runStreams(false);
+
+    //Block buffer, reused for all blocks
+    QByteArray block(block_size_max, (char)0);
+    char *data = block.data();
+
+    //Aligned buffer for uncached sentinel reads
+    QByteArray sentinel_block(2 * 4096, (char)0);
+    char *sentinel = sentinel_block.data() +
+        (4096 - (quintptr)sentinel_block.data() % 4096) % 4096;
+    sentinel_reads = 0;
+    sentinel_bytes = 0;
+    sentinel_time = 0;
+
     //Write test pattern
     QElapsedTimer timer_writing;
     double written_mb = 0;
     double written_sec = 0;
     for (int i = 0, ii = file_infos.size(); i < ii; i++)
     {
-        FileInfo file_info = file_infos[i];
+        const FileInfo &file_info = file_infos.at(i);
         QFile *file = file_info.file;
         int fd = file->handle();
 
@@ -736,62 +1315,259 @@ VolumeTester::writeFull()
         fsync(fd);
         #endif
 
+        //Sentinel check, blocks written through a synchronous handle
+        QFile sync_file;
+        QFile read_file;
+        bool fadvise = false;
+        if (sentinel_check)
+        {
+            file->flush();
+            if (!openSentinelFiles(file_info.path, sync_file, read_file,
+                &fadvise))
+            {
+                error_type |= Error::Write;
+                emit writeFailed(file_info.offset, file_info.size);
+                return false;
+            }
+            file = &sync_file;
+        }
+
         //Write blocks
         for (int j = 0, jj = file_info.blocks.size(); j < jj; j++)
         {
-            BlockInfo block_info = file_info.blocks[j];
+            const BlockInfo &block_info = file_info.blocks.at(j);
 
             //Block data (based on pattern, with unique id)
-            QByteArray block = blockData(i, j);
+            fillBlock(i, j, data);
 
             //Start timer
             timer_writing.start();
+            qint64 begin = test_timer.nsecsElapsed();
 
             //Write block
             if (!file->seek(block_info.rel_offset) ||
-                file->write(block) != block_info.size)
+                file->write(data, block_info.size) != block_info.size)
             {
                 //Writing chunk failed
+                recordBlock(Phase::Write,
+                    block_info.abs_offset, block_info.size, begin);
                 error_type |= Error::Write;
                 emit writeFailed(block_info.abs_offset, block_info.size);
                 return false;
             }
 
-            //Flush cache
+            //Flush cache (already synchronous with sentinel check)
             #ifdef USE_FSYNC
-            fsync(fd);
+            if (!sentinel_check) fsync(fd);
             #endif
 
             //Block written
+            recordBlock(Phase::Write,
+                block_info.abs_offset, block_info.size, begin);
             written_sec += (double)timer_writing.elapsed() / 1000;
+
+            //Read back sentinels (dropped write), timed separately
+            if (sentinel_check &&
+                !checkSentinels(i, j, data, read_file, fadvise, sentinel))
+            {
+                captureFailure(Phase::Write,
+                    block_info.abs_offset, block_info.size, 0, -1);
+                error_type |= Error::Verify;
+                emit verifyFailed(block_info.abs_offset, block_info.size);
+                return false;
+            }
             written_mb += block_info.size / MB;
             double avg_speed = written_sec ? written_mb / written_sec : 0;
-            emit written(block_info.abs_end, avg_speed);
+            {
+                AllocationCounter::Suspend suspend; //not part of I/O path
+                emit written(block_info.abs_end, avg_speed);
+            }
+            readKernelLog();
 
             //Cancel gracefully
             if (abortRequested()) return false;
         }
+
+        //Single pass: check this file right away, like initialize()
+        if (single_pass && !checkFile(i)) return false;
     }
 
     return true;
 }
 
 bool
-VolumeTester::verifyFull()
+VolumeTester::fill()
 {
-    //Read test pattern
-    emit verifyStarted();
-    QElapsedTimer timer_verifying;
-    double verified_mb = 0;
-    double verified_sec = 0;
+    //Start, no initialization but the total is needed for the progress
+    emit initializationStarted(bytes_total);
+
+    //Create empty test files, grown by writing the blocks
     for (int i = 0, ii = file_infos.size(); i < ii; i++)
     {
-        FileInfo file_info = file_infos[i];
+        const FileInfo &file_info = file_infos.at(i);
         QFile *file = file_info.file;
-        int fd = file->handle();
+        assert(file);
 
-        //Flush cache
-        #ifdef USE_FSYNC
+        //File must not exist
+        if (file->exists())
+        {
+            //File conflict
+            error_type |= Error::Create;
+            emit createFailed(i, file_info.offset);
+            return false;
+        }
+
+        //Create file
+        if (!file->open(QIODevice::ReadWrite))
+        {
+            //Creating test file failed
+            error_type |= Error::Create;
+            if (file->error() & QFileDevice::PermissionsError)
+                error_type |= Error::Permissions;
+            emit createFailed(i, file_info.offset);
+            return false;
+        }
+    }
+
+    //Write test pattern, each file checked after it's written
+    if (!writeFull()) return false;
+
+    //Check all files (quick test, earlier files may have been overwritten)
+    for (int i = 0, ii = file_infos.size(); i < ii; i++)
+    {
+        if (!checkFile(i)) return false;
+
+        //Cancel gracefully
+        if (abortRequested()) return false;
+    }
+
+    return true;
+}
+
+bool
+VolumeTester::remount()
+{
+    emit remountStarted();
+
+    //Current mount options
+    QString device, type, options;
+    if (!mountOptions(mountpoint(), &device, &type, &options))
+    {
+        error_type |= Error::Remount;
+        return false;
+    }
+
+    //Loop device set up by mount -o loop is detached when unmounted,
+    //the image file is mounted again instead
+    if (device.startsWith("/dev/loop"))
+    {
+        QString sys_path =
+            "/sys/block/" + QFileInfo(device).fileName() + "/loop/";
+        QFile autoclear(sys_path + "autoclear");
+        QFile backing_file(sys_path + "backing_file");
+        if (autoclear.open(QIODevice::ReadOnly) &&
+            autoclear.readAll().trimmed() == "1" &&
+            backing_file.open(QIODevice::ReadOnly))
+        {
+            device = QFile::decodeName(backing_file.readAll().trimmed());
+            options += ",loop";
+        }
+    }
+
+    //FUSE: the type selects the helper program (fuse.sshfs calls
+    //mount.fuse.sshfs), options that belong to the FUSE connection
+    //are not passed
+    if (type.startsWith("fuse"))
+    {
+        QStringList vfs_options;
+        foreach (QString option, options.split(','))
+        {
+            if (option.startsWith("user_id=") ||
+                option.startsWith("group_id=") ||
+                option.startsWith("rootmode=") ||
+                option.startsWith("blksize=") ||
+                option.startsWith("fd="))
+                continue;
+            vfs_options << option;
+        }
+        options = vfs_options.join(",");
+
+        //fuseblk has no subtype, driver derived from the filesystem
+        if (type.startsWith("fuseblk."))
+            type = type.mid(8);
+        else if (type == "fuseblk")
+            type = fuseblkDriver(device);
+        if (type.isEmpty())
+        {
+            error_type |= Error::Remount;
+            return false;
+        }
+    }
+
+    //Close test files, data written to device
+    for (int i = 0, ii = file_infos.size(); i < ii; i++)
+    {
+        QFile *file = file_infos[i].file;
+        if (!file->isOpen()) continue;
+        file->flush();
+        #ifdef USE_FSYNC
+        fsync(file->handle());
+        #endif
+        file->close();
+    }
+
+    //Unmount, mount again (same type and options)
+    QStringList mount_args;
+    mount_args << "-t" << type << "-o" << options << device << mountpoint();
+    QProcess umount, mount;
+    umount.start("umount", QStringList() << mountpoint());
+    if (!umount.waitForFinished(-1) || umount.exitCode() != 0)
+    {
+        error_type |= Error::Remount;
+        return false;
+    }
+    mount.start("mount", mount_args);
+    if (!mount.waitForFinished(-1) || mount.exitCode() != 0)
+    {
+        //Volume left unmounted, test files cannot be removed
+        error_type |= Error::Remount;
+        return false;
+    }
+
+    //Reopen test files by path
+    for (int i = 0, ii = file_infos.size(); i < ii; i++)
+    {
+        QFile *file = file_infos[i].file;
+        if (!file->open(QIODevice::ReadOnly))
+        {
+            error_type |= Error::Remount;
+            emit verifyFailed(file_infos[i].offset, file_infos[i].size);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+VolumeTester::verifyFull()
+{
+    //Read test pattern
+    emit verifyStarted();
+    if (network_profile) return runStreams(true);
+    QByteArray block(block_size_max, (char)0);
+    char *data = block.data();
+    QElapsedTimer timer_verifying;
+    double verified_mb = 0;
+    double verified_sec = 0;
+    for (int i = 0, ii = file_infos.size(); i < ii; i++)
+    {
+        const FileInfo &file_info = file_infos.at(i);
+        QFile *file = file_info.file;
+        int fd = file->handle();
+
+        //Flush cache
+        #ifdef USE_FSYNC
         fsync(fd);
         #endif
 
@@ -803,29 +1579,46 @@ VolumeTester::verifyFull()
         //Read pattern in small chunks
         for (int j = 0, jj = file_info.blocks.size(); j < jj; j++)
         {
-            BlockInfo block_info = file_info.blocks[j];
+            const BlockInfo &block_info = file_info.blocks.at(j);
 
-            //Block data (based on pattern, with unique id)
-            QByteArray block = blockData(i, j);
+            //Sample only (wipe)
+            if (!isSampled(block_info.abs_offset / block_size_max,
+                verify_sampling))
+                continue;
 
             //Start timer
             timer_verifying.start();
+            qint64 begin = test_timer.nsecsElapsed();
 
-            //Read block
-            if (!file->seek(block_info.rel_offset) ||
-                file->read(block_info.size) != block)
+            //Read block and compare with pattern (and unique id)
+            bool read = file->seek(block_info.rel_offset) &&
+                file->read(data, block_info.size) == block_info.size;
+            int index = read ? verifyBlock(i, j, data) : -1;
+            if (!read || index != -1)
             {
                 //Verifying chunk failed
+                recordBlock(Phase::Verify,
+                    block_info.abs_offset, block_info.size, begin);
+                if (index != -1) recordMismatch(i, j, data, index);
+                captureFailure(Phase::Verify,
+                    block_info.abs_offset, block_info.size, read ? data : 0,
+                    index != -1 ? block_info.abs_offset + index : -1);
                 error_type |= Error::Verify;
                 emit verifyFailed(block_info.abs_offset, block_info.size);
                 return false;
             }
 
             //Block verified
+            recordBlock(Phase::Verify,
+                block_info.abs_offset, block_info.size, begin);
             verified_sec += (double)timer_verifying.elapsed() / 1000;
             verified_mb += block_info.size / MB;
             double avg_speed = verified_sec ? verified_mb / verified_sec : 0;
-            emit verified(block_info.abs_end, avg_speed);
+            {
+                AllocationCounter::Suspend suspend; //not part of I/O path
+                emit verified(block_info.abs_end, avg_speed);
+            }
+            readKernelLog();
 
             //Cancel gracefully
             if (abortRequested()) return false;
@@ -835,26 +1628,6 @@ VolumeTester::verifyFull()
     return true;
 }
 
-void
-VolumeTester::generateTestPattern()
-{
-    //Test pattern
-    //Pattern size < block size
-    int pattern_size = block_size_max; //for example 16 MB
-    assert(pattern_size > 0);
-    QByteArray new_pattern(pattern_size, (char)0);
-    srand(time(0));
-    for (int i = 0; i < pattern_size; i++)
-    {
-        //Random byte except 0
-        uchar byte = rand() % 254 + 1; //0 < byte < 255
-        new_pattern[i] = byte;
-    }
-    this->pattern = new_pattern;
-    assert(this->pattern.size() == pattern_size);
-
-}
-
 void
 VolumeTester::removeFile(QObject *file)
 {
@@ -884,35 +1657,209 @@ VolumeTester::removeFile(QObject *file)
     //Finish after last file
     if (file_infos.isEmpty())
     {
+        if (success && discard_free_space) discardFreeSpace();
+        live_stats.finish(success, error_type);
         emit finished(success, error_type);
     }
 }
 
-QByteArray
-VolumeTester::blockData(int file_index, int block_index)
+/*!
+ * Returns the test files and their blocks filling the specified number
+ * of bytes: files of file_size_max bytes, the last one may be smaller,
+ * each one divided into blocks of block_size_max bytes.
+ */
+QList<VolumeTester::FileInfo>
+VolumeTester::layout(qint64 total)
 const
 {
-    FileInfo file_info = file_infos.at(file_index);
-    BlockInfo block_info = file_info.blocks.at(block_index);
+    int file_count = total / file_size_max;
+    int last_file_size = total % file_size_max;
+    if (last_file_size) file_count++;
+    QDir dir(mountpoint());
+    QList<FileInfo> infos;
+    for (int i = 0; i < file_count; i++)
+    {
+        //File size
+        int size = file_size_max; //e.g., 512 MB
+        if (i == file_count - 1 && last_file_size)
+            size = last_file_size;
+        assert(size > 0);
+
+        //File area
+        //long long (not just int) to prevent overflows
+        qint64 pos = i * file_size_max; //NOT times current size!
+        assert(pos >= 0); //int overflow may lead to negative pos
+        qint64 end = pos + size;
+
+        //File path
+        QString name = file_prefix + QString::number(i);
+        QString path = dir.absoluteFilePath(name);
+
+        //File ID
+        QByteArray id_bytes = QString::number(i).toUtf8();
+        id_bytes.append((char)'\1');
+
+        //File information
+        FileInfo file_info;
+        file_info.path = path;
+        file_info.offset = pos;
+        file_info.size = size;
+        file_info.end = end;
+        file_info.id = id_bytes;
+
+        //Blocks
+        int block_count = size / block_size_max;
+        int last_block_size = size % block_size_max;
+        if (last_block_size) block_count++;
+        for (int j = 0; j < block_count; j++)
+        {
+            //Block size
+            int block_size = block_size_max; //e.g., 16 MB
+            if (j == block_count - 1 && last_block_size)
+                block_size = last_block_size;
+            assert(block_size > 0);
+
+            //Block position
+            qint64 pos = j * block_size_max; //NOT times current size!
+            assert(pos >= 0);
+            qint64 end = pos + block_size;
+
+            //Block ID
+            QByteArray id_bytes = QString("%1:%2").arg(i).arg(j).toUtf8();
+            id_bytes.append((char)'\1');
 
-    //Block data based on test pattern
-    QByteArray block = pattern;
-    assert(!block.isEmpty()); //pattern must have been generated previously
+            //Block information
+            BlockInfo block_info;
+            block_info.rel_offset = pos; //relative offset within file
+            block_info.abs_offset = file_info.offset + pos; //absolute
+            block_info.size = block_size;
+            block_info.rel_end = end;
+            block_info.abs_end = file_info.offset + end;
+            block_info.id = id_bytes;
+
+            //Add to list
+            file_info.blocks << block_info;
+        }
+        assert(file_info.blocks.size() == block_count);
+
+        //Add to list
+        infos << file_info;
+    }
+
+    return infos;
+}
+
+void
+VolumeTester::fillBlock(int file_index, int block_index, char *data)
+const
+{
+    const BlockInfo &block_info =
+        file_infos.at(file_index).blocks.at(block_index);
+    assert(data_provider); //provider must have been selected previously
 
-    //Shrink last block
-    if (block.size() > block_info.size)
-        block.resize(block_info.size);
-    assert(block.size() == block_info.size);
-    assert(!block.isEmpty());
+    //Block data based on test pattern
+    data_provider->fill(data, block_info.size, block_info.abs_offset);
 
     //Put unique id sequence at beginning (if possible)
     if (block_info.size >= block_info.id.size())
     {
-        block.replace(0, block_info.id.size(), block_info.id);
+        memcpy(data, block_info.id.constData(), block_info.id.size());
+    }
+
+}
+
+int
+VolumeTester::verifyBlock(int file_index, int block_index, const char *data)
+const
+{
+    const BlockInfo &block_info =
+        file_infos.at(file_index).blocks.at(block_index);
+    assert(data_provider);
+
+    //Unique id sequence at beginning (if possible)
+    int id_size = 0;
+    if (block_info.size >= block_info.id.size())
+    {
+        id_size = block_info.id.size();
+        for (int i = 0; i < id_size; i++)
+        {
+            if (data[i] != block_info.id.at(i))
+                return i;
+        }
+    }
+
+    //Remaining block data based on test pattern
+    int index = data_provider->verify(data + id_size,
+        block_info.size - id_size, block_info.abs_offset + id_size);
+    if (index != -1)
+        index += id_size;
+
+    return index;
+}
+
+/*!
+ * Like fillBlock(), but only for size bytes at the absolute offset,
+ * which must be within the specified block.
+ */
+void
+VolumeTester::fillRange(int file_index, int block_index, qint64 offset,
+    int size, char *data)
+const
+{
+    const BlockInfo &block_info =
+        file_infos.at(file_index).blocks.at(block_index);
+    assert(data_provider);
+    assert(offset >= block_info.abs_offset &&
+        offset + size <= block_info.abs_end);
+
+    //Test pattern
+    data_provider->fill(data, size, offset);
+
+    //Part of unique id sequence at beginning of block (if possible)
+    qint64 start = offset - block_info.abs_offset;
+    if (block_info.size >= block_info.id.size() &&
+        start < block_info.id.size())
+    {
+        int id_size = qMin((qint64)size, block_info.id.size() - start);
+        memcpy(data, block_info.id.constData() + start, id_size);
+    }
+
+}
+
+/*!
+ * Like verifyBlock(), but only for size bytes at the absolute offset,
+ * which must be within the specified block.
+ */
+int
+VolumeTester::verifyRange(int file_index, int block_index, qint64 offset,
+    int size, const char *data)
+const
+{
+    const BlockInfo &block_info =
+        file_infos.at(file_index).blocks.at(block_index);
+    assert(data_provider);
+
+    //Part of unique id sequence at beginning of block (if possible)
+    int id_size = 0;
+    qint64 start = offset - block_info.abs_offset;
+    if (block_info.size >= block_info.id.size() &&
+        start < block_info.id.size())
+    {
+        id_size = qMin((qint64)size, block_info.id.size() - start);
+        for (int i = 0; i < id_size; i++)
+        {
+            if (data[i] != block_info.id.at(start + i))
+                return i;
+        }
     }
-    assert(block.size() == block_info.size);
 
-    return block;
+    //Remaining data based on test pattern
+    int index = data_provider->verify(data + id_size,
+        size - id_size, offset + id_size);
+    if (index != -1)
+        index += id_size;
+
+    return index;
 }
 
 bool
@@ -922,3 +1869,1103 @@ const
     return _canceled;
 }
 
+/*!
+ * Quick check of a test file written in a single pass:
+ * reads the id of the first block and the end of the last block.
+ * A file closed by a stream is opened again (read-only).
+ */
+bool
+VolumeTester::checkFile(int index)
+{
+    const FileInfo &file_info = file_infos.at(index);
+    const BlockInfo &first = file_info.blocks.first();
+    const BlockInfo &last = file_info.blocks.last();
+    QFile *file = file_info.file;
+    assert(file);
+
+    //Open file
+    if (!file->isOpen() && !file->open(QIODevice::ReadOnly))
+    {
+        error_type |= Error::Verify;
+        emit verifyFailed(file_info.offset, file_info.size);
+        return false;
+    }
+
+    //Verify id of first block (if the block is large enough for it)
+    if (first.size >= first.id.size() &&
+        (!file->seek(first.rel_offset) ||
+        file->read(first.id.size()) != first.id))
+    {
+        //Verifying id failed
+        error_type |= Error::Verify;
+        emit verifyFailed(first.abs_offset, first.size);
+        return false;
+    }
+
+    //Verify end of last block (test pattern after the id)
+    char tail[4096];
+    int id_size = last.size >= last.id.size() ? last.id.size() : 0;
+    int size = qMin((int)sizeof(tail), last.size - id_size);
+    if (size > 0 &&
+        (!file->seek(last.rel_end - size) ||
+        file->read(tail, size) != size ||
+        data_provider->verify(tail, size, last.abs_end - size) != -1))
+    {
+        //Verifying last bytes failed
+        error_type |= Error::Verify;
+        emit verifyFailed(last.abs_offset, last.size);
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * Fills a part of the free space with files of mixed sizes
+ * and deletes about half of them, see setAging().
+ * The files are created in a directory named like the test files,
+ * so a directory left behind is found by conflictFiles().
+ */
+bool
+VolumeTester::age()
+{
+    QDir root(mountpoint());
+    QString name = file_prefix + ".AGING";
+    if (root.exists(name) || !root.mkdir(name))
+    {
+        error_type |= Error::Create;
+        return false;
+    }
+    QDir dir(root.absoluteFilePath(name));
+
+    //Space to fill (test files need the rest)
+    qint64 total = (bytesAvailable() - safety_buffer) * aging_percent / 100;
+    emit agingStarted(total);
+
+    //Same sizes and pattern for the same seed
+    std::mt19937_64 generator(aging_seed);
+    QByteArray chunk(MB, (char)0);
+    for (int i = 0; i < chunk.size(); i++)
+        chunk[i] = (char)(generator() % 254 + 1);
+
+    //Files of mixed sizes, 4 KB to 32 MB (log scale)
+    QStringList paths;
+    qint64 bytes = 0;
+    qint64 reported = 0;
+    while (bytes < total)
+    {
+        qint64 size = (qint64)4 * KB << (generator() % 13);
+        size = qMin(size + (qint64)(generator() % size), total - bytes);
+        QString path = dir.absoluteFilePath(QString::number(paths.size()));
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly))
+        {
+            error_type |= Error::Create;
+            return false;
+        }
+        for (qint64 pos = 0; pos < size; pos += chunk.size())
+        {
+            qint64 length = qMin((qint64)chunk.size(), size - pos);
+            if (file.write(chunk.constData(), length) != length)
+            {
+                error_type |= Error::Write;
+                return false;
+            }
+        }
+        file.close();
+        paths << path;
+        bytes += size;
+
+        if (bytes - reported >= 64 * MB || bytes >= total)
+        {
+            reported = bytes;
+            emit agingProgress(bytes);
+        }
+        if (abortRequested()) return false;
+    }
+
+    //Delete about half of the files, leaving holes of mixed sizes
+    int kept_files = 0;
+    qint64 kept_bytes = 0;
+    for (int i = 0; i < paths.size(); i++)
+    {
+        if (generator() % 2)
+        {
+            if (!QFile::remove(paths.at(i)))
+            {
+                error_type |= Error::Create;
+                return false;
+            }
+            continue;
+        }
+        kept_files++;
+        kept_bytes += QFileInfo(paths.at(i)).size();
+    }
+    #if defined(USE_FSYNC) && !defined(_WIN32)
+    ::sync(); //allocation settled before the test
+    #endif
+    emit aged(kept_files, kept_bytes);
+
+    return true;
+}
+
+/*!
+ * Deletes the files created by age().
+ */
+void
+VolumeTester::removeAgingFiles()
+{
+    QDir dir(QDir(mountpoint()).absoluteFilePath(file_prefix + ".AGING"));
+    if (dir.exists() && !dir.removeRecursively())
+        emit removeFailed(dir.absolutePath());
+}
+
+/*!
+ * Opens a test file for synchronous writes (O_DSYNC) and for uncached
+ * reads (O_DIRECT, or dropped from the cache before reading
+ * if the filesystem does not support it, indicated by fadvise).
+ */
+bool
+VolumeTester::openSentinelFiles(const QString &path, QFile &sync_file,
+    QFile &read_file, bool *fadvise)
+const
+{
+    *fadvise = false;
+    #if !defined(_WIN32) && defined(O_DSYNC)
+    QByteArray local_path = QFile::encodeName(path);
+    int fd = ::open(local_path.constData(), O_WRONLY | O_DSYNC);
+    if (fd == -1) return false;
+    if (!sync_file.open(fd, QIODevice::WriteOnly | QIODevice::Unbuffered,
+        QFileDevice::AutoCloseHandle))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    bool opened = false;
+    #if defined(O_DIRECT)
+    fd = ::open(local_path.constData(), O_RDONLY | O_DIRECT);
+    if (fd != -1)
+    {
+        opened = read_file.open(fd,
+            QIODevice::ReadOnly | QIODevice::Unbuffered,
+            QFileDevice::AutoCloseHandle);
+        if (!opened) ::close(fd);
+    }
+    #endif
+    if (!opened)
+    {
+        read_file.setFileName(path);
+        *fadvise = true;
+        opened = read_file.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+    return opened;
+    #else
+    Q_UNUSED(path);
+    Q_UNUSED(sync_file);
+    Q_UNUSED(read_file);
+    return false;
+    #endif
+}
+
+/*!
+ * Reads the start, the end and a pseudo-random 4 KB in the middle
+ * of a block that has just been written and compares them
+ * with the written data. Returns false if they don't match.
+ * The sentinel buffer must be aligned to 4 KB.
+ */
+bool
+VolumeTester::checkSentinels(int file_index, int block_index,
+    const char *data, QFile &read_file, bool fadvise, char *sentinel)
+{
+    const BlockInfo &block_info =
+        file_infos.at(file_index).blocks.at(block_index);
+    const qint64 alignment = 4096;
+    qint64 start = block_info.rel_offset;
+    qint64 end = block_info.rel_end;
+
+    //Middle position derived from the block offset (same in every test)
+    quint64 hash = (quint64)block_info.abs_offset * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 29;
+    qint64 positions[3];
+    positions[0] = start;
+    positions[1] = start + (qint64)(hash % block_info.size) / alignment *
+        alignment;
+    positions[2] = (end - 1) / alignment * alignment;
+
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = true;
+    for (int i = 0; ok && i < 3; i++)
+    {
+        qint64 pos = qMax(positions[i], start);
+        int length = (int)qMin(alignment, end - pos);
+
+        //Not using O_DIRECT, drop the written pages from the cache
+        #if _XOPEN_SOURCE >= 600 || _POSIX_C_SOURCE >= 200112L
+        if (fadvise)
+            posix_fadvise(read_file.handle(), pos, alignment,
+                POSIX_FADV_DONTNEED);
+        #endif
+
+        //Full aligned length for O_DIRECT (short read at end of file)
+        ok = read_file.seek(pos) &&
+            read_file.read(sentinel, alignment) >= length &&
+            !memcmp(sentinel, data + (pos - start), length);
+        sentinel_reads++;
+        sentinel_bytes += length;
+    }
+    sentinel_time += timer.nsecsElapsed();
+
+    return ok;
+}
+
+/*!
+ * Looks up how the filesystem at the mountpoint is mounted (/proc/mounts).
+ */
+bool
+VolumeTester::mountOptions(const QString &mountpoint,
+    QString *device, QString *type, QString *options)
+{
+    QFile file("/proc/self/mounts");
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    //device mountpoint type options 0 0
+    //Special characters octal-escaped (space: \040)
+    bool found = false;
+    QString path = QDir(mountpoint).absolutePath();
+    foreach (QByteArray line, file.readAll().split('\n'))
+    {
+        QList<QByteArray> fields = line.split(' ');
+        if (fields.size() < 4) continue;
+        for (int i = 0; i < 4; i++)
+        {
+            QByteArray field = fields.at(i);
+            int pos = 0;
+            while ((pos = field.indexOf('\\', pos)) != -1 &&
+                pos + 3 < field.size())
+            {
+                char c = (char)field.mid(pos + 1, 3).toInt(0, 8);
+                field.replace(pos, 4, QByteArray(1, c));
+                pos++;
+            }
+            fields[i] = field;
+        }
+        if (QFile::decodeName(fields.at(1)) != path) continue;
+
+        //Last entry wins (mounted on top)
+        found = true;
+        if (device) *device = QFile::decodeName(fields.at(0));
+        if (type) *type = QString::fromLatin1(fields.at(2));
+        if (options) *options = QString::fromLatin1(fields.at(3));
+    }
+
+    return found;
+}
+
+/*!
+ * Returns the FUSE driver (mount type) for the filesystem on a device
+ * mounted as fuseblk, or an empty string if it is not known.
+ */
+QString
+VolumeTester::fuseblkDriver(const QString &device)
+{
+    //Filesystem type according to its superblock
+    QProcess blkid;
+    blkid.start("blkid",
+        QStringList() << "-o" << "value" << "-s" << "TYPE" << device);
+    if (!blkid.waitForFinished(-1) || blkid.exitCode() != 0)
+        return QString();
+    QString fs_type =
+        QString::fromLatin1(blkid.readAllStandardOutput()).trimmed();
+
+    if (fs_type == "ntfs") return "ntfs-3g";
+    if (fs_type == "exfat") return "exfat-fuse";
+    return QString();
+}
+
+/*!
+ * Runs a test phase and reports the number of heap allocations made
+ * by the test (worker thread and streams), excluding progress signals.
+ * It only depends on the number of files, not on the number of blocks,
+ * as the block loops don't allocate memory.
+ * Then reports the bytes transferred, the runtime (ms)
+ * and the block latencies (ns) of the phase.
+ */
+bool
+VolumeTester::runPhase(int phase, bool (VolumeTester::*function)())
+{
+    stream_allocations.store(0);
+    stream_allocated_bytes.store(0);
+    phase_latency.clear();
+    phase_bytes = 0;
+    phase_blocks.clear();
+    {
+        int block_count = 0;
+        for (int i = 0, ii = file_infos.size(); i < ii; i++)
+            block_count += file_infos.at(i).blocks.size();
+        phase_blocks.reserve(block_count);
+    }
+    phase_begin = test_timer.nsecsElapsed();
+    live_stats.setPhase(phase);
+    AllocationCounter::Counts before = AllocationCounter::current();
+    perf_counters.start();
+    QElapsedTimer timer;
+    timer.start();
+
+    bool ok = (this->*function)();
+
+    perf_counters.stop();
+    if (!ok && !abortRequested()) live_stats.addError();
+
+    qint64 runtime = timer.elapsed();
+    AllocationCounter::Counts after = AllocationCounter::current();
+    emit allocations(phase,
+        after.count - before.count + stream_allocations.load(),
+        after.bytes - before.bytes + stream_allocated_bytes.load());
+
+    //Throughput and latency (fio terms)
+    QVariantMap statistics = phase_latency.toVariantMap();
+    statistics["bytes"] = phase_bytes;
+    statistics["runtime"] = runtime;
+    if (perf_enabled) statistics["counters"] = perf_counters.toVariantMap();
+    statistics["block_size"] = block_size_max;
+    statistics["jobs"] = network_profile ? stream_count : 1;
+
+    //Batch means after warm-up
+    {
+        qint64 start = phase_begin + warmup;
+        BenchmarkStatistics benchmark =
+            BenchmarkStatistics::fromBlocks(phase_blocks, start);
+        QVariantMap map = benchmark.toVariantMap();
+        qint64 measured = 0;
+        for (int i = 0, ii = phase_blocks.size(); i < ii; i++)
+            measured += phase_blocks.at(i).first;
+        qint64 nsecs = phase_blocks.isEmpty() ?
+            0 : phase_blocks.last().second - start;
+        map["speed"] = nsecs > 0 ?
+            ((double)measured / MB) / ((double)nsecs / 1000000000) : 0;
+        map["warmup_bytes"] = phase_bytes - measured;
+        statistics["benchmark"] = map;
+    }
+
+    //Throughput and latency per request type
+    if (phase == Phase::Workload)
+    {
+        QStringList names = QStringList() << "read" << "write";
+        for (int i = 0; i < names.size(); i++)
+        {
+            QVariantMap map = workload_latency[i].toVariantMap();
+            map["bytes"] = workload_bytes[i];
+            statistics[names.at(i)] = map;
+        }
+        statistics["workload"] = workload.spec();
+        statistics["jobs"] = workload.queueDepth();
+    }
+
+    if (phase == Phase::Write && sentinel_check && !network_profile)
+    {
+        statistics["sentinels"] = sentinel_reads;
+        statistics["sentinel_bytes"] = sentinel_bytes;
+        statistics["sentinel_runtime"] = sentinel_time / 1000000;
+    }
+    emit phaseStatistics(phase, statistics);
+
+    //Throughput for the next plan (see plan()), clean filesystem only
+    if (ok && !aging_percent && phase != Phase::Workload)
+    {
+        ThroughputHistory history(ThroughputHistory::key(mountpoint()));
+        history.add(phase, phase_bytes, runtime);
+    }
+
+    return ok;
+}
+
+bool
+VolumeTester::runStreams(bool verify)
+{
+    //Reset shared state
+    stream_error.store(0);
+    stream_bytes.store(0);
+    stream_failed_start = 0;
+    stream_failed_size = 0;
+
+    //Start streams, each one handles every n-th file
+    int count = qMin(stream_count, file_infos.size());
+    QList<Stream*> streams;
+    for (int i = 0; i < count; i++)
+    {
+        Stream *stream =
+            new Stream(this, i, verify ? Phase::Verify : Phase::Write);
+        streams << stream;
+        stream->start();
+    }
+
+    //Report progress until all streams are done
+    QElapsedTimer timer;
+    timer.start();
+    bool running = true;
+    while (running)
+    {
+        running = false;
+        foreach (Stream *stream, streams)
+        {
+            if (!stream->wait(200)) running = true;
+        }
+
+        double sec = (double)timer.elapsed() / 1000;
+        qint64 bytes = stream_bytes.load();
+        double avg_speed = sec ? ((double)bytes / MB) / sec : 0;
+        AllocationCounter::Suspend suspend; //not part of I/O path
+        if (verify)
+            emit verified(bytes, avg_speed);
+        else
+            emit written(bytes, avg_speed);
+        readKernelLog();
+    }
+
+    //Collect results
+    bool ok = true;
+    foreach (Stream *stream, streams)
+    {
+        if (!stream->succeeded()) ok = false;
+        delete stream;
+    }
+    if (!ok && stream_error.load())
+    {
+        error_type |= stream_error.load();
+        if (verify)
+            emit verifyFailed(stream_failed_start, stream_failed_size);
+        else
+            emit writeFailed(stream_failed_start, stream_failed_size);
+    }
+
+    return ok;
+}
+
+bool
+VolumeTester::writeStream(int stream)
+{
+    QByteArray block(block_size_max, (char)0);
+    char *data = block.data();
+
+    for (int i = stream, ii = file_infos.size(); i < ii; i += stream_count)
+    {
+        const FileInfo &file_info = file_infos.at(i);
+        QFile *file = file_info.file;
+
+        //Write blocks, no fsync() in between
+        for (int j = 0, jj = file_info.blocks.size(); j < jj; j++)
+        {
+            const BlockInfo &block_info = file_info.blocks.at(j);
+
+            //Stop if another stream has failed
+            if (stream_error.load() || abortRequested()) return false;
+
+            //Write block
+            fillBlock(i, j, data);
+            qint64 begin = test_timer.nsecsElapsed();
+            bool ok = file->seek(block_info.rel_offset) &&
+                file->write(data, block_info.size) == block_info.size;
+            recordBlock(Phase::Write,
+                block_info.abs_offset, block_info.size, begin);
+            if (!ok)
+            {
+                streamFailed(Error::Write,
+                    block_info.abs_offset, block_info.size);
+                return false;
+            }
+
+            stream_bytes.fetchAndAddRelaxed(block_info.size);
+        }
+
+        //Flush once per file and close it
+        //Write errors on a network filesystem are often reported here
+        bool flushed = file->flush();
+        #ifdef USE_FSYNC
+        if (flushed && fsync(file->handle()) != 0) flushed = false;
+        #endif
+        file->close();
+        if (!flushed)
+        {
+            streamFailed(Error::Write, file_info.offset, file_info.size);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool
+VolumeTester::verifyStream(int stream)
+{
+    //Aligned buffer for uncached reads
+    const int alignment = 4096;
+    char *data = (char*)qMallocAligned(block_size_max + alignment, alignment);
+    if (!data)
+    {
+        streamFailed(Error::Verify, 0, 0);
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = stream, ii = file_infos.size(); ok && i < ii;
+        i += stream_count)
+    {
+        const FileInfo &file_info = file_infos.at(i);
+
+        //Reopen by path, the client revalidates the file (close-to-open)
+        //Bypass the client cache, the data has to come from the server
+        QFile file(file_info.path);
+        bool opened = false;
+        #if defined(O_DIRECT)
+        int fd = ::open(QFile::encodeName(file_info.path).constData(),
+            O_RDONLY | O_DIRECT);
+        if (fd != -1)
+        {
+            opened = file.open(fd, QIODevice::ReadOnly | QIODevice::Unbuffered,
+                QFileDevice::AutoCloseHandle);
+            if (!opened) ::close(fd);
+        }
+        #endif
+        if (!opened)
+        {
+            opened = file.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+            #if _XOPEN_SOURCE >= 600 || _POSIX_C_SOURCE >= 200112L
+            if (opened)
+                posix_fadvise(file.handle(), 0, 0, POSIX_FADV_DONTNEED);
+            #endif
+        }
+        if (!opened)
+        {
+            streamFailed(Error::Verify, file_info.offset, file_info.size);
+            ok = false;
+            break;
+        }
+
+        //Read blocks
+        for (int j = 0, jj = file_info.blocks.size(); j < jj; j++)
+        {
+            const BlockInfo &block_info = file_info.blocks.at(j);
+
+            //Stop if another stream has failed
+            if (stream_error.load() || abortRequested())
+            {
+                ok = false;
+                break;
+            }
+
+            //Sample only (wipe)
+            if (!isSampled(block_info.abs_offset / block_size_max,
+                verify_sampling))
+                continue;
+
+            //Read block, length rounded up for O_DIRECT (short read at end)
+            int length = (block_info.size + alignment - 1) /
+                alignment * alignment;
+            qint64 begin = test_timer.nsecsElapsed();
+            bool read = file.seek(block_info.rel_offset) &&
+                file.read(data, length) >= block_info.size;
+            recordBlock(Phase::Verify,
+                block_info.abs_offset, block_info.size, begin);
+            int index = read ? verifyBlock(i, j, data) : -1;
+            if (!read || index != -1)
+            {
+                if (index != -1) recordMismatch(i, j, data, index);
+                captureFailure(Phase::Verify,
+                    block_info.abs_offset, block_info.size, read ? data : 0,
+                    index != -1 ? block_info.abs_offset + index : -1);
+                streamFailed(Error::Verify,
+                    block_info.abs_offset, block_info.size);
+                ok = false;
+                break;
+            }
+
+            stream_bytes.fetchAndAddRelaxed(block_info.size);
+        }
+    }
+
+    qFreeAligned(data);
+    return ok;
+}
+
+/*!
+ * Sends the requests of the workload (see setWorkload())
+ * from one stream per request in flight, until the time is up.
+ * Reports the progress once per stream poll, like runStreams().
+ */
+bool
+VolumeTester::runWorkload()
+{
+    //Start
+    emit workloadStarted(workload.seconds());
+
+    //Reset shared state
+    stream_error.store(0);
+    stream_bytes.store(0);
+    stream_failed_start = 0;
+    stream_failed_size = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        workload_latency[i].clear();
+        workload_bytes[i] = 0;
+    }
+    workload_end = test_timer.nsecsElapsed() +
+        (qint64)workload.seconds() * 1000000000;
+
+    //Start streams, one per request in flight
+    QList<Stream*> streams;
+    for (int i = 0; i < workload.queueDepth(); i++)
+    {
+        Stream *stream = new Stream(this, i, Phase::Workload);
+        streams << stream;
+        stream->start();
+    }
+
+    //Report progress until all streams are done
+    QElapsedTimer timer;
+    timer.start();
+    bool running = true;
+    while (running)
+    {
+        running = false;
+        foreach (Stream *stream, streams)
+        {
+            if (!stream->wait(200)) running = true;
+        }
+
+        double sec = (double)timer.elapsed() / 1000;
+        qint64 bytes = stream_bytes.load();
+        double avg_speed = sec ? ((double)bytes / MB) / sec : 0;
+        AllocationCounter::Suspend suspend; //not part of I/O path
+        emit workloadProgress((int)sec, bytes, avg_speed);
+        readKernelLog();
+    }
+
+    //Collect results
+    bool ok = true;
+    foreach (Stream *stream, streams)
+    {
+        if (!stream->succeeded()) ok = false;
+        delete stream;
+    }
+    if (!ok && stream_error.load())
+    {
+        error_type |= stream_error.load();
+        if (stream_error.load() & Error::Verify)
+            emit verifyFailed(stream_failed_start, stream_failed_size);
+        else
+            emit writeFailed(stream_failed_start, stream_failed_size);
+    }
+
+    return ok;
+}
+
+/*!
+ * Opens a test file for workload requests, uncached if possible.
+ * Returns 0 if it cannot be opened.
+ */
+QFile*
+VolumeTester::openWorkloadFile(const QString &path)
+const
+{
+    QFile *file = new QFile(path);
+    bool opened = false;
+    #if defined(O_DIRECT)
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDWR | O_DIRECT);
+    if (fd != -1)
+    {
+        opened = file->open(fd, QIODevice::ReadWrite | QIODevice::Unbuffered,
+            QFileDevice::AutoCloseHandle);
+        if (!opened) ::close(fd);
+    }
+    #endif
+    if (!opened)
+    {
+        opened = file->open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+        #if _XOPEN_SOURCE >= 600 || _POSIX_C_SOURCE >= 200112L
+        if (opened)
+            posix_fadvise(file->handle(), 0, 0, POSIX_FADV_DONTNEED);
+        #endif
+    }
+    if (!opened)
+    {
+        delete file;
+        return 0;
+    }
+    return file;
+}
+
+bool
+VolumeTester::workloadStream(int stream)
+{
+    //Aligned buffer for uncached requests
+    const int alignment = Workload::ALIGNMENT;
+    char *data = (char*)qMallocAligned(workload.maxSize(), alignment);
+    if (!data)
+    {
+        streamFailed(Error::Write, 0, 0);
+        return false;
+    }
+
+    //Test files opened on first request
+    QVector<QFile*> files(file_infos.size(), 0);
+
+    //Same requests in every test, sequential streams start apart
+    std::mt19937_64 generator(stream + 1);
+    qint64 total = bytes_total / alignment * alignment;
+    qint64 position = total / workload.queueDepth() * stream /
+        alignment * alignment;
+
+    bool ok = true;
+    while (ok && test_timer.nsecsElapsed() < workload_end)
+    {
+        //Stop if another stream has failed
+        if (stream_error.load() || abortRequested())
+        {
+            ok = false;
+            break;
+        }
+
+        //Request within one block, aligned for O_DIRECT
+        Workload::Operation operation =
+            workload.next(generator, position, total);
+        int i = operation.offset / file_size_max;
+        const FileInfo &file_info = file_infos.at(i);
+        int j = (operation.offset - file_info.offset) / block_size_max;
+        const BlockInfo &block_info = file_info.blocks.at(j);
+        int size = qMin((qint64)operation.size,
+            block_info.abs_end - operation.offset) / alignment * alignment;
+        if (size <= 0) continue; //unaligned end of last block
+
+        //Open file
+        if (!files.at(i)) files[i] = openWorkloadFile(file_info.path);
+        QFile *file = files.at(i);
+        if (!file)
+        {
+            streamFailed(operation.write ? Error::Write : Error::Verify,
+                file_info.offset, file_info.size);
+            ok = false;
+            break;
+        }
+
+        //Write the same test data again or read and verify it
+        qint64 rel_offset = operation.offset - file_info.offset;
+        int index = -1;
+        bool done;
+        if (operation.write)
+        {
+            fillRange(i, j, operation.offset, size, data);
+            qint64 begin = test_timer.nsecsElapsed();
+            done = file->seek(rel_offset) && file->write(data, size) == size;
+            recordRequest(true, operation.offset, size, begin);
+        }
+        else
+        {
+            qint64 begin = test_timer.nsecsElapsed();
+            done = file->seek(rel_offset) && file->read(data, size) == size;
+            recordRequest(false, operation.offset, size, begin);
+            if (done) index = verifyRange(i, j, operation.offset, size, data);
+        }
+        if (!done || index != -1)
+        {
+            if (index != -1)
+            {
+                //Expected data, only generated after a failure
+                QByteArray expected(size, (char)0);
+                fillRange(i, j, operation.offset, size, expected.data());
+                int start = qMax(0, index - 16) / 16 * 16;
+                flight_recorder.setFailure(operation.offset + start,
+                    expected.constData() + start, data + start,
+                    qMin(64, size - start));
+            }
+            if (!operation.write)
+                captureFailure(Phase::Workload, operation.offset, size,
+                    done ? data : 0,
+                    index != -1 ? operation.offset + index : -1);
+            streamFailed(operation.write ? Error::Write : Error::Verify,
+                operation.offset, size);
+            ok = false;
+            break;
+        }
+
+        stream_bytes.fetchAndAddRelaxed(size);
+    }
+
+    foreach (QFile *file, files)
+        delete file;
+    qFreeAligned(data);
+    return ok;
+}
+
+void
+VolumeTester::streamFailed(int type, qint64 start, int size)
+{
+    //Remember first failure only
+    QMutexLocker locker(&stream_mutex);
+    if (stream_error.load()) return;
+    stream_failed_start = start;
+    stream_failed_size = size;
+    stream_error.store(type);
+}
+
+/*!
+ * Adds a block to the timeline, which is used to find the block
+ * that was being written or read when a kernel message was logged,
+ * and its latency to the statistics of the current phase.
+ * The block has started at begin (nanoseconds, test timer).
+ * Called from several streams at once with the network profile.
+ */
+void
+VolumeTester::recordBlock(int phase, qint64 offset, int size, qint64 begin)
+{
+    qint64 end = test_timer.nsecsElapsed();
+
+    TimelineEntry entry;
+    entry.phase = phase;
+    entry.offset = offset;
+    entry.size = size;
+    entry.begin = begin / 1000000;
+    entry.end = end / 1000000;
+
+    flight_recorder.record(phase, offset, size, entry.begin, entry.end);
+    recordSample(size, begin, end);
+
+    QMutexLocker locker(&timeline_mutex);
+    timeline << entry;
+    phase_latency.add(end - begin);
+    phase_bytes += size;
+    if (begin >= phase_begin + warmup)
+        phase_blocks << qMakePair((qint64)size, end);
+    live_stats.addBytes(size);
+}
+
+/*!
+ * Adds the throughput (MB/s) and the latency (ms) of a block or request
+ * to the time series (see throughputSeries()).
+ */
+void
+VolumeTester::recordSample(int size, qint64 begin, qint64 end)
+{
+    double nsecs = qMax(end - begin, (qint64)1);
+    qint64 begin_ms = begin / 1000000;
+    qint64 end_ms = end / 1000000;
+    throughput_series->add(begin_ms, end_ms,
+        ((double)size / MB) / (nsecs / 1000000000));
+    latency_series->add(begin_ms, end_ms, nsecs / 1000000);
+}
+
+/*!
+ * Adds a workload request to the statistics of its type.
+ * Not added to the timeline, which only has room for the blocks.
+ */
+void
+VolumeTester::recordRequest(bool write, qint64 offset, int size,
+    qint64 begin)
+{
+    qint64 end = test_timer.nsecsElapsed();
+
+    flight_recorder.record(Phase::Workload, offset, size,
+        begin / 1000000, end / 1000000);
+    recordSample(size, begin, end);
+
+    QMutexLocker locker(&timeline_mutex);
+    workload_latency[write].add(end - begin);
+    workload_bytes[write] += size;
+    phase_latency.add(end - begin);
+    phase_bytes += size;
+    live_stats.addBytes(size);
+}
+
+/*!
+ * Saves a failing region and its neighborhood to the capture file
+ * (see setCapture()) right away, the device may not survive the test.
+ * data is what has been read, if 0, the region is read again.
+ * mismatch is the absolute offset of the first wrong byte (or -1).
+ * Called from several streams at once with the network profile.
+ */
+void
+VolumeTester::captureFailure(int phase, qint64 offset, int size,
+    const char *data, qint64 mismatch)
+{
+    if (!capture.isOpen()) return;
+    AllocationCounter::Suspend suspend; //failure only
+
+    //Failing region
+    QVariantMap info;
+    info["phase"] = phase;
+    info["mismatch"] = mismatch;
+    info["time"] = test_timer.elapsed();
+    info["blocks"] = blockIds(offset, size);
+    QByteArray buffer;
+    if (!data)
+    {
+        buffer = readRegion(offset, size);
+        if (buffer.size() == size)
+            data = buffer.constData();
+        else
+            info["read_error"] = true;
+    }
+    capture.add(offset, data, size, "failure", info);
+
+    //Neighborhood before and after, one block at most per region
+    qint64 begin = qMax((qint64)0, offset - capture_neighborhood);
+    qint64 end = qMin(bytes_total, offset + size + capture_neighborhood);
+    for (qint64 pos = begin; pos < end;)
+    {
+        if (pos >= offset && pos < offset + size)
+        {
+            pos = offset + size;
+            continue;
+        }
+        qint64 stop = pos < offset ? offset : end;
+        int chunk = (int)qMin(stop - pos, block_size_max);
+        QVariantMap info;
+        info["phase"] = phase;
+        info["blocks"] = blockIds(pos, chunk);
+        QByteArray buffer = readRegion(pos, chunk);
+        if (buffer.size() != chunk) info["read_error"] = true;
+        if (!capture.add(pos, buffer.size() == chunk ? buffer.constData() : 0,
+            chunk, "neighbor", info))
+            break; //limit reached
+        pos += chunk;
+    }
+}
+
+/*!
+ * Reads size bytes at the absolute offset from the test files,
+ * uncached, possibly across files. Returns less on a read error.
+ */
+QByteArray
+VolumeTester::readRegion(qint64 offset, int size)
+const
+{
+    QByteArray data;
+    while (data.size() < size)
+    {
+        qint64 pos = offset + data.size();
+        int i = pos / file_size_max;
+        if (i >= file_infos.size()) break;
+        const FileInfo &file_info = file_infos.at(i);
+        int length = (int)qMin((qint64)(size - data.size()),
+            file_info.end - pos);
+
+        //Drop cached pages, the data has to come from the device
+        QFile file(file_info.path);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) break;
+        #if _XOPEN_SOURCE >= 600 || _POSIX_C_SOURCE >= 200112L
+        posix_fadvise(file.handle(), 0, 0, POSIX_FADV_DONTNEED);
+        #endif
+        QByteArray chunk;
+        if (file.seek(pos - file_info.offset)) chunk = file.read(length);
+        data += chunk;
+        if (chunk.size() != length) break;
+    }
+    return data;
+}
+
+/*!
+ * Returns the blocks starting within the specified range
+ * with their id sequence (hex), which is part of the expected data.
+ */
+QVariantList
+VolumeTester::blockIds(qint64 offset, int size)
+const
+{
+    QVariantList ids;
+    for (qint64 pos = offset; pos < offset + size;)
+    {
+        int i = pos / file_size_max;
+        if (i >= file_infos.size()) break;
+        const FileInfo &file_info = file_infos.at(i);
+        const BlockInfo &block_info =
+            file_info.blocks.at((pos - file_info.offset) / block_size_max);
+        if (block_info.abs_offset >= offset &&
+            block_info.size >= block_info.id.size())
+        {
+            QVariantMap map;
+            map["offset"] = block_info.abs_offset;
+            map["id"] = QString::fromLatin1(block_info.id.toHex());
+            ids << map;
+        }
+        pos = block_info.abs_end;
+    }
+    return ids;
+}
+
+/*!
+ * Passes the expected and the actual bytes around the first mismatch
+ * to the flight recorder (first failing block only).
+ */
+void
+VolumeTester::recordMismatch(int file_index, int block_index,
+    const char *data, int index)
+{
+    const BlockInfo &block_info =
+        file_infos.at(file_index).blocks.at(block_index);
+
+    //Expected block, only generated after a failure
+    QByteArray expected(block_info.size, (char)0);
+    fillBlock(file_index, block_index, expected.data());
+
+    int start = qMax(0, index - 16) / 16 * 16;
+    int size = qMin(64, block_info.size - start);
+    flight_recorder.setFailure(block_info.abs_offset + start,
+        expected.constData() + start, data + start, size);
+}
+
+/*!
+ * Tells the device that the free space is unused (FITRIM),
+ * like fstrim. Reports the number of bytes discarded.
+ */
+void
+VolumeTester::discardFreeSpace()
+{
+    bool ok = false;
+    qint64 bytes = 0;
+    #if defined(__linux__) && defined(FITRIM)
+    int fd = ::open(QFile::encodeName(mountpoint()).constData(), O_RDONLY);
+    if (fd != -1)
+    {
+        struct fstrim_range range;
+        range.start = 0;
+        range.len = ~0ULL;
+        range.minlen = 0;
+        ok = ioctl(fd, FITRIM, &range) == 0;
+        if (ok) bytes = range.len; //bytes discarded
+        ::close(fd);
+    }
+    #endif
+    emit discarded(ok, bytes);
+}
+
+void
+VolumeTester::readKernelLog()
+{
+    if (!kernel_log.isOpen()) return;
+    AllocationCounter::Suspend suspend; //only allocates if there are messages
+
+    foreach (KernelLog::Message message, kernel_log.read())
+    {
+        //Block in progress at that time (or the last one before)
+        int phase = Phase::None;
+        qint64 offset = -1;
+        double speed = 0;
+        {
+            QMutexLocker locker(&timeline_mutex);
+            for (int i = timeline.size() - 1; i >= 0; i--)
+            {
+                const TimelineEntry &entry = timeline.at(i);
+                if (entry.begin > message.time) continue;
+                double sec = (double)(entry.end - entry.begin) / 1000;
+                phase = entry.phase;
+                offset = entry.offset;
+                speed = sec ? ((double)entry.size / MB) / sec : 0;
+                break;
+            }
+        }
+
+        emit kernelMessage(message.time, message.text, phase, offset, speed);
+    }
+}
+
@@ -0,0 +1,217 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 Philip Seeger
+** This file is part of CapacityTester.
+**
+** CapacityTester is free software: you can redistribute it and/or modify
+** it under the terms of the GNU General Public License as published by
+** the Free Software Foundation, either version 3 of the License, or
+** (at your option) any later version.
+**
+** CapacityTester is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+** GNU General Public License for more details.
+**
+** You should have received a copy of the GNU General Public License
+** along with CapacityTester. If not, see <http://www.gnu.org/licenses/>.
+**
+****************************************************************************/
+
+#include "workload.hpp"
+
+/*! \class Workload
+ *
+ * \brief The Workload class describes a mixed read/write workload
+ * and generates its requests.
+ *
+ * The workload is specified as a list of settings, e.g.,
+ * "read=70,random=80,depth=4,time=60,bs=4k:60/64k:30/1m:10":
+ * read: percentage of reads (default 50), the rest are writes.
+ * random: percentage of requests at random offsets (default 100),
+ * the rest continue where the previous request of the same queue ended.
+ * depth: number of requests in flight (default 1).
+ * time: duration in seconds (default 60).
+ * bs: request sizes with weights (default 4k),
+ * multiples of 4 KB up to 16 MB.
+ *
+ * Offsets and sizes are aligned to 4 KB, so the requests
+ * can be sent with O_DIRECT. The same generator seed
+ * gives the same sequence of requests.
+ *
+ */
+
+Workload::Workload(const QString &spec)
+        : valid(false),
+          _spec(spec),
+          read_percent(50),
+          random_percent(100),
+          queue_depth(1),
+          _seconds(60),
+          weight_total(0)
+{
+    if (spec.isEmpty()) return;
+
+    foreach (QString setting, spec.split(',', QString::SkipEmptyParts))
+    {
+        QString key = setting.section('=', 0, 0).trimmed();
+        QString value = setting.section('=', 1).trimmed();
+        bool ok = true;
+        if (key == "read")
+        {
+            read_percent = value.toInt(&ok);
+            if (read_percent < 0 || read_percent > 100) ok = false;
+        }
+        else if (key == "random")
+        {
+            random_percent = value.toInt(&ok);
+            if (random_percent < 0 || random_percent > 100) ok = false;
+        }
+        else if (key == "depth")
+        {
+            queue_depth = value.toInt(&ok);
+            if (queue_depth < 1 || queue_depth > 256) ok = false;
+        }
+        else if (key == "time")
+        {
+            _seconds = value.toInt(&ok);
+            if (_seconds < 1) ok = false;
+        }
+        else if (key == "bs")
+        {
+            //Size with optional weight, e.g., 4k:60
+            foreach (QString item, value.split('/'))
+            {
+                int size = parseSize(item.section(':', 0, 0));
+                int weight = 1;
+                if (item.contains(':'))
+                    weight = item.section(':', 1).toInt(&ok);
+                if (!size || !ok || weight < 1) return;
+                sizes << qMakePair(size, weight);
+            }
+        }
+        else
+        {
+            ok = false;
+        }
+        if (!ok) return;
+    }
+
+    //Default request size
+    if (sizes.isEmpty())
+        sizes << qMakePair(ALIGNMENT, 1);
+    for (int i = 0; i < sizes.size(); i++)
+        weight_total += sizes.at(i).second;
+
+    valid = true;
+}
+
+bool
+Workload::isValid()
+const
+{
+    return valid;
+}
+
+QString
+Workload::spec()
+const
+{
+    return _spec;
+}
+
+int
+Workload::readPercent()
+const
+{
+    return read_percent;
+}
+
+int
+Workload::randomPercent()
+const
+{
+    return random_percent;
+}
+
+int
+Workload::queueDepth()
+const
+{
+    return queue_depth;
+}
+
+int
+Workload::seconds()
+const
+{
+    return _seconds;
+}
+
+/*!
+ * Returns the largest request size (bytes).
+ */
+int
+Workload::maxSize()
+const
+{
+    int size = 0;
+    for (int i = 0; i < sizes.size(); i++)
+        size = qMax(size, sizes.at(i).first);
+    return size;
+}
+
+/*!
+ * Returns the next request within the first total bytes.
+ * Sequential requests continue at position, which is updated.
+ * Requests may extend beyond total, they have to be shortened.
+ */
+Workload::Operation
+Workload::next(std::mt19937_64 &generator, qint64 &position, qint64 total)
+const
+{
+    Operation operation;
+    operation.write = (int)(generator() % 100) >= read_percent;
+
+    //Request size (weighted)
+    int pick = generator() % weight_total;
+    operation.size = sizes.first().first;
+    for (int i = 0; i < sizes.size(); i++)
+    {
+        if (pick < sizes.at(i).second)
+        {
+            operation.size = sizes.at(i).first;
+            break;
+        }
+        pick -= sizes.at(i).second;
+    }
+
+    //Random offset or where the last request ended
+    qint64 positions = qMax(total / ALIGNMENT, (qint64)1);
+    if ((int)(generator() % 100) < random_percent)
+        operation.offset = (qint64)(generator() % positions) * ALIGNMENT;
+    else
+        operation.offset = position < total ? position : 0;
+    position = operation.offset + operation.size;
+
+    return operation;
+}
+
+int
+Workload::parseSize(const QString &text)
+{
+    //Number with optional unit (k, m)
+    QString str = text.trimmed().toLower();
+    qint64 factor = 1;
+    if (str.endsWith("k"))
+        factor = 1024;
+    else if (str.endsWith("m"))
+        factor = 1024 * 1024;
+    if (factor != 1) str.chop(1);
+    bool ok;
+    qint64 size = str.toLongLong(&ok) * factor;
+    if (!ok || size <= 0 || size % ALIGNMENT || size > 16 * 1024 * 1024)
+        return 0;
+    return (int)size;
+}
+